@@ -6,21 +6,86 @@
  */
 
 #include <iso15765.h>
+#include <isotp.h>
 #include <bus.h>
 #include <can.h>
+#include <dgas_ring.h>
+#include <dgas_time.h>
+#include <dgas_signal.h>
+#include <dgas_live.h>
+#include <dgas_vehicle.h>
+#include <uds.h>
+#include <string.h>
 #include <stdbool.h>
 
 // stores CAN Bus handle used for OBD CAN messages
 static CAN_HandleTypeDef canBus;
-// stores current CAN filter configuration
-static CAN_FilterTypeDef canFilt;
 // stores task handle for this controller
 static TaskHandle_t taskHandleOBDCAN;
-// flag to indicate if CAN Bus response has been received
-static bool canGotMsg;
+// received frames of each ECU, filled by receive interrupt
+static DRing rxRing[OBD_CAN_ECU_COUNT];
+// storage for rxRing
+static CANFrame rxRingBuff[OBD_CAN_ECU_COUNT][OBD_CAN_RX_RING_SIZE];
+// frames received in listen only mode, waiting to be decoded
+static DRing broadcastRing;
+// storage for broadcastRing
+static CANFrame broadcastRingBuff[OBD_CAN_BROADCAST_RING_SIZE];
+// UDS periodic frames received from ECUs, waiting to be decoded
+static DRing periodicRing;
+// storage for periodicRing
+static CANFrame periodicRingBuff[OBD_CAN_PERIODIC_RING_SIZE];
+// true if peripheral is listening only (never transmits or acknowledges)
+static volatile bool listenOnly;
+// mode CAN task should switch peripheral to
+static volatile bool listenRequested;
+// bit rate bus is configured for
+static CANBitrate bitrate = OBD_CAN_BITRATE_500K;
+// bit rate of each CANBitrate (bits/s)
+static const uint32_t bitrateValues[OBD_CAN_BITRATE_COUNT] = {500000, 250000, 125000, 1000000};
+// true if ECUs are addressed with 29-bit IDs
+static volatile bool extendedIds;
+// address of each ECU which has responded with a 29-bit ID, by ECU index
+static uint8_t ecuAddr[OBD_CAN_ECU_COUNT];
+static volatile uint32_t ecuAddrCount;
+// true once bit rate and addressing are known (detected or cached)
+static bool configValid;
+// requests to all ECUs in a row which timed out without any frame being received
+static uint32_t detectFails;
+// frames received when detectFails was last reset
+static uint32_t detectFrames;
+// time of next detection attempt (ticks)
+static TickType_t detectDue;
+// true once a detected configuration is waiting to be cached by OBD task
+static volatile bool configDetected;
+// traffic statistics of each ID seen, written by receive interrupt
+static CANIdStats profile[OBD_CAN_PROFILE_IDS];
+// overall bus statistics, written by receive and error interrupts
+static CANBusStats busStats;
+// start of current bus load window (us)
+static uint64_t loadWindowStart;
+// bits received in current bus load window
+static uint32_t loadWindowBits;
 // in bound and out bound queues for CAN bus
 QueueHandle_t queueCANRequest;
 QueueHandle_t queueCANResponse;
+// request in flight to each ECU
+static CANSlot slots[OBD_CAN_ECU_COUNT];
+// request in flight to all ECUs, only sent when no ECU has a request in flight
+static CANSlot functional;
+// requests taken from queue which are waiting for their ECU's slot (oldest first)
+static CANRequest backlog[OBD_CAN_BACKLOG_MAX];
+static uint32_t backlogCount;
+// ISO-TP flow control parameters
+static IsoTpConfig isotpCfg = {.blockSize = OBD_CAN_ISOTP_BLOCK_SIZE, .stMin = OBD_CAN_ISOTP_STMIN,
+							   .txStMin = OBD_CAN_ISOTP_TX_STMIN};
+
+static BusStatus obd_can_link_send(uint32_t id, uint8_t* frame, uint32_t len);
+static BusStatus obd_can_link_recv(uint32_t src, uint32_t* id, uint8_t* frame, uint32_t* len, uint32_t timeout);
+static uint32_t obd_can_flow_id(uint32_t src);
+
+// CAN peripheral as ISO-TP link
+static const IsoTpLink canLink = {.send = &obd_can_link_send, .recv = &obd_can_link_recv,
+								  .flowId = &obd_can_flow_id};
 
 /**
  * Initialise GPIO pins required for OBD CAN
@@ -46,43 +111,157 @@ static void obd_can_gpio_init(void) {
 }
 
 /**
- * Initialise CAN peripheral for OBD use
+ * Program a filter bank to accept exactly four standard IDs (16-bit list mode)
+ *
+ * bank: Filter bank to program
+ * ids: IDs to accept (OBD_CAN_FILTER_LIST_IDS of them, repeat an ID to fill the bank)
  *
  * Return: None
  * */
-static void obd_can_init(void) {
-	__OBD_CAN_CLK_EN();
+static void obd_can_filter_list(uint32_t bank, const uint32_t* ids) {
+	CAN_FilterTypeDef filt = {0};
 
-	canFilt.FilterActivation = CAN_FILTER_ENABLE;
-	canFilt.FilterFIFOAssignment = OBD_CAN_FILTER_FIFO;
-	canFilt.FilterMode = CAN_FILTERMODE_IDMASK;
+	filt.FilterBank = bank;
+	filt.FilterMode = CAN_FILTERMODE_IDLIST;
+	filt.FilterScale = CAN_FILTERSCALE_16BIT;
+	// in 16-bit list mode each of the four registers holds an ID
+	filt.FilterIdLow = OBD_CAN_FILTER_STD(ids[0]);
+	filt.FilterIdHigh = OBD_CAN_FILTER_STD(ids[1]);
+	filt.FilterMaskIdLow = OBD_CAN_FILTER_STD(ids[2]);
+	filt.FilterMaskIdHigh = OBD_CAN_FILTER_STD(ids[3]);
+	filt.FilterFIFOAssignment = OBD_CAN_FILTER_FIFO;
+	filt.FilterActivation = CAN_FILTER_ENABLE;
+	filt.SlaveStartFilterBank = OBD_CAN_FILTER_SLAVE_START;
+	HAL_CAN_ConfigFilter(&canBus, &filt);
+}
 
-	// set ID low and high to bound of ECU CAN ID
-	canFilt.FilterIdHigh = OBD_CAN_ID_RESPONSE_UPPER;
-	canFilt.FilterIdLow = OBD_CAN_ID_RESPONSE_LOWER;
+/**
+ * Program a filter bank to accept every frame (standard and extended IDs)
+ *
+ * bank: Filter bank to program
+ *
+ * Return: None
+ * */
+static void obd_can_filter_all(uint32_t bank) {
+	CAN_FilterTypeDef filt = {0};
 
-	// not using extended ID's so FilterIdLow and FilterIdLow mask don't matter
-	canFilt.FilterMaskIdHigh = 0x0000;
-	canFilt.FilterMaskIdLow = 0x0000;
+	// 32-bit mask mode with an empty mask matches any ID
+	filt.FilterBank = bank;
+	filt.FilterMode = CAN_FILTERMODE_IDMASK;
+	filt.FilterScale = CAN_FILTERSCALE_32BIT;
+	filt.FilterFIFOAssignment = OBD_CAN_FILTER_FIFO;
+	filt.FilterActivation = CAN_FILTER_ENABLE;
+	filt.SlaveStartFilterBank = OBD_CAN_FILTER_SLAVE_START;
+	HAL_CAN_ConfigFilter(&canBus, &filt);
+}
+
+/**
+ * Program a filter bank to accept 29-bit ECU response IDs (0x18DAF1xx)
+ *
+ * bank: Filter bank to program
+ *
+ * Return: None
+ * */
+static void obd_can_filter_extended(uint32_t bank) {
+	CAN_FilterTypeDef filt = {0};
+	uint32_t id = OBD_CAN_FILTER_EXT(OBD_CAN_EXT_ID_RESPONSE);
+	uint32_t mask = OBD_CAN_FILTER_EXT(OBD_CAN_EXT_ID_RESPONSE_MASK);
+
+	filt.FilterBank = bank;
+	filt.FilterMode = CAN_FILTERMODE_IDMASK;
+	filt.FilterScale = CAN_FILTERSCALE_32BIT;
+	filt.FilterIdHigh = id >> 16;
+	filt.FilterIdLow = id & 0xFFFF;
+	// IDE bit is part of mask so standard frames don't match
+	filt.FilterMaskIdHigh = mask >> 16;
+	filt.FilterMaskIdLow = mask & 0xFFFF;
+	filt.FilterFIFOAssignment = OBD_CAN_FILTER_FIFO;
+	filt.FilterActivation = CAN_FILTER_ENABLE;
+	filt.SlaveStartFilterBank = OBD_CAN_FILTER_SLAVE_START;
+	HAL_CAN_ConfigFilter(&canBus, &filt);
+}
+
+/**
+ * Disable filter banks from a bank up to the last bank OBD CAN uses
+ *
+ * first: First filter bank to disable
+ *
+ * Return: None
+ * */
+static void obd_can_filter_disable(uint32_t first) {
+	CAN_FilterTypeDef filt = {0};
+
+	for (uint32_t bank = first; bank < OBD_CAN_FILTER_BANKS; bank++) {
+		filt.FilterBank = bank;
+		filt.FilterFIFOAssignment = OBD_CAN_FILTER_FIFO;
+		filt.FilterActivation = CAN_FILTER_DISABLE;
+		filt.SlaveStartFilterBank = OBD_CAN_FILTER_SLAVE_START;
+		HAL_CAN_ConfigFilter(&canBus, &filt);
+	}
+}
+
+/**
+ * Program filter banks so only ECU response IDs (0x7E8 - 0x7EF, or 0x18DAF1xx when ECUs
+ * use 29-bit IDs) are received
+ *
+ * Return: None
+ * */
+static void obd_can_filter_responses(void) {
+	uint32_t ids[OBD_CAN_FILTER_LIST_IDS];
+
+	if (extendedIds) {
+		obd_can_filter_extended(0);
+		obd_can_filter_disable(1);
+		return;
+	}
+	for (uint32_t i = 0; i < OBD_CAN_ECU_COUNT; i += OBD_CAN_FILTER_LIST_IDS) {
+		for (uint32_t j = 0; j < OBD_CAN_FILTER_LIST_IDS; j++) {
+			ids[j] = OBD_CAN_ID_RESPONSE_LOWER + i + j;
+		}
+		obd_can_filter_list(i / OBD_CAN_FILTER_LIST_IDS, ids);
+	}
+}
+
+/**
+ * Initialise CAN peripheral for OBD use at current bit rate and ID length
+ *
+ * mode: CAN_MODE_NORMAL to make requests, CAN_MODE_SILENT to receive every frame without
+ * 		 ever driving the bus (not even acknowledging)
+ *
+ * Return: None
+ * */
+static void obd_can_init(uint32_t mode) {
+	__OBD_CAN_CLK_EN();
 
 	canBus.Instance = OBD_CAN_INSTANCE;
-	canBus.Init.Prescaler = 16;
-	canBus.Init.Mode = CAN_MODE_NORMAL;
+	canBus.Init.Prescaler = HAL_RCC_GetPCLK1Freq() / (OBD_CAN_TQ_PER_BIT * bitrateValues[bitrate]);
+	canBus.Init.Mode = mode;
 	canBus.Init.SyncJumpWidth = CAN_SJW_1TQ;
-	canBus.Init.TimeSeg1 = CAN_BS1_1TQ;
-	canBus.Init.TimeSeg2 = CAN_BS2_1TQ;
+	canBus.Init.TimeSeg1 = CAN_BS1_15TQ;
+	canBus.Init.TimeSeg2 = CAN_BS2_2TQ;
 	canBus.Init.TimeTriggeredMode = DISABLE;
-	canBus.Init.AutoBusOff = DISABLE;
+	// recover from bus off without software intervention, bus off events are counted
+	canBus.Init.AutoBusOff = ENABLE;
 	canBus.Init.AutoWakeUp = DISABLE;
 	canBus.Init.AutoRetransmission = DISABLE;
 	canBus.Init.ReceiveFifoLocked = DISABLE;
 	canBus.Init.TransmitFifoPriority = DISABLE;
-	// configure ID filter for CAN peripheral
-	HAL_CAN_ConfigFilter(&canBus, &canFilt);
-	// enable interrupt callback when message is pending for OBD CAN FIFO
-	HAL_CAN_ActivateNotification(&hcan1, CAN_IT_RX_FIFO0_MSG_PENDING);
-	// initialise CAN peripheral
+	// initialise CAN peripheral, filters and notifications can only be configured once
+	// peripheral is initialised
 	HAL_CAN_Init(&canBus);
+	if (mode == CAN_MODE_SILENT) {
+		obd_can_filter_all(0);
+		obd_can_filter_disable(1);
+	} else {
+		obd_can_filter_responses();
+	}
+	// interrupt when a frame is pending in OBD CAN FIFO
+	HAL_CAN_ActivateNotification(&canBus, OBD_CAN_NOTIFICATION | OBD_CAN_ERROR_NOTIFICATION |
+			CAN_IT_RX_FIFO0_OVERRUN);
+	HAL_NVIC_SetPriority(OBD_CAN_RX_IRQN, 6, 0);
+	HAL_NVIC_EnableIRQ(OBD_CAN_RX_IRQN);
+	HAL_NVIC_SetPriority(OBD_CAN_SCE_IRQN, 6, 0);
+	HAL_NVIC_EnableIRQ(OBD_CAN_SCE_IRQN);
 	HAL_CAN_Start(&canBus);
 }
 
@@ -92,8 +271,13 @@ static void obd_can_init(void) {
  * Return: None
  * */
 void obd_can_hardware_init(void) {
+	for (uint32_t i = 0; i < OBD_CAN_ECU_COUNT; i++) {
+		dgas_ring_init(&rxRing[i], rxRingBuff[i], sizeof(CANFrame), OBD_CAN_RX_RING_SIZE);
+	}
+	dgas_ring_init(&broadcastRing, broadcastRingBuff, sizeof(CANFrame), OBD_CAN_BROADCAST_RING_SIZE);
+	dgas_ring_init(&periodicRing, periodicRingBuff, sizeof(CANFrame), OBD_CAN_PERIODIC_RING_SIZE);
 	obd_can_gpio_init();
-	obd_can_init();
+	obd_can_init(listenOnly ? CAN_MODE_SILENT : CAN_MODE_NORMAL);
 }
 
 /**
@@ -105,63 +289,546 @@ TaskHandle_t task_obd_can_get_handle(void) {
 	return taskHandleOBDCAN;
 }
 
-// This function is called by HAL in the HAL_CAN_IRQHandler()
+/**
+ * Interrupt handler for OBD CAN receive FIFO
+ *
+ * Return: None
+ * */
+void CAN1_RX0_IRQHandler(void) {
+	HAL_CAN_IRQHandler(&canBus);
+}
+
+/**
+ * Interrupt handler for OBD CAN status change and errors
+ *
+ * Return: None
+ * */
+void CAN1_SCE_IRQHandler(void) {
+	HAL_CAN_IRQHandler(&canBus);
+}
+
+/**
+ * Find profiler entry of an ID, claiming a free entry if the ID hasn't been seen
+ * before. At most OBD_CAN_PROFILE_PROBE entries are looked at.
+ *
+ * id: CAN ID
+ *
+ * Return: Entry of ID, NULL if there is no room for ID
+ * */
+static CANIdStats* obd_can_profile_find(uint32_t id) {
+	uint32_t hash = (id ^ (id >> 7) ^ (id >> 14)) & (OBD_CAN_PROFILE_IDS - 1);
+	CANIdStats* entry;
+
+	for (uint32_t i = 0; i < OBD_CAN_PROFILE_PROBE; i++) {
+		entry = &profile[(hash + i) & (OBD_CAN_PROFILE_IDS - 1)];
+		if (entry->count == 0) {
+			entry->id = id;
+			return entry;
+		}
+		if (entry->id == id) {
+			return entry;
+		}
+	}
+	return NULL;
+}
+
+/**
+ * Record a received frame in traffic statistics. Called from receive interrupt.
+ *
+ * frame: Frame received
+ * extended: True if frame has a 29-bit ID
+ * now: Time frame was received (us)
+ *
+ * Return: None
+ * */
+static void obd_can_profile_frame(CANFrame* frame, bool extended, uint64_t now) {
+	CANIdStats* entry;
+	uint32_t period;
+
+	busStats.frames++;
+	loadWindowBits += (extended ? OBD_CAN_FRAME_BITS_EXT : OBD_CAN_FRAME_BITS_STD) +
+			(frame->len * 8);
+	if (now - loadWindowStart >= OBD_CAN_LOAD_WINDOW_US) {
+		// bits / (bitrate * seconds) in 0.1% units
+		busStats.load = (uint32_t) (((uint64_t) loadWindowBits * 1000 * 1000000) /
+				((uint64_t) bitrateValues[bitrate] * (now - loadWindowStart)));
+		loadWindowStart = now;
+		loadWindowBits = 0;
+	}
+
+	if ((entry = obd_can_profile_find(frame->id)) == NULL) {
+		busStats.untracked++;
+		return;
+	}
+	if (entry->count == 0) {
+		entry->first = now;
+		entry->minPeriod = UINT32_MAX;
+	} else {
+		period = (uint32_t) (now - entry->last);
+		if (period < entry->minPeriod) {
+			entry->minPeriod = period;
+		}
+		if (period > entry->maxPeriod) {
+			entry->maxPeriod = period;
+		}
+		for (uint32_t i = 0; i < frame->len; i++) {
+			if (entry->data[i] != frame->data[i]) {
+				entry->changed |= 1 << i;
+			}
+		}
+	}
+	memcpy(entry->data, frame->data, frame->len);
+	entry->len = frame->len;
+	entry->last = now;
+	entry->count++;
+}
+
+// This function is called by HAL in the HAL_CAN_IRQHandler() on errors
+void HAL_CAN_ErrorCallback(CAN_HandleTypeDef* hcan) {
+	if (hcan->Instance != OBD_CAN_INSTANCE) {
+		return;
+	}
+	if (hcan->ErrorCode & HAL_CAN_ERROR_BOF) {
+		busStats.busOff++;
+	}
+	if (hcan->ErrorCode & HAL_CAN_ERROR_EPV) {
+		busStats.errorPassive++;
+	}
+	if (hcan->ErrorCode & HAL_CAN_ERROR_RX_FOV0) {
+		busStats.overrun++;
+	}
+	HAL_CAN_ResetError(hcan);
+}
+
+/**
+ * Get index of ECU with a 29-bit address, giving ECU the next free index if it hasn't
+ * responded before. Called from receive interrupt.
+ *
+ * addr: ECU address (low byte of response ID)
+ *
+ * Return: Index of ECU, OBD_CAN_ECU_COUNT if every index is taken
+ * */
+static uint32_t obd_can_ext_index(uint8_t addr) {
+	uint32_t count = ecuAddrCount;
+
+	for (uint32_t i = 0; i < count; i++) {
+		if (ecuAddr[i] == addr) {
+			return i;
+		}
+	}
+	if (count == OBD_CAN_ECU_COUNT) {
+		return OBD_CAN_ECU_COUNT;
+	}
+	ecuAddr[count] = addr;
+	__DMB();
+	ecuAddrCount = count + 1;
+	return count;
+}
+
+// This function is called by HAL in the HAL_CAN_IRQHandler(). Drains FIFO into the
+// sending ECU's ring (or the broadcast or periodic ring) and wakes the CAN task
 void HAL_CAN_RxFifo0MsgPendingCallback(CAN_HandleTypeDef* hcan) {
-	if (hcan->Instance == OBD_CAN_INSTANCE) {
-		canGotMsg = true;
+	CAN_RxHeaderTypeDef rxHeader;
+	CANFrame frame;
+	BaseType_t woken = pdFALSE;
+	uint64_t now;
+	uint32_t index;
+
+	if (hcan->Instance != OBD_CAN_INSTANCE) {
+		return;
+	}
+	while (HAL_CAN_GetRxFifoFillLevel(hcan, OBD_CAN_FIFO) != 0) {
+		if (HAL_CAN_GetRxMessage(hcan, OBD_CAN_FIFO, &rxHeader, frame.data) != HAL_OK) {
+			break;
+		}
+		now = dgas_time_us();
+		frame.len = (rxHeader.DLC > ISOTP_FRAME_LEN) ? ISOTP_FRAME_LEN : rxHeader.DLC;
+		frame.id = (rxHeader.IDE == CAN_ID_STD) ? rxHeader.StdId : (rxHeader.ExtId | SIGNAL_ID_EXTENDED);
+		obd_can_profile_frame(&frame, rxHeader.IDE != CAN_ID_STD, now);
+		if (listenOnly) {
+			dgas_ring_push(&broadcastRing, &frame);
+			continue;
+		}
+		// filters only pass ECU response IDs but check anyway
+		if (extendedIds) {
+			if ((rxHeader.IDE == CAN_ID_STD) ||
+					((rxHeader.ExtId & OBD_CAN_EXT_ID_RESPONSE_MASK) != OBD_CAN_EXT_ID_RESPONSE) ||
+					((index = obd_can_ext_index(OBD_CAN_EXT_ADDR(rxHeader.ExtId))) == OBD_CAN_ECU_COUNT)) {
+				continue;
+			}
+			// rest of DGOS only sees ECU's index
+			frame.id = OBD_CAN_ECU_ID(index);
+		} else if ((frame.id >= OBD_CAN_ID_RESPONSE_LOWER) && (frame.id <= OBD_CAN_ID_RESPONSE_UPPER)) {
+			index = OBD_CAN_ECU_INDEX(frame.id);
+		} else {
+			continue;
+		}
+		// periodic frames aren't ISO-TP so keep them out of ECU's ring
+		dgas_ring_push((uds_periodic_frame(frame.id, frame.data, frame.len) < 0) ? &rxRing[index] : &periodicRing,
+				&frame);
 	}
+	if (taskHandleOBDCAN != NULL) {
+		vTaskNotifyGiveIndexedFromISR(taskHandleOBDCAN, OBD_CAN_NOTIFY_INDEX, &woken);
+	}
+	portYIELD_FROM_ISR(woken);
+}
+
+/**
+ * Pop next received frame
+ *
+ * src: ID to pop frame of (ISOTP_ANY_ID for any ECU)
+ * dest: Destination to store frame
+ *
+ * Return: True if a frame was popped, false if there are none waiting
+ * */
+static bool obd_can_rx_pop(uint32_t src, CANFrame* dest) {
+	if (src != ISOTP_ANY_ID) {
+		if ((src < OBD_CAN_ID_RESPONSE_LOWER) || (src > OBD_CAN_ID_RESPONSE_UPPER)) {
+			return false;
+		}
+		return dgas_ring_pop(&rxRing[OBD_CAN_ECU_INDEX(src)], dest);
+	}
+	for (uint32_t i = 0; i < OBD_CAN_ECU_COUNT; i++) {
+		if (dgas_ring_pop(&rxRing[i], dest)) {
+			return true;
+		}
+	}
+	return false;
 }
 
 /**
- * Send OBD data to CAN bus
+ * Send a frame on CAN bus, waiting for a free transmit mailbox. ISO-TP link send
+ * function.
  *
- * data: Data to send
- * len: Number of bytes to send
+ * id: CAN ID to send frame with (29-bit if ECUs use 29-bit IDs)
+ * frame: Frame data
+ * len: Number of data bytes (DLC)
  *
  * Returns: Status indicating success or failure
  * */
-BusStatus obd_can_send_data(uint8_t* data, uint32_t len) {
+static BusStatus obd_can_link_send(uint32_t id, uint8_t* frame, uint32_t len) {
+	CAN_TxHeaderTypeDef txHeader = {0};
+	uint32_t waited = 0;
 	uint32_t ptx;
 
-	if (len > BUS_REQUEST_MAX) {
-		return BUS_BUFFER_ERROR;
+	// consecutive frames can be sent faster than they leave the mailboxes
+	while (HAL_CAN_GetTxMailboxesFreeLevel(&canBus) == 0) {
+		if (waited++ == OBD_CAN_TX_TIMEOUT) {
+			return BUS_TX_ERROR;
+		}
+		vTaskDelay(1);
 	}
-	CAN_TxHeaderTypeDef txHeader = {0};
-
-	// number of data bytes
 	txHeader.DLC = len;
-	// use standard 11-bit CAN ID
-	txHeader.IDE = CAN_ID_STD;
-	// set CAN ID to OBD CAN request ID (0x7DF)
-	txHeader.StdId = OBD_CAN_ID_REQUEST;
-	// set data type to a data fram
+	if (extendedIds) {
+		txHeader.IDE = CAN_ID_EXT;
+		txHeader.ExtId = id;
+	} else {
+		txHeader.IDE = CAN_ID_STD;
+		txHeader.StdId = id;
+	}
+	// set data type to a data frame
 	txHeader.RTR = CAN_RTR_DATA;
 
-	if (HAL_CAN_AddTxMessage(&canBus, &txHeader, data, &ptx) != HAL_OK) {
+	if (HAL_CAN_AddTxMessage(&canBus, &txHeader, frame, &ptx) != HAL_OK) {
 		return BUS_TX_ERROR;
 	}
 	return BUS_OK;
 }
 
 /**
- * Read data from CAN bus
+ * Receive next frame from CAN bus, CAN task blocks until the receive interrupt hands
+ * over a frame. ISO-TP link receive function.
  *
- * dest: Destination buffer
+ * src: ID to receive frame from (ISOTP_ANY_ID for any ECU), frames of other ECUs are
+ * 		left in their rings
+ * id: Destination to store CAN ID of frame
+ * frame: Destination to store frame data (8 bytes)
+ * len: Destination to store number of data bytes (DLC)
+ * timeout: Time to wait for a frame (ms)
  *
- * Return: Number of data bytes received
+ * Return: Status indicating success or failure (BUS_RX_ERROR if no frame arrived)
  * */
-uint32_t obd_can_get_data(uint8_t* dest) {
-	CAN_RxHeaderTypeDef rxHeader = {0};
+static BusStatus obd_can_link_recv(uint32_t src, uint32_t* id, uint8_t* frame, uint32_t* len, uint32_t timeout) {
+	CANFrame f;
+	uint64_t start = dgas_time_us();
+	uint64_t limit = (uint64_t) timeout * DGAS_TIME_US_PER_MS;
+	uint64_t elapsed;
 
-	if (HAL_CAN_GetRxMessage(&canBus, OBD_CAN_FIFO, &rxHeader, dest) != HAL_OK) {
+	// notifications count so a frame which arrives between checking the rings and
+	// blocking still wakes us
+	while (!obd_can_rx_pop(src, &f)) {
+		if ((elapsed = dgas_time_us() - start) > limit) {
+			return BUS_RX_ERROR;
+		}
+		ulTaskNotifyTakeIndexed(OBD_CAN_NOTIFY_INDEX, pdTRUE,
+				pdMS_TO_TICKS((limit - elapsed) / DGAS_TIME_US_PER_MS) + 1);
+	}
+	*id = f.id;
+	*len = (f.len > ISOTP_FRAME_LEN) ? ISOTP_FRAME_LEN : f.len;
+	memcpy(frame, f.data, *len);
+	return BUS_OK;
+}
+
+/**
+ * Get ID to send ISO-TP flow control to for an ECU. ISO-TP link flow ID function.
+ *
+ * src: Response ID of ECU
+ *
+ * Return: Physical request ID of ECU
+ * */
+static uint32_t obd_can_flow_id(uint32_t src) {
+	if (extendedIds) {
+		return OBD_CAN_EXT_ID_PHYS(ecuAddr[OBD_CAN_ECU_INDEX(src)]);
+	}
+	return src - OBD_CAN_ID_PHYS_OFFSET;
+}
+
+/**
+ * Get ID requests to all ECUs are sent to
+ *
+ * Return: Functional request ID for current ID length
+ * */
+static uint32_t obd_can_functional_id(void) {
+	return extendedIds ? OBD_CAN_EXT_ID_REQUEST : OBD_CAN_ID_REQUEST;
+}
+
+/**
+ * Discard any received frames which haven't been read (e.g. late responses from
+ * other ECUs to a previous request)
+ *
+ * Return: None
+ * */
+static void obd_can_rx_flush(void) {
+	for (uint32_t i = 0; i < OBD_CAN_ECU_COUNT; i++) {
+		dgas_ring_flush(&rxRing[i]);
+	}
+}
+
+/**
+ * Stop CAN peripheral and initialise it again (e.g. after bit rate, ID length or mode
+ * changes). Frames received under the old configuration are discarded.
+ *
+ * mode: CAN_MODE_NORMAL or CAN_MODE_SILENT
+ *
+ * Return: None
+ * */
+static void obd_can_reconfigure(uint32_t mode) {
+	HAL_CAN_Stop(&canBus);
+	obd_can_rx_flush();
+	dgas_ring_flush(&periodicRing);
+	// ECUs using 29-bit IDs are indexed again as they respond
+	ecuAddrCount = 0;
+	obd_can_init(mode);
+}
+
+/**
+ * Set ISO-TP flow control parameters used for requests and responses
+ *
+ * cfg: New parameters
+ *
+ * Return: None
+ * */
+void obd_can_set_isotp_config(const IsoTpConfig* cfg) {
+	memcpy(&isotpCfg, cfg, sizeof(IsoTpConfig));
+}
+
+/**
+ * Get ISO-TP flow control parameters used for requests and responses
+ *
+ * dest: Destination to store parameters
+ *
+ * Return: None
+ * */
+void obd_can_get_isotp_config(IsoTpConfig* dest) {
+	memcpy(dest, &isotpCfg, sizeof(IsoTpConfig));
+}
+
+/**
+ * Switch CAN peripheral between listen only mode, where broadcast frames are decoded
+ * through the signal database into the live data table, and normal mode where requests
+ * can be made. Requests made while listening fail with BUS_TX_ERROR.
+ *
+ * enable: True to listen only, false for normal mode
+ *
+ * Return: None
+ * */
+void obd_can_set_listen_only(bool enable) {
+	listenRequested = enable;
+	if (taskHandleOBDCAN != NULL) {
+		// CAN task switches mode
+		xTaskNotifyGiveIndexed(taskHandleOBDCAN, OBD_CAN_NOTIFY_INDEX);
+	}
+}
+
+/**
+ * Check if CAN peripheral is in listen only mode
+ *
+ * Return: True if listening only, false otherwise
+ * */
+bool obd_can_is_listen_only(void) {
+	return listenOnly;
+}
+
+/**
+ * Take configuration detected since last call, for OBD task to cache in vehicle profile
+ *
+ * dest: Destination to store configuration
+ *
+ * Return: True if a configuration was detected, false otherwise
+ * */
+bool obd_can_take_detected_config(CANConfig* dest) {
+	if (!configDetected) {
+		return false;
+	}
+	configDetected = false;
+	return obd_can_get_config(dest);
+}
+
+/**
+ * Get bus configuration in use
+ *
+ * dest: Destination to store configuration
+ *
+ * Return: True if configuration was detected (or cached), false if it isn't known
+ * */
+bool obd_can_get_config(CANConfig* dest) {
+	dest->bitrate = bitrate;
+	dest->extended = extendedIds;
+	return configValid;
+}
+
+/**
+ * Clear traffic statistics
+ *
+ * Return: None
+ * */
+void obd_can_profile_reset(void) {
+	taskENTER_CRITICAL();
+	memset(profile, 0, sizeof(profile));
+	memset(&busStats, 0, sizeof(busStats));
+	loadWindowStart = dgas_time_us();
+	loadWindowBits = 0;
+	taskEXIT_CRITICAL();
+}
+
+/**
+ * Get traffic statistics of every ID seen. Each entry is copied with interrupts masked
+ * so it is consistent, interrupts are only held off for a single entry at a time.
+ *
+ * dest: Destination array of statistics
+ * max: Maximum number of entries to store
+ *
+ * Return: Number of entries stored
+ * */
+uint32_t obd_can_profile_report(CANIdStats* dest, uint32_t max) {
+	uint32_t count = 0;
+
+	for (uint32_t i = 0; (i < OBD_CAN_PROFILE_IDS) && (count < max); i++) {
+		taskENTER_CRITICAL();
+		if (profile[i].count != 0) {
+			memcpy(&dest[count++], &profile[i], sizeof(CANIdStats));
+		}
+		taskEXIT_CRITICAL();
+	}
+	return count;
+}
+
+/**
+ * Get average time between frames of an ID
+ *
+ * stats: Statistics of ID
+ *
+ * Return: Average period (us), 0 if fewer than two frames have been received
+ * */
+uint32_t obd_can_profile_avg_period(const CANIdStats* stats) {
+	if (stats->count < 2) {
 		return 0;
 	}
-	// return number of data bytes read
-	return rxHeader.DLC;
+	return (uint32_t) ((stats->last - stats->first) / (stats->count - 1));
+}
+
+/**
+ * Get overall bus statistics
+ *
+ * dest: Destination to store statistics
+ *
+ * Return: None
+ * */
+void obd_can_get_bus_stats(CANBusStats* dest) {
+	uint64_t now = dgas_time_us();
+	uint32_t esr;
+
+	taskENTER_CRITICAL();
+	memcpy(dest, &busStats, sizeof(CANBusStats));
+	if (now - loadWindowStart >= 2 * OBD_CAN_LOAD_WINDOW_US) {
+		// no frames have closed a window for a while so bus is idle
+		dest->load = 0;
+	}
+	taskEXIT_CRITICAL();
+	if (canBus.Instance != NULL) {
+		esr = canBus.Instance->ESR;
+		dest->tec = (esr & CAN_ESR_TEC) >> CAN_ESR_TEC_Pos;
+		dest->rec = (esr & CAN_ESR_REC) >> CAN_ESR_REC_Pos;
+	}
 }
 
 /**
- * Make request and get response on OBD CAN bus
+ * Queue a request for the CAN task. Returns as soon as request is queued, the caller is
+ * notified (OBD_CAN_NOTIFY_INDEX) once the response is in the reply slot. Requests to
+ * different ECUs are in flight at the same time.
+ *
+ * ecu: Response ID of ECU to send request to (0x7E8 - 0x7EF), OBD_CAN_ID_REQUEST to send
+ * 		to all ECUs
+ * req: Request to make
+ * reply: Reply slot to store response, must remain valid until request completes (NULL
+ * 		  to send response to queueCANResponse instead)
+ *
+ * Return: Status indicating success or failure
+ * */
+BusStatus obd_can_submit(uint32_t ecu, BusRequest* req, BusResponse* reply) {
+	CANRequest creq;
+
+	if (queueCANRequest == NULL) {
+		return BUS_INIT_ERROR;
+	}
+	if ((ecu != OBD_CAN_ID_REQUEST) &&
+			((ecu < OBD_CAN_ID_RESPONSE_LOWER) || (ecu > OBD_CAN_ID_RESPONSE_UPPER))) {
+		return BUS_TX_ERROR;
+	}
+	memcpy(&creq.bus, req, sizeof(BusRequest));
+	creq.ecu = ecu;
+	creq.reply = reply;
+	creq.caller = xTaskGetCurrentTaskHandle();
+	if (reply != NULL) {
+		reply->status = BUS_NULL;
+	}
+	if (xQueueSend(queueCANRequest, &creq, 0) != pdTRUE) {
+		return BUS_BUFFER_ERROR;
+	}
+	// CAN task may be blocked waiting for frames
+	xTaskNotifyGiveIndexed(taskHandleOBDCAN, OBD_CAN_NOTIFY_INDEX);
+	return BUS_OK;
+}
+
+/**
+ * Wait for a request made with obd_can_submit() to complete. CAN task completes every
+ * request once its timeout passes so the reply slot can't be written after we return.
+ *
+ * reply: Reply slot given to obd_can_submit()
+ *
+ * Return: Status of response
+ * */
+BusStatus obd_can_wait(BusResponse* reply) {
+	while (reply->status == BUS_NULL) {
+		ulTaskNotifyTakeIndexed(OBD_CAN_NOTIFY_INDEX, pdTRUE, portMAX_DELAY);
+	}
+	__DMB();
+	return reply->status;
+}
+
+/**
+ * Make request and get response on OBD CAN bus. Request is sent to all ECUs and the
+ * first ECU to respond is received, multi-frame responses are reassembled by ISO-TP.
  *
  * req: Request to make
  * resp: Pointer to struct to store response
@@ -170,58 +837,509 @@ uint32_t obd_can_get_data(uint8_t* dest) {
  * */
 BusStatus obd_can_make_request(BusRequest* req, BusResponse* resp) {
 	BusStatus status;
-	uint32_t timeout = 0;
-	// make sure to reset flag from previous use before making request
-	canGotMsg = false;
 
-	if ((status = obd_can_send_data(req->data, req->dataLen)) != BUS_OK) {
+	if ((status = obd_can_submit(OBD_CAN_ID_REQUEST, req, resp)) != BUS_OK) {
 		return status;
 	}
-	// request has been made, now wait for response or until timeout
-	while(!canGotMsg && (timeout < req->timeout)) {
-		timeout++;
-		vTaskDelay(1);
+	return obd_can_wait(resp);
+}
+
+/**
+ * Complete the request in flight in a slot, store response in caller's reply slot and
+ * notify caller. Response data is already in the reply slot so only its length, frames
+ * and status are stored.
+ *
+ * slot: Slot to complete
+ * status: Status to complete request with
+ *
+ * Return: None
+ * */
+static void obd_can_complete(CANSlot* slot, BusStatus status) {
+	BusResponse* reply = slot->req.reply;
+
+	slot->busy = false;
+	if (status == BUS_OK) {
+		detectFails = 0;
 	}
-	if (timeout == req->timeout) {
-		return BUS_RX_ERROR;
+	if (reply == NULL) {
+		slot->resp.status = status;
+		xQueueSend(queueCANResponse, &slot->resp, 0);
+		return;
 	}
-	resp->dataLen = obd_can_get_data(resp->data);
+	reply->dataLen = slot->resp.dataLen;
+	reply->frameCount = slot->resp.frameCount;
+	memcpy(reply->frames, slot->resp.frames, slot->resp.frameCount * sizeof(BusFrame));
+	// caller polls status so it must be written last
+	__DMB();
+	reply->status = status;
+	xTaskNotifyGiveIndexed(slot->req.caller, OBD_CAN_NOTIFY_INDEX);
+}
 
-	if (resp->dataLen == 0) {
-		return BUS_RX_ERROR;
+/**
+ * Check if a response answers the request in flight. A negative response must name the
+ * request's service, a positive response must be for the request's service and echo its
+ * first parameter byte (PID, DID, sub-function) if it has one.
+ *
+ * req: Request in flight
+ * data: Response
+ * len: Length of response
+ *
+ * Return: True if response is for request, false otherwise (e.g. late response to an
+ * 		   earlier request)
+ * */
+static bool obd_can_response_matches(BusRequest* req, uint8_t* data, uint32_t len) {
+	if ((len == 0) || (req->dataLen == 0)) {
+		return false;
+	}
+	if (data[0] == OBD_CAN_SID_NEGATIVE) {
+		return (len > OBD_CAN_NRC_INDEX) && (data[1] == req->data[0]);
+	}
+	if (data[0] != req->data[0] + OBD_CAN_SID_POSITIVE_OFFSET) {
+		return false;
+	}
+	if ((req->dataLen > 1) && (len > 1)) {
+		return data[1] == req->data[1];
+	}
+	return true;
+}
+
+/**
+ * Get slot a request is sent through
+ *
+ * req: Request
+ *
+ * Return: Slot of request's ECU, functional slot if request is for all ECUs
+ * */
+static CANSlot* obd_can_slot_of(CANRequest* req) {
+	if (req->ecu == OBD_CAN_ID_REQUEST) {
+		return &functional;
+	}
+	return &slots[OBD_CAN_ECU_INDEX(req->ecu)];
+}
+
+/**
+ * Check if any ECU has a request in flight
+ *
+ * Return: True if a request is in flight to any ECU, false otherwise
+ * */
+static bool obd_can_any_busy(void) {
+	for (uint32_t i = 0; i < OBD_CAN_ECU_COUNT; i++) {
+		if (slots[i].busy) {
+			return true;
+		}
+	}
+	return false;
+}
+
+/**
+ * Send a request and put it in flight in its slot
+ *
+ * req: Request to send
+ *
+ * Return: None
+ * */
+static void obd_can_send(CANRequest* req) {
+	CANSlot* slot = obd_can_slot_of(req);
+	BusStatus status;
+
+	memcpy(&slot->req, req, sizeof(CANRequest));
+	slot->resp.dataLen = 0;
+	slot->resp.frameCount = 0;
+	slot->busy = true;
+	slot->deadline = dgas_time_us() + (uint64_t) req->bus.timeout * DGAS_TIME_US_PER_MS;
+
+	if (listenOnly) {
+		obd_can_complete(slot, BUS_TX_ERROR);
+		return;
+	}
+	if (!configValid) {
+		// bus hasn't been found yet
+		obd_can_complete(slot, BUS_INIT_ERROR);
+		return;
+	}
+	if (req->ecu == OBD_CAN_ID_REQUEST) {
+		// anything still waiting to be read doesn't belong to this request
+		obd_can_rx_flush();
+		status = isotp_send(&canLink, &isotpCfg, obd_can_functional_id(), ISOTP_ANY_ID,
+				req->bus.data, req->bus.dataLen);
+	} else if (extendedIds && (OBD_CAN_ECU_INDEX(req->ecu) >= ecuAddrCount)) {
+		// no ECU has responded with this index so its address isn't known
+		status = BUS_TX_ERROR;
+	} else {
+		dgas_ring_flush(&rxRing[OBD_CAN_ECU_INDEX(req->ecu)]);
+		status = isotp_send(&canLink, &isotpCfg, obd_can_flow_id(req->ecu), req->ecu,
+				req->bus.data, req->bus.dataLen);
+	}
+	if (status != BUS_OK) {
+		obd_can_complete(slot, status);
+	}
+}
+
+/**
+ * Take newly queued requests into backlog then send every backlogged request whose
+ * slot is free. A request to all ECUs waits until no ECU has a request in flight and
+ * holds back the requests behind it so it can't be starved.
+ *
+ * Return: None
+ * */
+static void obd_can_dispatch(void) {
+	CANRequest req;
+
+	while ((backlogCount < OBD_CAN_BACKLOG_MAX) &&
+			(xQueueReceive(queueCANRequest, &req, 0) == pdTRUE)) {
+		memcpy(&backlog[backlogCount++], &req, sizeof(CANRequest));
+	}
+	for (uint32_t i = 0; i < backlogCount;) {
+		CANRequest* next = &backlog[i];
+
+		if (functional.busy) {
+			return;
+		}
+		if (next->ecu == OBD_CAN_ID_REQUEST) {
+			if (obd_can_any_busy()) {
+				return;
+			}
+		} else if (obd_can_slot_of(next)->busy) {
+			// ECU already has a request in flight, keep order of requests to each ECU
+			i++;
+			continue;
+		}
+		memcpy(&req, next, sizeof(CANRequest));
+		backlogCount--;
+		memmove(&backlog[i], &backlog[i + 1], (backlogCount - i) * sizeof(CANRequest));
+		obd_can_send(&req);
+	}
+}
+
+/**
+ * Receive waiting responses and complete the requests they answer. Responses are
+ * matched to requests by the ECU they come from and their service and PID, not by the
+ * order they arrive in.
+ *
+ * Return: None
+ * */
+static void obd_can_receive(void) {
+	CANSlot* slot;
+	uint8_t* data;
+	uint32_t src, len;
+	BusStatus status;
+
+	for (uint32_t i = 0; i < OBD_CAN_ECU_COUNT; i++) {
+		if (dgas_ring_used(&rxRing[i]) == 0) {
+			continue;
+		}
+		slot = slots[i].busy ? &slots[i] : (functional.busy ? &functional : NULL);
+		if (slot == NULL) {
+			// nothing in flight to this ECU
+			dgas_ring_flush(&rxRing[i]);
+			continue;
+		}
+		src = OBD_CAN_ECU_ID(i);
+		// reassemble straight into caller's reply slot, caller doesn't read it until
+		// status is set
+		data = (slot->req.reply != NULL) ? slot->req.reply->data : slot->resp.data;
+		// first frame is already waiting, only consecutive frames are waited on
+		status = isotp_receive(&canLink, &isotpCfg, &src, data, sizeof(slot->resp.data), &len, 1);
+		if (status == BUS_BUFFER_ERROR) {
+			obd_can_complete(slot, status);
+			continue;
+		}
+		if ((status != BUS_OK) || !obd_can_response_matches(&slot->req.bus, data, len)) {
+			continue;
+		}
+		if ((data[0] == OBD_CAN_SID_NEGATIVE) && (data[OBD_CAN_NRC_INDEX] == OBD_CAN_NRC_RESPONSE_PENDING)) {
+			// real response is still to come
+			slot->deadline = dgas_time_us() + (uint64_t) OBD_CAN_TIMEOUT_PENDING * DGAS_TIME_US_PER_MS;
+			continue;
+		}
+		slot->resp.dataLen = len;
+		slot->resp.frames[0].src = src;
+		slot->resp.frames[0].offset = 0;
+		slot->resp.frames[0].len = len;
+		slot->resp.frameCount = 1;
+		obd_can_complete(slot, BUS_OK);
+	}
+}
+
+/**
+ * Complete requests whose response hasn't arrived in time
+ *
+ * now: Current time (us)
+ *
+ * Return: None
+ * */
+static void obd_can_expire(uint64_t now) {
+	for (uint32_t i = 0; i < OBD_CAN_ECU_COUNT; i++) {
+		if (slots[i].busy && (now >= slots[i].deadline)) {
+			obd_can_complete(&slots[i], BUS_RX_ERROR);
+		}
+	}
+	if (functional.busy && (now >= functional.deadline)) {
+		obd_can_complete(&functional, BUS_RX_ERROR);
+		if (busStats.frames != detectFrames) {
+			// ECUs are responding, just not to this request (e.g. unsupported PID)
+			detectFrames = busStats.frames;
+			detectFails = 0;
+		} else if (configValid && !listenOnly && (++detectFails >= OBD_CAN_DETECT_FAILS)) {
+			// cached configuration may be for another vehicle
+			configValid = false;
+			detectDue = xTaskGetTickCount();
+		}
 	}
-	return BUS_OK;
 }
 
 /**
- * Thread function for OBD CAN controller task
+ * Decode broadcast frames received while listening
+ *
+ * Return: None
+ * */
+static void obd_can_decode_broadcast(void) {
+	CANFrame frame;
+
+	while (dgas_ring_pop(&broadcastRing, &frame)) {
+		dgas_signal_decode(frame.id, frame.data, frame.len, dgas_live_now());
+	}
+}
+
+/**
+ * Complete every request in flight
+ *
+ * status: Status to complete requests with
+ *
+ * Return: None
+ * */
+static void obd_can_fail_all(BusStatus status) {
+	for (uint32_t i = 0; i < OBD_CAN_ECU_COUNT; i++) {
+		if (slots[i].busy) {
+			obd_can_complete(&slots[i], status);
+		}
+	}
+	if (functional.busy) {
+		obd_can_complete(&functional, status);
+	}
+}
+
+/**
+ * Listen to bus in silent mode at a bit rate
+ *
+ * rate: Bit rate to listen at
+ *
+ * Return: True if a frame was received, false otherwise. A frame only passes its CRC
+ * 		   check at the bus' bit rate
+ * */
+static bool obd_can_listen_at(CANBitrate rate) {
+	uint32_t frames;
+
+	bitrate = rate;
+	obd_can_reconfigure(CAN_MODE_SILENT);
+	frames = busStats.frames;
+	vTaskDelay(pdMS_TO_TICKS(OBD_CAN_DETECT_LISTEN));
+	return busStats.frames != frames;
+}
+
+/**
+ * Send mode 01 PID 00 to all ECUs at current bit rate
+ *
+ * extended: True to use 29-bit IDs, false for 11-bit IDs
+ *
+ * Return: True if an ECU responded, false otherwise
+ * */
+static bool obd_can_probe(bool extended) {
+	uint8_t req[] = {OBD_CAN_DETECT_SERVICE, OBD_CAN_DETECT_PID};
+	uint8_t frame[ISOTP_FRAME_LEN];
+	uint32_t id, len;
+
+	extendedIds = extended;
+	obd_can_reconfigure(CAN_MODE_NORMAL);
+	if (isotp_send(&canLink, &isotpCfg, obd_can_functional_id(), ISOTP_ANY_ID, req, sizeof(req)) != BUS_OK) {
+		return false;
+	}
+	// filters only pass response IDs of the ID length being probed
+	return obd_can_link_recv(ISOTP_ANY_ID, &id, frame, &len, OBD_CAN_DETECT_TIMEOUT) == BUS_OK;
+}
+
+/**
+ * Detect bus bit rate and whether ECUs use 11 or 29-bit IDs. Every bit rate is listened
+ * to first so the bus isn't disturbed by transmitting at the wrong rate, requests are only
+ * sent at each rate in turn if the bus is silent at all of them. Addressing can't be
+ * found in listen only mode.
+ *
+ * Return: True if configuration was found, false otherwise
+ * */
+static bool obd_can_detect(void) {
+	uint32_t heard = OBD_CAN_BITRATE_COUNT;
+
+	for (uint32_t rate = 0; rate < OBD_CAN_BITRATE_COUNT; rate++) {
+		if (obd_can_listen_at(rate)) {
+			heard = rate;
+			break;
+		}
+	}
+	if (listenOnly) {
+		bitrate = (heard == OBD_CAN_BITRATE_COUNT) ? OBD_CAN_BITRATE_500K : heard;
+		return heard != OBD_CAN_BITRATE_COUNT;
+	}
+	for (uint32_t rate = 0; rate < OBD_CAN_BITRATE_COUNT; rate++) {
+		if ((heard != OBD_CAN_BITRATE_COUNT) && (rate != heard)) {
+			continue;
+		}
+		bitrate = rate;
+		if (obd_can_probe(false) || obd_can_probe(true)) {
+			return true;
+		}
+	}
+	bitrate = OBD_CAN_BITRATE_500K;
+	extendedIds = false;
+	return false;
+}
+
+/**
+ * Detect bus configuration if it isn't known and a detection attempt is due. Once found
+ * OBD task is left to cache configuration in active vehicle's profile, so profiles are
+ * only ever written by one task.
+ *
+ * Return: None
+ * */
+static void obd_can_autodetect(void) {
+	if (configValid || ((int32_t) (xTaskGetTickCount() - detectDue) < 0)) {
+		return;
+	}
+	obd_can_fail_all(BUS_INIT_ERROR);
+	configValid = obd_can_detect();
+	detectFails = 0;
+	obd_can_reconfigure(listenOnly ? CAN_MODE_SILENT : CAN_MODE_NORMAL);
+	if (!configValid) {
+		detectDue = xTaskGetTickCount() + pdMS_TO_TICKS(OBD_CAN_DETECT_RETRY);
+		return;
+	}
+	if (!listenOnly) {
+		configDetected = true;
+	}
+}
+
+/**
+ * Decode UDS periodic frames streamed by ECUs
+ *
+ * Return: None
+ * */
+static void obd_can_decode_periodic(void) {
+	CANFrame frame;
+
+	while (dgas_ring_pop(&periodicRing, &frame)) {
+		uds_periodic_decode(frame.id, frame.data, frame.len, dgas_live_now());
+	}
+}
+
+/**
+ * Switch CAN peripheral to requested mode if it isn't already in it. Requests in flight
+ * are failed since their responses can't be received in listen only mode.
+ *
+ * Return: None
+ * */
+static void obd_can_apply_mode(void) {
+	if (listenRequested == listenOnly) {
+		return;
+	}
+	obd_can_fail_all(BUS_TX_ERROR);
+	listenOnly = listenRequested;
+	dgas_ring_flush(&broadcastRing);
+	if (listenOnly) {
+		// database may have changed since last time
+		dgas_signal_load();
+	} else {
+		dgas_signal_clear();
+	}
+	obd_can_reconfigure(listenOnly ? CAN_MODE_SILENT : CAN_MODE_NORMAL);
+}
+
+/**
+ * Get time CAN task can block for, until the earliest request deadline (or detection
+ * attempt) or until a frame or request arrives
+ *
+ * now: Current time (us)
+ *
+ * Return: Ticks to block for (0 if frames are already waiting)
+ * */
+static TickType_t obd_can_idle_ticks(uint64_t now) {
+	uint64_t earliest = UINT64_MAX;
+	TickType_t ticks;
+	int32_t detect;
+
+	if ((dgas_ring_used(&broadcastRing) != 0) || (dgas_ring_used(&periodicRing) != 0)) {
+		return 0;
+	}
+	for (uint32_t i = 0; i < OBD_CAN_ECU_COUNT; i++) {
+		if (dgas_ring_used(&rxRing[i]) != 0) {
+			return 0;
+		}
+		if (slots[i].busy && (slots[i].deadline < earliest)) {
+			earliest = slots[i].deadline;
+		}
+	}
+	if (functional.busy && (functional.deadline < earliest)) {
+		earliest = functional.deadline;
+	}
+	if (earliest == UINT64_MAX) {
+		ticks = portMAX_DELAY;
+	} else if (earliest <= now) {
+		return 0;
+	} else {
+		ticks = pdMS_TO_TICKS((earliest - now) / DGAS_TIME_US_PER_MS) + 1;
+	}
+	if (!configValid) {
+		// wake up for next detection attempt
+		if ((detect = (int32_t) (detectDue - xTaskGetTickCount())) <= 0) {
+			return 0;
+		}
+		if ((TickType_t) detect < ticks) {
+			ticks = detect;
+		}
+	}
+	return ticks;
+}
+
+/**
+ * Thread function for OBD CAN controller task. Keeps a request in flight to each ECU
+ * which has one waiting.
  *
  * Return: None
  * */
 void task_obd_can(void) {
-	BusRequest req = {0};
-	BusResponse resp = {0};
+	CANConfig cached;
 
+	// connect with configuration vehicle last used, detect it if there isn't one
+	if (dgas_vehicle_last_can_config(&cached) && (cached.bitrate < OBD_CAN_BITRATE_COUNT)) {
+		bitrate = cached.bitrate;
+		extendedIds = cached.extended;
+		configValid = true;
+	}
 	// init CAN peripheral and in bound and out bound queues
-	obd_can_init();
-	queueCANRequest = xQueueCreate(1, sizeof(BusRequest));
-	queueCANResponse = xQueueCreate(1, sizeof(BusResponse));
+	obd_can_hardware_init();
+	queueCANResponse = xQueueCreate(OBD_CAN_QUEUE_LENGTH, sizeof(BusResponse));
+	queueCANRequest = xQueueCreate(OBD_CAN_QUEUE_LENGTH, sizeof(CANRequest));
 
 	for (;;) {
-		if (xQueueReceive(queueCANRequest, &req, 10) == pdTRUE) {
-			// got request so send over bus and get response
-			resp.status = obd_can_make_request(&req, &resp);
-			xQueueSend(queueCANResponse, &resp, 10);
-		}
+		obd_can_apply_mode();
+		obd_can_autodetect();
+		obd_can_decode_broadcast();
+		obd_can_decode_periodic();
+		obd_can_dispatch();
+		obd_can_receive();
+		obd_can_expire(dgas_time_us());
+		// woken by receive interrupt or by a new request
+		ulTaskNotifyTakeIndexed(OBD_CAN_NOTIFY_INDEX, pdTRUE, obd_can_idle_ticks(dgas_time_us()));
 	}
 }
 
 /**
- * Initialise OBD CAN controller task
+ * Initialise OBD CAN controller task, does nothing if task is already running
  *
  * Return: None
  * */
 void task_init_obd_can(void) {
+	if (taskHandleOBDCAN != NULL) {
+		return;
+	}
 	xTaskCreate((void*) &task_obd_can, "TaskOBDCAN", DGAS_TASK_OBD_CAN_STACK_SIZE,
 			NULL, DGAS_TASK_OBD_CAN_PRIORITY, &taskHandleOBDCAN);
 }
@@ -0,0 +1,312 @@
+/*
+ * isotp.c
+ *
+ *  Created on: 18 Oct. 2026
+ *      Author: rhett
+ */
+
+// ISO 15765-2 (ISO-TP) transport layer. Messages longer than a single CAN frame are
+// sent as a first frame followed by consecutive frames paced by the receiver's flow
+// control, received messages are reassembled straight into the caller's buffer. Only
+// the IsoTpLink it is given is used to reach the bus so it can run against a virtual ECU.
+
+#include <isotp.h>
+#include <dgas_time.h>
+#include <string.h>
+
+/**
+ * Convert STmin to a separation time
+ *
+ * stMin: STmin as sent in flow control frame
+ *
+ * Return: Separation time (us)
+ * */
+uint32_t isotp_stmin_to_us(uint8_t stMin) {
+	if (stMin <= ISOTP_STMIN_MS_MAX) {
+		return stMin * DGAS_TIME_US_PER_MS;
+	}
+	if ((stMin >= ISOTP_STMIN_US_FIRST) && (stMin <= ISOTP_STMIN_US_LAST)) {
+		return (stMin - ISOTP_STMIN_US_FIRST + 1) * ISOTP_STMIN_US_STEP;
+	}
+	// reserved, use longest separation
+	return ISOTP_STMIN_MS_MAX * DGAS_TIME_US_PER_MS;
+}
+
+/**
+ * Wait separation time between consecutive frames
+ *
+ * us: Separation time (us)
+ *
+ * Return: None
+ * */
+static void isotp_separate(uint32_t us) {
+	uint64_t end = dgas_time_us() + us;
+	uint64_t now;
+
+	if (us >= 2 * DGAS_TIME_US_PER_MS) {
+		// sleep whole ticks (may wake up to a tick early) then busy wait the remainder
+		vTaskDelay(pdMS_TO_TICKS(us / DGAS_TIME_US_PER_MS) - 1);
+	}
+	if ((now = dgas_time_us()) < end) {
+		dgas_time_delay_us((uint32_t) (end - now));
+	}
+}
+
+/**
+ * Send a single padded frame
+ *
+ * link: Link to send frame on
+ * id: ID to send frame with
+ * pci: Protocol control information bytes
+ * pciLen: Number of PCI bytes
+ * data: Data to send after PCI
+ * len: Number of data bytes
+ *
+ * Return: Status indicating success or failure
+ * */
+static BusStatus isotp_send_frame(const IsoTpLink* link, uint32_t id, uint8_t* pci, uint32_t pciLen,
+		uint8_t* data, uint32_t len) {
+	uint8_t frame[ISOTP_FRAME_LEN];
+
+	memset(frame, ISOTP_FRAME_PAD, sizeof(frame));
+	memcpy(frame, pci, pciLen);
+	if (len != 0) {
+		memcpy(frame + pciLen, data, len);
+	}
+	return link->send(id, frame, sizeof(frame));
+}
+
+/**
+ * Send a flow control frame to an ECU
+ *
+ * link: Link to send frame on
+ * cfg: Flow control parameters to advertise
+ * src: Response ID of ECU flow control is for
+ * status: Flow status (ISOTP_FS_CTS etc.)
+ *
+ * Return: Status indicating success or failure
+ * */
+static BusStatus isotp_send_flow(const IsoTpLink* link, const IsoTpConfig* cfg, uint32_t src, uint8_t status) {
+	uint8_t pci[ISOTP_FC_LEN] = {ISOTP_PCI_FLOW_CONTROL | status, cfg->blockSize, cfg->stMin};
+
+	return isotp_send_frame(link, link->flowId(src), pci, sizeof(pci), NULL, 0);
+}
+
+/**
+ * Wait for receiver's flow control before sending a block of consecutive frames
+ *
+ * link: Link to receive on
+ * fcId: ID flow control is expected from (ISOTP_ANY_ID for any)
+ * bs: Destination to store block size
+ * sep: Destination to store separation time (us)
+ *
+ * Return: Status indicating success or failure
+ * */
+static BusStatus isotp_wait_flow(const IsoTpLink* link, uint32_t fcId, uint8_t* bs, uint32_t* sep) {
+	uint8_t frame[ISOTP_FRAME_LEN];
+	uint32_t id, len;
+	uint32_t waits = 0;
+	uint64_t start = dgas_time_us();
+	uint64_t limit = (uint64_t) ISOTP_TIMEOUT_BS * DGAS_TIME_US_PER_MS;
+	uint64_t elapsed;
+
+	while ((elapsed = dgas_time_us() - start) < limit) {
+		if (link->recv(fcId, &id, frame, &len, ((limit - elapsed) / DGAS_TIME_US_PER_MS) + 1) != BUS_OK) {
+			break;
+		}
+		if (((fcId != ISOTP_ANY_ID) && (id != fcId)) || (len < ISOTP_FC_LEN) ||
+				((frame[0] & ISOTP_PCI_TYPE_MASK) != ISOTP_PCI_FLOW_CONTROL)) {
+			// not flow control for us
+			continue;
+		}
+		switch (frame[0] & ISOTP_PCI_LOW_MASK) {
+			case ISOTP_FS_CTS:
+				*bs = frame[1];
+				*sep = isotp_stmin_to_us(frame[2]);
+				return BUS_OK;
+			case ISOTP_FS_WAIT:
+				if (++waits > ISOTP_WAIT_MAX) {
+					return BUS_TX_ERROR;
+				}
+				// N_Bs restarts with every WAIT
+				start = dgas_time_us();
+				break;
+			default:
+				// overflow, receiver can't take message
+				return BUS_BUFFER_ERROR;
+		}
+	}
+	return BUS_RX_ERROR;
+}
+
+/**
+ * Send a message. Messages which fit are sent as a single frame, otherwise a first frame
+ * is sent and consecutive frames follow as the receiver's flow control allows.
+ *
+ * link: Link to send on
+ * cfg: Flow control parameters
+ * txId: ID to send message with
+ * fcId: ID flow control is expected from (ISOTP_ANY_ID for any)
+ * data: Message to send
+ * len: Length of message
+ *
+ * Return: Status indicating success or failure
+ * */
+BusStatus isotp_send(const IsoTpLink* link, const IsoTpConfig* cfg, uint32_t txId,
+		uint32_t fcId, uint8_t* data, uint32_t len) {
+	uint8_t pci[2];
+	uint32_t minSep = isotp_stmin_to_us(cfg->txStMin);
+	uint32_t sep = minSep;
+	uint32_t sent, chunk;
+	uint32_t block = 0;
+	uint8_t bs;
+	uint8_t sn = 1;
+	BusStatus status;
+
+	if ((len == 0) || (len > ISOTP_MESSAGE_MAX)) {
+		return BUS_BUFFER_ERROR;
+	}
+	if (len <= ISOTP_SF_DATA_MAX) {
+		pci[0] = ISOTP_PCI_SINGLE | len;
+		return isotp_send_frame(link, txId, pci, 1, data, len);
+	}
+	pci[0] = ISOTP_PCI_FIRST | (len >> 8);
+	pci[1] = len & 0xFF;
+	if ((status = isotp_send_frame(link, txId, pci, 2, data, ISOTP_FF_DATA_LEN)) != BUS_OK) {
+		return status;
+	}
+	sent = ISOTP_FF_DATA_LEN;
+
+	while (sent < len) {
+		if (block == 0) {
+			// flow control comes after first frame and after every block
+			if ((status = isotp_wait_flow(link, fcId, &bs, &sep)) != BUS_OK) {
+				return status;
+			}
+			if (sep < minSep) {
+				sep = minSep;
+			}
+			// block size of 0 means rest of message without further flow control
+			block = (bs == 0) ? len : bs;
+		} else {
+			isotp_separate(sep);
+		}
+		chunk = ((len - sent) > ISOTP_CF_DATA_LEN) ? ISOTP_CF_DATA_LEN : (len - sent);
+		pci[0] = ISOTP_PCI_CONSECUTIVE | (sn++ & ISOTP_PCI_LOW_MASK);
+		if ((status = isotp_send_frame(link, txId, pci, 1, data + sent, chunk)) != BUS_OK) {
+			return status;
+		}
+		sent += chunk;
+		block--;
+	}
+	return BUS_OK;
+}
+
+/**
+ * Receive a message. Once a first frame arrives the message is locked to the ECU which
+ * sent it, flow control is sent back and consecutive frames are copied straight into
+ * the destination.
+ *
+ * link: Link to receive on
+ * cfg: Flow control parameters to advertise
+ * src: ID to receive from (ISOTP_ANY_ID for any), set to ID message came from
+ * dest: Destination buffer
+ * destMax: Size of destination buffer
+ * len: Destination to store length of message
+ * timeout: Time to wait for start of message (ms)
+ *
+ * Return: Status indicating success or failure
+ * */
+BusStatus isotp_receive(const IsoTpLink* link, const IsoTpConfig* cfg, uint32_t* src,
+		uint8_t* dest, uint32_t destMax, uint32_t* len, uint32_t timeout) {
+	uint8_t frame[ISOTP_FRAME_LEN];
+	uint32_t id, frameLen, chunk;
+	uint32_t total = 0;
+	uint32_t got = 0;
+	uint32_t block = 0;
+	uint8_t sn = 0;
+	bool receiving = false;
+	uint64_t start = dgas_time_us();
+	uint64_t limit = (uint64_t) timeout * DGAS_TIME_US_PER_MS;
+	uint64_t elapsed;
+
+	for (;;) {
+		if ((elapsed = dgas_time_us() - start) >= limit) {
+			return BUS_RX_ERROR;
+		}
+		if (link->recv(*src, &id, frame, &frameLen, ((limit - elapsed) / DGAS_TIME_US_PER_MS) + 1) != BUS_OK) {
+			return BUS_RX_ERROR;
+		}
+		if (((*src != ISOTP_ANY_ID) && (id != *src)) || (frameLen == 0)) {
+			// another ECU
+			continue;
+		}
+
+		switch (frame[0] & ISOTP_PCI_TYPE_MASK) {
+			case ISOTP_PCI_SINGLE:
+				chunk = frame[0] & ISOTP_PCI_LOW_MASK;
+				if ((chunk == 0) || (chunk > ISOTP_SF_DATA_MAX) || (chunk + 1 > frameLen)) {
+					continue;
+				}
+				if (chunk > destMax) {
+					return BUS_BUFFER_ERROR;
+				}
+				memcpy(dest, frame + 1, chunk);
+				*src = id;
+				*len = chunk;
+				return BUS_OK;
+			case ISOTP_PCI_FIRST:
+				total = ((frame[0] & ISOTP_PCI_LOW_MASK) << 8) | frame[1];
+				if ((frameLen < ISOTP_FRAME_LEN) || (total <= ISOTP_SF_DATA_MAX)) {
+					continue;
+				}
+				if (total > destMax) {
+					isotp_send_flow(link, cfg, id, ISOTP_FS_OVERFLOW);
+					return BUS_BUFFER_ERROR;
+				}
+				memcpy(dest, frame + 2, ISOTP_FF_DATA_LEN);
+				got = ISOTP_FF_DATA_LEN;
+				sn = 1;
+				// rest of message must come from same ECU
+				*src = id;
+				receiving = true;
+				block = cfg->blockSize;
+				if (isotp_send_flow(link, cfg, id, ISOTP_FS_CTS) != BUS_OK) {
+					return BUS_TX_ERROR;
+				}
+				break;
+			case ISOTP_PCI_CONSECUTIVE:
+				if (!receiving) {
+					continue;
+				}
+				if ((frame[0] & ISOTP_PCI_LOW_MASK) != (sn & ISOTP_PCI_LOW_MASK)) {
+					// frame lost
+					return BUS_RX_ERROR;
+				}
+				chunk = ((total - got) > ISOTP_CF_DATA_LEN) ? ISOTP_CF_DATA_LEN : (total - got);
+				if (chunk + 1 > frameLen) {
+					return BUS_RX_ERROR;
+				}
+				memcpy(dest + got, frame + 1, chunk);
+				got += chunk;
+				sn++;
+				if (got == total) {
+					*len = total;
+					return BUS_OK;
+				}
+				if ((cfg->blockSize != 0) && (--block == 0)) {
+					block = cfg->blockSize;
+					if (isotp_send_flow(link, cfg, id, ISOTP_FS_CTS) != BUS_OK) {
+						return BUS_TX_ERROR;
+					}
+				}
+				break;
+			default:
+				// flow control isn't expected while receiving
+				continue;
+		}
+		// next consecutive frame must arrive within N_Cr
+		start = dgas_time_us();
+		limit = (uint64_t) ISOTP_TIMEOUT_CR * DGAS_TIME_US_PER_MS;
+	}
+}
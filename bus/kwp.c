@@ -8,9 +8,13 @@
 #include <dgas_types.h>
 #include <dgas_obd.h>
 #include <dgas_debug.h>
+#include <dgas_time.h>
+#include <dgas_ring.h>
+#include <dgas_vehicle.h>
 #include <kwp.h>
 #include <bus.h>
 #include <string.h>
+#include <stdio.h>
 #include <stdbool.h>
 
 // queue for bus requests
@@ -22,10 +26,58 @@ QueueHandle_t queueKwpResponse;
 static TaskHandle_t handleKwp;
 // kwp UART bus
 static UART_HandleTypeDef kwpBus;
-// buffer for storing responses from interrupt
+// circular buffer UART received bytes are written to by DMA
 static uint8_t rxBuff[KWP_UART_RX_BUFF_SIZE];
-// stores current index of RX buffer to write to
-static uint32_t rxByteCount;
+// index of rxBuff up to which received bytes have been moved into rxRing
+static uint32_t rxDmaPos;
+// received bytes waiting to be read by a task
+static DRing rxRing;
+// storage for rxRing
+static uint8_t rxRingBuff[KWP_RX_RING_SIZE];
+// task waiting for received bytes (NULL if none)
+static volatile TaskHandle_t rxWaiter;
+// time of last byte sent or received on bus (us)
+static uint64_t lastActivity;
+// method which successfully initialised bus
+static KWPInitMethod initMethod;
+// ISO 14230 default timing parameters, used at the start of every session
+static const KWPTiming timingDefault = KWP_TIMING_DEFAULTS;
+// timing parameters of bus
+static KWPTiming timing = KWP_TIMING_DEFAULTS;
+// state of timing parameter negotiation for current session
+static KWPTimingState timingState;
+// AccessTimingParameters bytes ECU accepted for current session
+static uint8_t timingRaw[KWP_ATP_PARAM_COUNT];
+// true if timingRaw holds negotiated parameters
+static bool timingRawValid;
+// time last request started being sent (us, 0 if none since cadence was reset)
+static uint64_t lastRequest;
+// smoothed time between requests (us, 0 if not measured)
+static uint32_t cadencePeriod;
+// number of requests cadencePeriod has been measured over
+static uint32_t cadenceSamples;
+// achieved request cadence before and after negotiation
+static KWPCadence cadence;
+// frame being transmitted by timer
+static uint8_t txFrame[OBD_BUS_REQUEST_MAX];
+// length of frame being transmitted
+static uint32_t txLen;
+// index of next byte of txFrame to transmit
+static volatile uint32_t txNext;
+// index of next byte of txFrame expected to be echoed back
+static volatile uint32_t txEcho;
+// true while a frame is being transmitted or echo is outstanding
+static volatile bool txActive;
+// result of last transmit
+static volatile BusStatus txStatus;
+// true while ECU session is established, read without mutex to avoid waiting on init
+static volatile bool sessionUp;
+// session management statistics
+static KWPSessionStats sessionStats;
+// serialises access to bus between callers and keep alive
+static SemaphoreHandle_t kwpBusMutex;
+// true while another bus is in use and session isn't maintained
+static volatile bool suspended;
 
 
 /**
@@ -78,6 +130,135 @@ static void kwp_bus_k_gpio(void) {
 	HAL_GPIO_Init(K_LINE_PORT, &gpioInit);
 }
 
+/**
+ * Start circular DMA reception of UART into rxBuff
+ *
+ * Return: None
+ * */
+static void kwp_bus_dma_init(void) {
+	__KWP_UART_DMA_CLK_EN();
+
+	// stop stream in case it is being restarted after 5 baud init
+	KWP_UART_DMA_STREAM->CR &= ~DMA_SxCR_EN;
+	while (KWP_UART_DMA_STREAM->CR & DMA_SxCR_EN);
+	KWP_UART_DMA_IFCR = KWP_UART_DMA_FLAGS;
+
+	// setup stream for byte transfers from UART to memory in circular mode with half
+	// and full transfer interrupts
+	KWP_UART_DMA_STREAM->CR = (KWP_UART_DMA_CHANNEL) | (DMA_MBURST_SINGLE) |
+							  (DMA_PBURST_SINGLE) | (DMA_PRIORITY_HIGH) |
+							  (DMA_SxCR_MINC) | (DMA_CIRCULAR) |
+							  (DMA_SxCR_HTIE) | (DMA_SxCR_TCIE);
+	KWP_UART_DMA_STREAM->NDTR = sizeof(rxBuff);
+	KWP_UART_DMA_STREAM->PAR = (uint32_t) &(KWP_UART_INSTANCE->RDR);
+	KWP_UART_DMA_STREAM->M0AR = (uint32_t) rxBuff;
+	rxDmaPos = 0;
+
+	HAL_NVIC_SetPriority(KWP_UART_DMA_IRQN, 6, 0);
+	HAL_NVIC_EnableIRQ(KWP_UART_DMA_IRQN);
+
+	// UART must request DMA transfers and interrupt when line goes idle
+	KWP_UART_INSTANCE->CR3 |= USART_CR3_DMAR;
+	KWP_UART_INSTANCE->ICR = USART_ICR_IDLECF;
+	KWP_UART_INSTANCE->CR1 |= USART_CR1_IDLEIE;
+	KWP_UART_DMA_STREAM->CR |= DMA_SxCR_EN;
+}
+
+/**
+ * Initialise timer which paces transmitted bytes
+ *
+ * Return: None
+ * */
+static void kwp_bus_tx_timer_init(void) {
+	__KWP_TX_TIMER_CLK_EN();
+
+	KWP_TX_TIMER->CR1 = 0;
+	KWP_TX_TIMER->PSC = (KWP_TX_TIMER_CLK_HZ() / KWP_TX_TIMER_TICK_HZ) - 1;
+	// load prescaler now
+	KWP_TX_TIMER->EGR = TIM_EGR_UG;
+	KWP_TX_TIMER->SR = 0;
+	KWP_TX_TIMER->DIER = TIM_DIER_UIE;
+
+	HAL_NVIC_SetPriority(KWP_TX_TIMER_IRQN, 6, 0);
+	HAL_NVIC_EnableIRQ(KWP_TX_TIMER_IRQN);
+}
+
+/**
+ * Stop transmitting frame
+ *
+ * status: Result of transmit
+ *
+ * Return: None
+ * */
+static void kwp_bus_tx_stop(BusStatus status) {
+	KWP_TX_TIMER->CR1 &= ~TIM_CR1_CEN;
+	txStatus = status;
+	txActive = false;
+}
+
+/**
+ * Check a received byte against the frame being transmitted (K-line echoes every
+ * transmitted byte). Called from ISR.
+ *
+ * byte: Received byte
+ *
+ * Return: None
+ * */
+static void kwp_bus_tx_echo(uint8_t byte) {
+	if (byte != txFrame[txEcho]) {
+		// collision or line fault
+		kwp_bus_tx_stop(BUS_ECHO_ERROR);
+		return;
+	}
+	if (++txEcho == txLen) {
+		kwp_bus_tx_stop(BUS_OK);
+	}
+}
+
+/**
+ * Interrupt handler for transmit timer, sends next byte of frame each period
+ *
+ * Return: None
+ * */
+void TIM7_IRQHandler(void) {
+	KWP_TX_TIMER->SR = ~TIM_SR_UIF;
+
+	if (!txActive || (txNext == txLen)) {
+		// last byte has been sent, only echo is outstanding
+		KWP_TX_TIMER->CR1 &= ~TIM_CR1_CEN;
+		return;
+	}
+	KWP_UART_INSTANCE->TDR = txFrame[txNext++];
+}
+
+/**
+ * Move bytes DMA has written to rxBuff since last call into rxRing and wake waiting
+ * task. Called from UART idle and DMA half/full transfer interrupts.
+ *
+ * Return: None
+ * */
+static void kwp_bus_rx_drain(void) {
+	BaseType_t woken = pdFALSE;
+	uint32_t pos = sizeof(rxBuff) - KWP_UART_DMA_STREAM->NDTR;
+
+	if (pos == sizeof(rxBuff)) {
+		pos = 0;
+	}
+	while (rxDmaPos != pos) {
+		if (txActive) {
+			// echo of frame being transmitted
+			kwp_bus_tx_echo(rxBuff[rxDmaPos]);
+		} else {
+			dgas_ring_push(&rxRing, &rxBuff[rxDmaPos]);
+		}
+		rxDmaPos = (rxDmaPos + 1) % sizeof(rxBuff);
+	}
+	if (rxWaiter != NULL) {
+		vTaskNotifyGiveIndexedFromISR(rxWaiter, KWP_NOTIFY_INDEX, &woken);
+	}
+	portYIELD_FROM_ISR(woken);
+}
+
 /**
  * Initialise UART peripheral for KWP bus (10400 baud rate)
  *
@@ -97,8 +278,8 @@ static void kwp_bus_uart_init(void) {
 	kwpBus.Init.OneBitSampling = UART_ONE_BIT_SAMPLE_DISABLE;
 	kwpBus.AdvancedInit.AdvFeatureInit = UART_ADVFEATURE_NO_INIT;
 	HAL_UART_Init(&kwpBus);
-	// setup UART handle for receive interrupt
-	HAL_UART_Receive_IT(&kwpBus, rxBuff, sizeof(rxBuff));
+	// received bytes are moved by DMA, UART interrupt only signals idle line
+	kwp_bus_dma_init();
 
 	HAL_NVIC_SetPriority(KWP_UART_INSTANCE_IRQN, 6, 0);
 	HAL_NVIC_EnableIRQ(KWP_UART_INSTANCE_IRQN);
@@ -110,14 +291,37 @@ static void kwp_bus_uart_init(void) {
  * Return: None
  * */
 void UART4_IRQHandler(void) {
-	//if (KWP_UART_INSTANCE->ISR & USART_ISR_RXNE) {
-		if (rxByteCount == sizeof(rxBuff)) {
-			return;
-		}
-		rxBuff[rxByteCount] = KWP_UART_INSTANCE->RDR;
-		KWP_UART_INSTANCE->ISR &= ~USART_ISR_RXNE;
-		rxByteCount++;
-	//}
+	uint32_t isr = KWP_UART_INSTANCE->ISR;
+
+	// clear line errors so reception continues, bad bytes are caught by checksum
+	KWP_UART_INSTANCE->ICR = USART_ICR_ORECF | USART_ICR_NCF | USART_ICR_FECF;
+
+	if (isr & USART_ISR_IDLE) {
+		// end of frame (or echo of a single byte)
+		KWP_UART_INSTANCE->ICR = USART_ICR_IDLECF;
+		kwp_bus_rx_drain();
+	}
+}
+
+/**
+ * Interrupt handler for KWP UART receive DMA stream
+ *
+ * Return: None
+ * */
+void DMA1_Stream2_IRQHandler(void) {
+	KWP_UART_DMA_IFCR = KWP_UART_DMA_FLAGS;
+	// half or full transfer, drain before DMA wraps around onto unread bytes
+	kwp_bus_rx_drain();
+}
+
+/**
+ * Discard any received bytes which haven't been read (e.g. left over from a previous
+ * response)
+ *
+ * Return: None
+ * */
+void kwp_bus_rx_flush(void) {
+	dgas_ring_flush(&rxRing);
 }
 
 /**
@@ -126,8 +330,10 @@ void UART4_IRQHandler(void) {
  * Return: None
  * */
 void kwp_bus_init_hardware(void) {
+	dgas_ring_init(&rxRing, rxRingBuff, sizeof(uint8_t), sizeof(rxRingBuff));
 	kwp_bus_gpio_init();
 	kwp_bus_uart_init();
+	kwp_bus_tx_timer_init();
 }
 
 /**
@@ -179,49 +385,43 @@ void kwp_bus_five_baud_init(void) {
  * Return: status indicating success or failure
  * */
 BusStatus kwp_bus_write_byte(uint8_t byte) {
-	uint8_t tmp = byte;
-	uint8_t echo;
-	BusStatus status;
-
-	taskENTER_CRITICAL();
-	if (HAL_UART_Transmit(&kwpBus, &tmp, sizeof(uint8_t), 100) != HAL_OK) {
-		taskEXIT_CRITICAL();
-		return BUS_TX_ERROR;
-	}
-	taskEXIT_CRITICAL();
-	// the byte we just sent will be echoed back since it's all on the K-Line so we will read it back
-
-	if ((status = kwp_bus_read_byte(&echo, 100)) != BUS_OK) {
-		return status;
-	}
-	if (echo != tmp) {
-		return BUS_ECHO_ERROR;
-	}
-	return BUS_OK;
+	return kwp_bus_write(&byte, sizeof(uint8_t));
 }
 
 /**
- * Read a single byte from KWP bus
+ * Read a single byte from KWP bus. Bytes are read in the order they were received,
+ * the calling task blocks until a byte arrives.
  *
  * dest: Pointer to store data to
- * timeout: Timeout to use when waiting
+ * timeout: Timeout to use when waiting (ms)
  *
  * Return: Status indicating success or failure
  * */
 BusStatus kwp_bus_read_byte(uint8_t* dest, uint32_t timeout) {
-	uint32_t tickStart = HAL_GetTick();
+	uint64_t start = dgas_time_us();
+	uint64_t limit = (uint64_t) timeout * DGAS_TIME_US_PER_MS;
+	uint64_t elapsed;
 
-	while (rxByteCount == 0) {
-		if (HAL_GetTick() > tickStart + timeout) {
+	rxWaiter = xTaskGetCurrentTaskHandle();
+	// byte may have arrived before we registered as waiter so always check ring
+	// before blocking
+	while (!dgas_ring_pop(&rxRing, dest)) {
+		if ((elapsed = dgas_time_us() - start) > limit) {
+			rxWaiter = NULL;
 			return BUS_RX_ERROR;
 		}
+		ulTaskNotifyTakeIndexed(KWP_NOTIFY_INDEX, pdTRUE,
+				pdMS_TO_TICKS((limit - elapsed) / DGAS_TIME_US_PER_MS) + 1);
 	}
-	*dest = rxBuff[--rxByteCount];
+	rxWaiter = NULL;
+	lastActivity = dgas_time_us();
 	return BUS_OK;
 }
 
 /**
- * Write a stream of data to KWP bus
+ * Write a stream of data to KWP bus. Bytes are sent by the transmit timer interrupt
+ * spaced by P4 and each echoed byte is checked in the receive interrupt, the calling
+ * task blocks until the whole frame has been echoed back.
  *
  * data: Data to write
  * len: Length of data to write
@@ -229,19 +429,206 @@ BusStatus kwp_bus_read_byte(uint8_t* dest, uint32_t timeout) {
  * Return: Status indicating success or failure
  * */
 BusStatus kwp_bus_write(uint8_t* data, uint32_t len) {
-	BusStatus status;
+	uint64_t start;
+	uint64_t limit = ((uint64_t) len * (KWP_BYTE_TIME_US + timing.p4Min)) + KWP_TX_MARGIN_US;
+	uint64_t elapsed;
 
-	for (int i = 0; i < len; i++) {
-		if ((status = kwp_bus_write_byte(data[i])) != BUS_OK) {
-			DGAS_DEBUG_LOG_MSG_ERROR_TRANSMIT(BUS_ID_KWP, status);
-			return status;
+	if ((len == 0) || (len > sizeof(txFrame))) {
+		return BUS_BUFFER_ERROR;
+	}
+	memcpy(txFrame, data, len);
+	txLen = len;
+	txEcho = 0;
+	txStatus = BUS_TX_ERROR;
+	rxWaiter = xTaskGetCurrentTaskHandle();
+
+	// send first byte now, timer sends the rest one byte time + P4 apart
+	KWP_TX_TIMER->ARR = KWP_BYTE_TIME_US + timing.p4Min - 1;
+	KWP_TX_TIMER->CNT = 0;
+	txNext = 1;
+	txActive = true;
+	start = dgas_time_us();
+	KWP_UART_INSTANCE->TDR = txFrame[0];
+	if (len > 1) {
+		KWP_TX_TIMER->CR1 |= TIM_CR1_CEN;
+	}
+
+	while (txActive) {
+		if ((elapsed = dgas_time_us() - start) > limit) {
+			// echo never came back
+			kwp_bus_tx_stop(BUS_TX_ERROR);
+			break;
 		}
-		vTaskDelay(KWP_INTERBYTE_DELAY); // must wait 5ms between bytes according to spec
+		ulTaskNotifyTakeIndexed(KWP_NOTIFY_INDEX, pdTRUE,
+				pdMS_TO_TICKS((limit - elapsed) / DGAS_TIME_US_PER_MS) + 1);
+	}
+	rxWaiter = NULL;
+	lastActivity = dgas_time_us();
+
+	if (txStatus != BUS_OK) {
+		DGAS_DEBUG_LOG_MSG_ERROR_TRANSMIT(BUS_ID_KWP, txStatus);
+		return txStatus;
 	}
 	DGAS_DEBUG_LOG_MSG_DATA_TRANSMIT(data, len, BUS_ID_KWP);
 	return BUS_OK;
 }
 
+/**
+ * Check timing parameters can be used on bus
+ *
+ * t: Timing parameters to check
+ *
+ * Return: True if parameters are in range, false otherwise
+ * */
+static bool kwp_bus_timing_valid(const KWPTiming* t) {
+	// session must be kept alive well within P3max
+	return (t->p4Min <= KWP_TIMING_P4_LIMIT) && (t->p2Max != 0) && (t->p2Min <= t->p2Max) &&
+			(t->p3Min <= t->p3Max) && (t->p3Max > KWP_KEEPALIVE_MARGIN_US);
+}
+
+/**
+ * Set timing parameters of KWP bus
+ *
+ * t: New timing parameters
+ *
+ * Return: Status indicating success or failure (parameters out of range)
+ * */
+BusStatus kwp_bus_set_timing(const KWPTiming* t) {
+	if (!kwp_bus_timing_valid(t)) {
+		return BUS_BUFFER_ERROR;
+	}
+	memcpy(&timing, t, sizeof(KWPTiming));
+	return BUS_OK;
+}
+
+/**
+ * Get timing parameters of KWP bus
+ *
+ * dest: Destination to store timing parameters
+ *
+ * Return: None
+ * */
+void kwp_bus_get_timing(KWPTiming* dest) {
+	memcpy(dest, &timing, sizeof(KWPTiming));
+}
+
+/**
+ * Get time to wait for the start of a response with current timing parameters
+ *
+ * Return: Response timeout (ms)
+ * */
+uint32_t kwp_bus_response_timeout(void) {
+	return (timing.p2Max + KWP_RESPONSE_MARGIN_US + DGAS_TIME_US_PER_MS - 1) / DGAS_TIME_US_PER_MS;
+}
+
+/**
+ * Get AccessTimingParameters bytes negotiated for current session
+ *
+ * dest: Destination to store KWP_ATP_PARAM_COUNT parameter bytes
+ *
+ * Return: True if timing was negotiated, false if bus is using default timing
+ * */
+bool kwp_bus_get_negotiated_timing(uint8_t* dest) {
+	if (!timingRawValid) {
+		return false;
+	}
+	memcpy(dest, timingRaw, KWP_ATP_PARAM_COUNT);
+	return true;
+}
+
+/**
+ * Restart measurement of request cadence
+ *
+ * Return: None
+ * */
+static void kwp_bus_cadence_reset(void) {
+	lastRequest = 0;
+	cadencePeriod = 0;
+	cadenceSamples = 0;
+}
+
+/**
+ * Record the start of a request in the measured request cadence
+ *
+ * Return: None
+ * */
+static void kwp_bus_cadence_sample(void) {
+	uint64_t now = dgas_time_us();
+	uint64_t interval = now - lastRequest;
+
+	if ((lastRequest != 0) && (interval < KWP_CADENCE_IDLE_US)) {
+		if (cadencePeriod == 0) {
+			cadencePeriod = (uint32_t) interval;
+		} else {
+			cadencePeriod += ((int32_t) interval - (int32_t) cadencePeriod) /
+					(1 << KWP_CADENCE_SMOOTHING);
+		}
+		cadenceSamples++;
+	}
+	lastRequest = now;
+}
+
+/**
+ * Get measured request cadence
+ *
+ * Return: Requests per 1000 seconds, 0 if not measured yet
+ * */
+static uint32_t kwp_bus_cadence_rate(void) {
+	if (cadencePeriod == 0) {
+		return 0;
+	}
+	return 1000000000U / cadencePeriod;
+}
+
+/**
+ * Get achieved request cadence of KWP bus
+ *
+ * dest: Destination to store cadence
+ *
+ * Return: None
+ * */
+void kwp_bus_get_cadence(KWPCadence* dest) {
+	cadence.current = kwp_bus_cadence_rate();
+	memcpy(dest, &cadence, sizeof(KWPCadence));
+}
+
+/**
+ * Return bus to default timing parameters. ECU uses default timing at the start of
+ * every session.
+ *
+ * Return: None
+ * */
+static void kwp_bus_timing_reset(void) {
+	memcpy(&timing, &timingDefault, sizeof(KWPTiming));
+	timingState = KWP_TIMING_DEFAULT;
+	timingRawValid = false;
+	kwp_bus_cadence_reset();
+}
+
+/**
+ * Wait until P3min has passed since the end of the last response
+ *
+ * Return: None
+ * */
+static void kwp_bus_wait_p3(void) {
+	uint64_t idle = dgas_time_us() - lastActivity;
+	uint64_t remain;
+
+	if (idle >= timing.p3Min) {
+		return;
+	}
+	remain = timing.p3Min - idle;
+	if (remain > 2 * DGAS_TIME_US_PER_MS) {
+		// sleep whole ticks (may wake up to a tick early) then busy wait the remainder
+		vTaskDelay(pdMS_TO_TICKS(remain / DGAS_TIME_US_PER_MS) - 1);
+		if ((idle = dgas_time_us() - lastActivity) >= timing.p3Min) {
+			return;
+		}
+		remain = timing.p3Min - idle;
+	}
+	dgas_time_delay_us((uint32_t) remain);
+}
+
 /**
  * Read a stream of data from KWP bus
  *
@@ -306,17 +693,61 @@ BusStatus kwp_bus_get_init_response(KWPInit* init) {
 }
 
 /**
- * Initialise the KWP bus for communication
+ * Perform ISO 14230 fast init of KWP bus. Sends the wake up pattern followed by a
+ * StartCommunication request and waits for a positive response.
  *
  * Return: Status indicating success or failure
  * */
-BusStatus kwp_bus_init(void) {
+BusStatus kwp_bus_fast_init(void) {
+	uint8_t msg[KWP_FAST_INIT_REQUEST_SIZE] = {KWP_FAST_INIT_FORMAT, KWP_HEADER_TWO,
+											   KWP_HEADER_THREE, KWP_SID_START_COMM};
+	BusResponse resp = {0};
+	uint64_t idle = dgas_time_us() - lastActivity;
+
+	msg[KWP_FAST_INIT_REQUEST_SIZE - 1] = kwp_bus_calc_checksum(msg, KWP_FAST_INIT_REQUEST_SIZE - 1);
+
+	kwp_bus_k_gpio();
+	K_LINE_HIGH();
+	L_LINE_HIGH();
+	if (idle < KWP_FAST_INIT_IDLE_US) {
+		// bus must have been idle for W5 before wake up pattern
+		vTaskDelay(pdMS_TO_TICKS((KWP_FAST_INIT_IDLE_US - idle) / DGAS_TIME_US_PER_MS) + 1);
+	}
+	// wake up pattern timing is tighter than tick resolution so busy wait
+	K_LINE_LOW();
+	L_LINE_LOW();
+	dgas_time_delay_us(KWP_FAST_INIT_LOW_US);
+	K_LINE_HIGH();
+	L_LINE_HIGH();
+	dgas_time_delay_us(KWP_FAST_INIT_WAKEUP_US - KWP_FAST_INIT_LOW_US);
+	// change K pin back to TX ready for UART communication
+	HAL_GPIO_DeInit(K_LINE_PORT, K_LINE_PIN);
+	kwp_bus_uart_init();
+	kwp_bus_rx_flush();
+
+	if (kwp_bus_write(msg, sizeof(msg)) != BUS_OK) {
+		return BUS_INIT_ERROR;
+	}
+	// positive response is [0xC1, key byte 1, key byte 2]
+	if (kwp_bus_get_response(&resp, KWP_BUS_INIT_TIMEOUT) != BUS_OK) {
+		return BUS_INIT_ERROR;
+	}
+	if ((resp.dataLen < 1) || (resp.data[0] != KWP_SID_START_COMM + KWP_BUS_PID_OFFSET)) {
+		return BUS_INIT_ERROR;
+	}
+	return BUS_OK;
+}
+
+/**
+ * Perform 5 baud init of KWP bus and complete the key byte handshake
+ *
+ * Return: Status indicating success or failure
+ * */
+static BusStatus kwp_bus_slow_init(void) {
 	KWPInit init = {0};
 	uint8_t nkwTwo;
 	uint8_t nAddress;
 
-	// initialise hardware
-	kwp_bus_init_hardware();
 	// perform 5 baud init sequence
 	kwp_bus_five_baud_init();
 
@@ -337,11 +768,70 @@ BusStatus kwp_bus_init(void) {
 	if (nAddress != KWP_BUS_NADDRESS) {
 		return BUS_INIT_ERROR;
 	}
-	// bus is now initialised, note that requests must be made every 5 seconds or bus will
-	// need to be initialised again
 	return BUS_OK;
 }
 
+/**
+ * Initialise bus using a given method
+ *
+ * method: Initialisation method
+ *
+ * Return: Status indicating success or failure
+ * */
+static BusStatus kwp_bus_init_with(KWPInitMethod method) {
+	BusStatus status;
+
+	status = (method == KWP_INIT_FAST) ? kwp_bus_fast_init() : kwp_bus_slow_init();
+	if (status == BUS_OK) {
+		initMethod = method;
+	}
+	return status;
+}
+
+/**
+ * Get method which successfully initialised bus
+ *
+ * Return: Initialisation method, KWP_INIT_UNKNOWN if bus isn't initialised
+ * */
+KWPInitMethod kwp_bus_get_init_method(void) {
+	return initMethod;
+}
+
+/**
+ * Establish a session with ECU. Fast init is tried first unless the most recent
+ * vehicle needed 5 baud init, then the other method is tried.
+ *
+ * Return: Status indicating success or failure
+ * */
+static BusStatus kwp_bus_start_session(void) {
+	KWPInitMethod first = KWP_INIT_FAST;
+
+	initMethod = KWP_INIT_UNKNOWN;
+	kwp_bus_timing_reset();
+	if (dgas_vehicle_last_kwp_init() == KWP_INIT_FIVE_BAUD) {
+		first = KWP_INIT_FIVE_BAUD;
+	}
+	if ((kwp_bus_init_with(first) == BUS_OK) ||
+			(kwp_bus_init_with((first == KWP_INIT_FAST) ? KWP_INIT_FIVE_BAUD : KWP_INIT_FAST) == BUS_OK)) {
+		// session must be kept alive by making a request at least every P3max
+		sessionUp = true;
+		return BUS_OK;
+	}
+	sessionUp = false;
+	return BUS_INIT_ERROR;
+}
+
+/**
+ * Initialise the KWP bus for communication
+ *
+ * Return: Status indicating success or failure
+ * */
+BusStatus kwp_bus_init(void) {
+	// initialise hardware
+	kwp_bus_init_hardware();
+	return kwp_bus_start_session();
+}
+
 /**
  * Build a KWP packet for a given array of data
  *
@@ -352,11 +842,11 @@ BusStatus kwp_bus_init(void) {
  * Return: Number of bytes copied to destination array
  * */
 static uint8_t kwp_bus_build_packet(uint8_t* dest, uint8_t* data, uint32_t size) {
-	if (size > OBD_BUS_REQUEST_MAX) {
+	if ((size > KWP_DATA_SIZE_MASK) || (size + KWP_HEADER_SIZE + 1 > OBD_BUS_REQUEST_MAX)) {
 		return 0;
 	}
 	// setup headers
-	dest[0] = KWP_HEADER_ONE;
+	dest[0] = KWP_HEADER_FORMAT | (size & KWP_DATA_SIZE_MASK);
 	dest[1] = KWP_HEADER_TWO;
 	dest[2] = KWP_HEADER_THREE;
 	// copy data after headers
@@ -381,72 +871,346 @@ BusStatus kwp_bus_make_request(BusRequest* req) {
 	if ((len = kwp_bus_build_packet(msg, req->data, req->dataLen)) == 0) {
 		return BUS_BUFFER_ERROR;
 	}
+	// ECU ignores requests which start before P3min
+	kwp_bus_wait_p3();
+	// anything still waiting to be read doesn't belong to this request
+	kwp_bus_rx_flush();
+	kwp_bus_cadence_sample();
 
 	return kwp_bus_write(msg, len);
 }
 
 /**
- * Extract the data from a complete response packet
+ * Read a single frame from KWP bus. The format byte is [A1 A0 L5..L0], target and
+ * source bytes follow if A1 A0 isn't zero and a separate length byte follows the header
+ * if L is zero.
  *
- * response: Raw KWP response
- * dataSize: Number of bytes in response which are data (given from format byte)
- * dest: Array to store data
+ * frame: Buffer to store raw frame (KWP_FRAME_MAX bytes)
+ * dataStart: Destination to store index of first data byte within frame
+ * dataLen: Destination to store number of data bytes
+ * timeout: Time to wait for start of frame (ms)
  *
- * Return: None
+ * Return: Status indicating success or failure
  * */
-void kwp_bus_extract_data(uint8_t* response, uint32_t dataSize, uint8_t* dest) {
-	// we want to extract the data only from a received packet
-	// an example packet may look like 0x83 0xF1 0x11 0x41 0x0D 0x00 0xD3
-	// First three bytes are header (1st is format byte), we can see that
-	// 0x83 & 0b111111 = 3 so [0x41, 0x0D, 0x00] is our data (0xD3 is checksum)
+static BusStatus kwp_bus_read_frame(uint8_t* frame, uint32_t* dataStart, uint32_t* dataLen, uint32_t timeout) {
+	// bytes after the format byte must follow within P1max of each other
+	uint32_t p1 = (timing.p1Max / DGAS_TIME_US_PER_MS) + 1;
+	uint32_t len, size;
+	BusStatus status;
 
-	for (uint32_t i = 0; i < dataSize; i++) {
-		dest[i] = response[i + KWP_HEADER_SIZE];
+	if ((status = kwp_bus_read_byte(&frame[0], timeout)) != BUS_OK) {
+		// no frame, not necessarily an error if other frames have already been received
+		return status;
+	}
+	size = 1;
+	if (frame[0] & KWP_FORMAT_ADDR_MASK) {
+		size += KWP_ADDR_SIZE;
+	}
+	if ((frame[0] & KWP_DATA_SIZE_MASK) == 0) {
+		// extended length byte
+		size++;
+	}
+	for (uint32_t i = 1; i < size; i++) {
+		if ((status = kwp_bus_read_byte(&frame[i], p1)) != BUS_OK) {
+			DGAS_DEBUG_LOG_MSG_ERROR_RECEIVE(BUS_ID_KWP, status);
+			return status;
+		}
 	}
+	len = frame[0] & KWP_DATA_SIZE_MASK;
+	if (len == 0) {
+		len = frame[size - 1];
+	}
+	*dataStart = size;
+	*dataLen = len;
+
+	// data followed by checksum
+	for (uint32_t i = size; i < size + len + 1; i++) {
+		if ((status = kwp_bus_read_byte(&frame[i], p1)) != BUS_OK) {
+			DGAS_DEBUG_LOG_MSG_ERROR_RECEIVE(BUS_ID_KWP, status);
+			return status;
+		}
+	}
+	size += len;
+
+	if (kwp_bus_calc_checksum(frame, size) != frame[size]) {
+		DGAS_DEBUG_LOG_MSG_ERROR_RECEIVE(BUS_ID_KWP, BUS_CHECKSUM_ERROR);
+		return BUS_CHECKSUM_ERROR;
+	}
+	DGAS_DEBUG_LOG_MSG_DATA_RECEIVE(frame, size + 1, BUS_ID_KWP);
+	return BUS_OK;
 }
 
 /**
- * Get response to request over KWP bus
+ * Get response to request over KWP bus. Every frame which starts within default P2max
+ * of the previous one is gathered (e.g. several ECUs answering a functional request or a
+ * multi-message mode 09 reply) and tagged with the address of the ECU which sent it.
  *
  * resp: BusReponse struct to store response
+ * timeout: Time to wait for start of first frame (ms)
  *
- * Return: Status indicating success or failure
+ * Return: Status indicating success or failure (of first frame if none were received)
  * */
 BusStatus kwp_bus_get_response(BusResponse* resp, uint32_t timeout) {
-	uint8_t fByte, remain, msgSize;
-	uint8_t msg[OBD_BUS_RESPONSE_MAX] = {0};
+	uint8_t frame[KWP_FRAME_MAX];
+	uint32_t start, len;
+	BusFrame* f;
+	BusStatus status;
+
+	resp->dataLen = 0;
+	resp->frameCount = 0;
+
+	while ((status = kwp_bus_read_frame(frame, &start, &len, timeout)) == BUS_OK) {
+		if ((resp->frameCount == BUS_RESPONSE_FRAMES_MAX) ||
+				(resp->dataLen + len > sizeof(resp->data))) {
+			// no room, keep frames gathered so far
+			status = BUS_BUFFER_ERROR;
+			break;
+		}
+		f = &resp->frames[resp->frameCount++];
+		f->src = (frame[0] & KWP_FORMAT_ADDR_MASK) ? frame[KWP_FRAME_SOURCE_INDEX] : 0;
+		f->offset = resp->dataLen;
+		f->len = len;
+		memcpy(resp->data + resp->dataLen, frame + start, len);
+		resp->dataLen += len;
+		// any further frame must start within default P2max of the end of this one
+		timeout = KWP_GATHER_TIMEOUT;
+	}
+	if (resp->frameCount == 0) {
+		if (status == BUS_RX_ERROR) {
+			DGAS_DEBUG_LOG_MSG_ERROR_RECEIVE(BUS_ID_KWP, status);
+		}
+		return status;
+	}
+	return BUS_OK;
+}
+
+/**
+ * Send a request and receive its response, bus mutex must be held
+ *
+ * busReq: Bus request
+ * busResp: Struct to store bus response
+ *
+ * Return: Status indicating success or failure
+ * */
+static BusStatus kwp_bus_transaction(BusRequest* busReq, BusResponse* busResp) {
 	BusStatus status;
 
-	if ((status = kwp_bus_read(&msg[0], sizeof(uint8_t), timeout)) != BUS_OK) {
+	if ((status = kwp_bus_make_request(busReq)) != BUS_OK) {
 		return status;
 	}
 
-	fByte = msg[0];
-	remain = (fByte & KWP_DATA_SIZE_MASK) + KWP_HEADER_SIZE;
-	// +1 for format byte
-	msgSize = KWP_GET_MSG_SIZE_FROM_FBYTE(fByte);
+	if ((status = kwp_bus_get_response(busResp, busReq->timeout)) != BUS_OK) {
+		return status;
+	}
 
-	if (remain > sizeof(msg)) {
-		return BUS_BUFFER_ERROR;
+	return BUS_OK;
+}
+
+/**
+ * Convert AccessTimingParameters parameter bytes to timing parameters
+ *
+ * raw: KWP_ATP_PARAM_COUNT parameter bytes
+ * dest: Destination to store timing parameters
+ *
+ * Return: None
+ * */
+static void kwp_bus_timing_from_raw(const uint8_t* raw, KWPTiming* dest) {
+	// P1max isn't negotiable
+	dest->p1Max = timing.p1Max;
+	dest->p2Min = raw[KWP_ATP_P2_MIN] * KWP_ATP_MIN_RES_US;
+	dest->p2Max = raw[KWP_ATP_P2_MAX] * KWP_ATP_P2_MAX_RES_US;
+	dest->p3Min = raw[KWP_ATP_P3_MIN] * KWP_ATP_MIN_RES_US;
+	dest->p3Max = raw[KWP_ATP_P3_MAX] * KWP_ATP_P3_MAX_RES_US;
+	dest->p4Min = raw[KWP_ATP_P4_MIN] * KWP_ATP_MIN_RES_US;
+}
+
+/**
+ * Make an AccessTimingParameters request, bus mutex must be held
+ *
+ * tpi: Timing parameter identifier (KWP_ATP_READ_LIMITS etc.)
+ * params: KWP_ATP_PARAM_COUNT parameter bytes to send (NULL if none)
+ * resp: Struct to store response
+ *
+ * Return: True if ECU responded positively, false otherwise
+ * */
+static bool kwp_bus_access_timing(uint8_t tpi, const uint8_t* params, BusResponse* resp) {
+	BusRequest req = {.data = {KWP_SID_ACCESS_TIMING, tpi}, .dataLen = KWP_ATP_RESPONSE_PARAMS,
+					  .timeout = KWP_ATP_TIMEOUT};
+
+	if (params != NULL) {
+		memcpy(req.data + KWP_ATP_RESPONSE_PARAMS, params, KWP_ATP_PARAM_COUNT);
+		req.dataLen += KWP_ATP_PARAM_COUNT;
+	}
+	if (kwp_bus_transaction(&req, resp) != BUS_OK) {
+		return false;
 	}
+	// negative response means service isn't supported or parameters were rejected
+	return (resp->dataLen >= KWP_ATP_RESPONSE_PARAMS) &&
+			(resp->data[0] == KWP_SID_ACCESS_TIMING + KWP_BUS_PID_OFFSET) && (resp->data[1] == tpi);
+}
 
-	// we've read the format byte so store remaining starting from msg + 1
-	if ((status = kwp_bus_read(msg + 1, remain, timeout)) != BUS_OK) {
-			return status;
+/**
+ * Ask ECU to use given timing parameters and switch to them if it accepts, bus mutex
+ * must be held
+ *
+ * raw: KWP_ATP_PARAM_COUNT parameter bytes
+ *
+ * Return: True if ECU accepted parameters, false otherwise
+ * */
+static bool kwp_bus_try_timing(const uint8_t* raw) {
+	KWPTiming t;
+	BusResponse resp = {0};
+
+	kwp_bus_timing_from_raw(raw, &t);
+	if (!kwp_bus_timing_valid(&t) || !kwp_bus_access_timing(KWP_ATP_SET_VALUES, raw, &resp)) {
+		return false;
 	}
-	uint8_t checksum = KWP_GET_CHECKSUM_FROM_MSG(msg, msgSize);
+	// ECU uses new timing from its response onwards
+	memcpy(&timing, &t, sizeof(KWPTiming));
+	memcpy(timingRaw, raw, KWP_ATP_PARAM_COUNT);
+	timingRawValid = true;
+	return true;
+}
 
-	if (kwp_bus_calc_checksum(msg, msgSize) != checksum) {
-		return BUS_CHECKSUM_ERROR;
+/**
+ * Build parameters to request from ECU's timing limits. Minimum times are taken at the
+ * ECU's limits while maximum times are kept at their current values, clamped to the
+ * ECU's limits, so responses aren't expected any sooner than before.
+ *
+ * limits: KWP_ATP_PARAM_COUNT parameter bytes read with KWP_ATP_READ_LIMITS
+ * raw: Destination to store KWP_ATP_PARAM_COUNT parameter bytes to request
+ *
+ * Return: None
+ * */
+static void kwp_bus_timing_request(const uint8_t* limits, uint8_t* raw) {
+	uint32_t p2Max = timing.p2Max / KWP_ATP_P2_MAX_RES_US;
+	uint32_t p3Max = timing.p3Max / KWP_ATP_P3_MAX_RES_US;
+	// P2max can't be shorter than P2min
+	uint32_t p2Floor = (limits[KWP_ATP_P2_MIN] * KWP_ATP_MIN_RES_US + KWP_ATP_P2_MAX_RES_US - 1) /
+			KWP_ATP_P2_MAX_RES_US;
+
+	raw[KWP_ATP_P2_MIN] = limits[KWP_ATP_P2_MIN];
+	raw[KWP_ATP_P3_MIN] = limits[KWP_ATP_P3_MIN];
+	raw[KWP_ATP_P4_MIN] = limits[KWP_ATP_P4_MIN];
+	if (p2Max > limits[KWP_ATP_P2_MAX]) {
+		p2Max = limits[KWP_ATP_P2_MAX];
+	}
+	if (p2Max < p2Floor) {
+		p2Max = p2Floor;
+	}
+	if (p3Max > limits[KWP_ATP_P3_MAX]) {
+		p3Max = limits[KWP_ATP_P3_MAX];
+	}
+	raw[KWP_ATP_P2_MAX] = (uint8_t) p2Max;
+	raw[KWP_ATP_P3_MAX] = (uint8_t) p3Max;
+}
+
+/**
+ * Negotiate the tightest timing parameters ECU supports, bus mutex must be held. The
+ * parameters cached for the vehicle are tried first, otherwise the ECU's limits are
+ * read and the fastest minimum times it allows are requested.
+ *
+ * Return: True if new timing parameters are in use, false if bus kept default timing
+ * */
+static bool kwp_bus_negotiate_timing(void) {
+	uint8_t raw[KWP_ATP_PARAM_COUNT];
+	BusResponse resp = {0};
+
+	if (dgas_vehicle_last_kwp_timing(raw) && kwp_bus_try_timing(raw)) {
+		return true;
+	}
+	if (!kwp_bus_access_timing(KWP_ATP_READ_LIMITS, NULL, &resp) ||
+			(resp.dataLen < KWP_ATP_RESPONSE_PARAMS + KWP_ATP_PARAM_COUNT)) {
+		return false;
+	}
+	kwp_bus_timing_request(resp.data + KWP_ATP_RESPONSE_PARAMS, raw);
+	return kwp_bus_try_timing(raw);
+}
+
+/**
+ * Log request cadence before and after timing negotiation to the debugger
+ *
+ * Return: None
+ * */
+static void kwp_bus_log_cadence(void) {
+	char note[DGAS_DEBUG_NOTE_LEN];
+
+	if (timingRawValid) {
+		snprintf(note, sizeof(note), "KWP timing negotiated %lu.%02lu -> %lu.%02lu req/s",
+				(unsigned long) (cadence.before / 1000), (unsigned long) ((cadence.before % 1000) / 10),
+				(unsigned long) (cadence.after / 1000), (unsigned long) ((cadence.after % 1000) / 10));
+	} else {
+		snprintf(note, sizeof(note), "KWP timing default %lu.%02lu req/s",
+				(unsigned long) (cadence.before / 1000), (unsigned long) ((cadence.before % 1000) / 10));
+	}
+	DGAS_DEBUG_LOG_NOTE(BUS_ID_KWP, note);
+}
+
+/**
+ * Advance timing negotiation once enough requests have been made to measure cadence,
+ * bus mutex must be held. Cadence is measured with default timing, timing is
+ * negotiated and then cadence is measured again.
+ *
+ * Return: True if new timing parameters were just negotiated, false otherwise
+ * */
+static bool kwp_bus_timing_step(void) {
+	if ((timingState == KWP_TIMING_SETTLED) || (cadenceSamples < KWP_CADENCE_SAMPLES)) {
+		return false;
+	}
+	if (timingState == KWP_TIMING_NEGOTIATED) {
+		cadence.after = kwp_bus_cadence_rate();
+		timingState = KWP_TIMING_SETTLED;
+		kwp_bus_log_cadence();
+		return false;
+	}
+	cadence.before = kwp_bus_cadence_rate();
+	cadence.after = 0;
+	if (!kwp_bus_negotiate_timing()) {
+		timingState = KWP_TIMING_SETTLED;
+		kwp_bus_log_cadence();
+		return false;
+	}
+	// measure again with new timing
+	timingState = KWP_TIMING_NEGOTIATED;
+	kwp_bus_cadence_reset();
+	return true;
+}
+
+/**
+ * Re-establish a lost session, bus mutex must be held unless session is down (no other
+ * user touches the bus then)
+ *
+ * Return: Status indicating success or failure
+ * */
+static BusStatus kwp_bus_reestablish(void) {
+	sessionStats.reinit++;
+	if (kwp_bus_start_session() != BUS_OK) {
+		sessionStats.reinitFail++;
+		return BUS_INIT_ERROR;
 	}
-	kwp_bus_extract_data(msg, fByte & KWP_DATA_SIZE_MASK, resp->data);
-	// update response struct with number of data bytes
-	resp->dataLen = fByte & KWP_DATA_SIZE_MASK;
 	return BUS_OK;
 }
 
 /**
- * Send and receive a KWP bus request
+ * Send TesterPresent to keep session alive, bus mutex must be held
+ *
+ * Return: Status indicating success or failure (ECU didn't respond)
+ * */
+static BusStatus kwp_bus_keep_alive(void) {
+	BusRequest req = {.data = {KWP_SID_TESTER_PRESENT}, .dataLen = 1,
+					  .timeout = KWP_KEEPALIVE_TIMEOUT};
+	BusResponse resp = {0};
+
+	sessionStats.keepAlive++;
+	// negative response (e.g. service not supported) still shows ECU is listening
+	return kwp_bus_transaction(&req, &resp);
+}
+
+/**
+ * Send and receive a KWP bus request. If ECU has stopped responding the session is
+ * re-established and the request retried so callers don't see a dropped session.
+ * ECUs often ignore requests they don't support, so the session is only treated as
+ * lost if ECU doesn't answer TesterPresent either.
  *
  * busReq: Bus request
  * busResp: Struct to store bus response
@@ -455,16 +1219,102 @@ BusStatus kwp_bus_get_response(BusResponse* resp, uint32_t timeout) {
  * */
 BusStatus kwp_bus_handle_request(BusRequest* busReq, BusResponse* busResp) {
 	BusStatus status;
+	uint8_t raw[KWP_ATP_PARAM_COUNT];
+	bool negotiated = false;
 
-	if ((status = kwp_bus_make_request(busReq)) != BUS_OK) {
-		return status;
+	if (!sessionUp) {
+		// don't wait for mutex while KWP task is re-establishing session
+		return BUS_INIT_ERROR;
+	}
+	xSemaphoreTake(kwpBusMutex, portMAX_DELAY);
+	if (!sessionUp) {
+		// KWP task is retrying in the background
+		xSemaphoreGive(kwpBusMutex);
+		return BUS_INIT_ERROR;
 	}
+	status = kwp_bus_transaction(busReq, busResp);
 
-	if ((status = kwp_bus_get_response(busResp, busReq->timeout)) != BUS_OK) {
-		return status;
+	if (((status == BUS_RX_ERROR) || (status == BUS_TX_ERROR)) && (kwp_bus_keep_alive() != BUS_OK)) {
+		// no response to request or keep alive, ECU has dropped session
+		sessionUp = false;
+		sessionStats.lost++;
+		if (kwp_bus_reestablish() == BUS_OK) {
+			status = kwp_bus_transaction(busReq, busResp);
+		}
+	}
+	if ((status == BUS_OK) && (negotiated = kwp_bus_timing_step())) {
+		memcpy(raw, timingRaw, sizeof(raw));
 	}
+	xSemaphoreGive(kwpBusMutex);
 
-	return BUS_OK;
+	if (negotiated) {
+		// saving to flash is slow so don't hold up the bus
+		dgas_vehicle_save_kwp_timing(raw);
+	}
+	return status;
+}
+
+/**
+ * Get time until session next needs servicing (keep alive or re-establish)
+ *
+ * Return: Ticks until session needs servicing
+ * */
+static TickType_t kwp_bus_ticks_to_service(void) {
+	uint64_t idle = dgas_time_us() - lastActivity;
+	uint64_t due = timing.p3Max - KWP_KEEPALIVE_MARGIN_US;
+
+	if (!sessionUp) {
+		// also polls for resume while suspended
+		return pdMS_TO_TICKS(KWP_REINIT_RETRY);
+	}
+	if (idle >= due) {
+		return 0;
+	}
+	return pdMS_TO_TICKS((due - idle) / DGAS_TIME_US_PER_MS) + 1;
+}
+
+/**
+ * Keep session alive if no request has been made recently, re-establish it if it
+ * has been lost. Re-establishing takes seconds so it is done without holding the bus
+ * mutex, requests fail straight away while session is down and nothing else uses the
+ * bus until it is up.
+ *
+ * Return: None
+ * */
+static void kwp_bus_service_session(void) {
+	bool reinit;
+
+	xSemaphoreTake(kwpBusMutex, portMAX_DELAY);
+	// leave session down while another bus is in use
+	reinit = !suspended && !sessionUp;
+	if (!suspended && sessionUp && (kwp_bus_ticks_to_service() == 0) &&
+			(kwp_bus_keep_alive() != BUS_OK)) {
+		sessionUp = false;
+		sessionStats.lost++;
+		reinit = true;
+	}
+	xSemaphoreGive(kwpBusMutex);
+
+	if (reinit) {
+		kwp_bus_reestablish();
+		xSemaphoreTake(kwpBusMutex, portMAX_DELAY);
+		if (suspended) {
+			// bus was switched away while session was being established
+			sessionUp = false;
+		}
+		xSemaphoreGive(kwpBusMutex);
+	}
+}
+
+/**
+ * Get statistics of KWP session management
+ *
+ * dest: Destination to store statistics
+ *
+ * Return: None
+ * */
+void kwp_bus_get_session_stats(KWPSessionStats* dest) {
+	memcpy(dest, &sessionStats, sizeof(KWPSessionStats));
 }
 
 /**
@@ -473,33 +1323,72 @@ BusStatus kwp_bus_handle_request(BusRequest* busReq, BusResponse* busResp) {
  * Return: None
  * */
 void task_kwp_bus(void) {
-	//while(kwp_bus_init() != BUS_OK) {
-	//	vTaskDelay(100);
-	//}
-	kwp_bus_init();
 	BusRequest req = {0};
 	BusResponse resp = {0};
 
+	kwpBusMutex = xSemaphoreCreateMutex();
+	// if ECU doesn't respond session is retried in background
+	kwp_bus_init();
+
 	queueKwpRequest = xQueueCreate(QUEUE_KWP_LENGTH, sizeof(BusRequest));
 	queueKwpResponse = xQueueCreate(QUEUE_KWP_LENGTH, sizeof(BusResponse));
 
 	for (;;) {
-		if (xQueueReceive(queueKwpRequest, &req, 10) == pdTRUE) {
-			// OBD controller made a request
+		// OBD controller normally calls kwp_bus_handle_request() directly, queued
+		// requests are still served for other users of the bus. When idle keep the
+		// session alive
+		if (xQueueReceive(queueKwpRequest, &req, kwp_bus_ticks_to_service()) == pdTRUE) {
 			resp.status = kwp_bus_handle_request(&req, &resp);
 			// send response to out bound queue
-			xQueueSend(queueKwpResponse, &resp, 10);
+			xQueueSend(queueKwpResponse, &resp, portMAX_DELAY);
+		} else {
+			kwp_bus_service_session();
 		}
-		vTaskDelay(10);
 	}
 }
 
 /**
- * Initialise KWP thread
+ * Stop maintaining session while another bus is in use. ECU drops the session once
+ * keep alives stop so it is re-established on resume.
+ *
+ * Return: None
+ * */
+void kwp_bus_suspend(void) {
+	if (kwpBusMutex == NULL) {
+		// task hasn't started yet
+		return;
+	}
+	xSemaphoreTake(kwpBusMutex, portMAX_DELAY);
+	suspended = true;
+	sessionUp = false;
+	xSemaphoreGive(kwpBusMutex);
+}
+
+/**
+ * Resume maintaining session after switching back to KWP. KWP task re-establishes the
+ * session on its next retry.
+ *
+ * Return: None
+ * */
+static void kwp_bus_resume(void) {
+	if (kwpBusMutex == NULL) {
+		return;
+	}
+	xSemaphoreTake(kwpBusMutex, portMAX_DELAY);
+	suspended = false;
+	xSemaphoreGive(kwpBusMutex);
+}
+
+/**
+ * Initialise KWP thread, or resume the session if thread is already running
  *
  * Return: None
  * */
 void task_init_kwp_bus(void) {
+	if (handleKwp != NULL) {
+		kwp_bus_resume();
+		return;
+	}
 	xTaskCreate((void*) &task_kwp_bus, "TaskKwpBus", TASK_KWP_STACK_SIZE,
 			NULL, TASK_KWP_PRIORITY, &handleKwp);
 }
@@ -0,0 +1,452 @@
+/*
+ * uds.c
+ *
+ *  Created on: 18 Oct. 2026
+ *      Author: rhett
+ */
+
+// UDS (ISO 14229) client on top of the OBD CAN transport. Several DIDs can be read in a
+// single ReadDataByIdentifier request and a record made up of several DIDs can be
+// dynamically defined on the ECU so a single DID read returns all of them packed back
+// to back. Requests go through the CAN task like any other so ISO-TP segmentation and
+// response matching are handled there. Records can also be streamed by the ECU as
+// periodic identifiers, the CAN task hands their frames to uds_periodic_decode().
+
+#include <uds.h>
+#include <iso15765.h>
+#include <isotp.h>
+#include <dgas_obd.h>
+#include <dgas_pid.h>
+#include <dgas_live.h>
+#include <string.h>
+
+// periodic identifiers ECU is streaming, read by CAN task
+static UDSPeriodic periodic[UDS_PERIODIC_ID_COUNT];
+// number of identifiers in periodic which frames are decoded for
+static volatile uint32_t periodicCount;
+// number of identifiers in periodic defined on ECU (still to be cleared when stopping)
+static uint32_t periodicDefined;
+// PIDs fed by a periodic identifier, one bit per PID
+static uint32_t periodicFed[0x100 / 32];
+// response ID of ECU streaming periodic identifiers
+static uint32_t periodicEcu;
+// true if ECU was switched to extended session to stream
+static bool sessionChanged;
+// tick count at which TesterPresent is next sent
+static TickType_t testerPresentDue;
+// tick count each identifier in periodic last had a frame decoded, written by CAN task
+static volatile TickType_t periodicLast[UDS_PERIODIC_ID_COUNT];
+
+/**
+ * Get negative response code of a response
+ *
+ * resp: Response
+ *
+ * Return: Negative response code, UDS_NRC_NONE if response is positive
+ * */
+uint8_t uds_nrc(const BusResponse* resp) {
+	if ((resp->dataLen > UDS_NRC_INDEX) && (resp->data[0] == UDS_SID_NEGATIVE)) {
+		return resp->data[UDS_NRC_INDEX];
+	}
+	return UDS_NRC_NONE;
+}
+
+/**
+ * Make a UDS request and wait for response. A negative response completes the request
+ * successfully, use uds_nrc() to check for one.
+ *
+ * ecu: Response ID of ECU to send request to, OBD_CAN_ID_REQUEST to send to all ECUs
+ * data: Request (service ID first)
+ * len: Length of request
+ * resp: Destination to store response
+ * timeout: Time to wait for response (ms)
+ *
+ * Return: Status indicating success or failure
+ * */
+BusStatus uds_request(uint32_t ecu, uint8_t* data, uint32_t len, BusResponse* resp, uint32_t timeout) {
+	BusRequest req = {0};
+	BusStatus status;
+
+	if (len > BUS_REQUEST_MAX) {
+		return BUS_BUFFER_ERROR;
+	}
+	memcpy(req.data, data, len);
+	req.dataLen = len;
+	req.timeout = timeout;
+	if ((status = obd_can_submit(ecu, &req, resp)) != BUS_OK) {
+		return status;
+	}
+	return obd_can_wait(resp);
+}
+
+/**
+ * Read several data identifiers in a single ReadDataByIdentifier request
+ *
+ * ecu: Response ID of ECU to read from, OBD_CAN_ID_REQUEST to read from first ECU to
+ * 		respond
+ * dids: Identifiers to read
+ * count: Number of identifiers (at most UDS_READ_DID_MAX)
+ * resp: Destination to store response, use uds_split_dids() to find each identifier
+ * timeout: Time to wait for response (ms)
+ *
+ * Return: Status indicating success or failure
+ * */
+BusStatus uds_read_dids(uint32_t ecu, const UDSDataId* dids, uint32_t count, BusResponse* resp,
+		uint32_t timeout) {
+	uint8_t req[1 + (UDS_READ_DID_MAX * UDS_DID_LEN)];
+	uint32_t len = 0;
+
+	if ((count == 0) || (count > UDS_READ_DID_MAX)) {
+		return BUS_BUFFER_ERROR;
+	}
+	req[len++] = UDS_SID_READ_DID;
+	for (uint32_t i = 0; i < count; i++) {
+		req[len++] = UDS_DID_HIGH(dids[i].did);
+		req[len++] = UDS_DID_LOW(dids[i].did);
+	}
+	return uds_request(ecu, req, len, resp, timeout);
+}
+
+/**
+ * Find data of each identifier in a ReadDataByIdentifier response. Response takes form
+ * [0x62, DID, data..., DID, data...], ECU may leave out identifiers it doesn't support.
+ *
+ * resp: Response to split
+ * dids: Identifiers which were read
+ * count: Number of identifiers
+ * dest: Array (one per identifier) to store pointer to each identifier's data, NULL if
+ * 		 identifier isn't in response
+ *
+ * Return: Number of identifiers found
+ * */
+uint32_t uds_split_dids(BusResponse* resp, const UDSDataId* dids, uint32_t count, uint8_t** dest) {
+	uint32_t found = 0;
+	uint32_t i = 1;
+	uint16_t did;
+	uint32_t j;
+
+	for (j = 0; j < count; j++) {
+		dest[j] = NULL;
+	}
+	if ((resp->dataLen == 0) || (resp->data[0] != UDS_SID_READ_DID + UDS_SID_POSITIVE_OFFSET)) {
+		return 0;
+	}
+	while (i + UDS_DID_LEN <= resp->dataLen) {
+		did = (resp->data[i] << 8) | resp->data[i + 1];
+		i += UDS_DID_LEN;
+		for (j = 0; j < count; j++) {
+			if (dids[j].did == did) {
+				break;
+			}
+		}
+		if ((j == count) || (i + dids[j].len > resp->dataLen)) {
+			// length of unknown identifier can't be skipped so stop here
+			break;
+		}
+		if (dest[j] == NULL) {
+			dest[j] = resp->data + i;
+			found++;
+		}
+		i += dids[j].len;
+	}
+	return found;
+}
+
+/**
+ * Dynamically define a record made up of other identifiers. Reading the record returns
+ * the data of each source back to back in order. Any previous definition of the record
+ * is cleared first.
+ *
+ * ecu: Response ID of ECU to define record on
+ * record: Identifier of record (0xF200 - 0xF3FF)
+ * sources: Identifiers record is made of, whole identifier is used
+ * count: Number of sources (at most UDS_DDDI_SOURCES_MAX)
+ * resp: Destination to store response
+ * timeout: Time to wait for each response (ms)
+ *
+ * Return: Status indicating success or failure
+ * */
+BusStatus uds_define_record(uint32_t ecu, uint16_t record, const UDSDataId* sources, uint32_t count,
+		BusResponse* resp, uint32_t timeout) {
+	uint8_t req[UDS_DDDI_HEADER_LEN + (UDS_DDDI_SOURCES_MAX * UDS_DDDI_SOURCE_LEN)];
+	uint32_t len = 0;
+
+	if ((count == 0) || (count > UDS_DDDI_SOURCES_MAX)) {
+		return BUS_BUFFER_ERROR;
+	}
+	// definitions append to a record so old sources have to go first, record may not
+	// exist so response doesn't matter
+	uds_clear_record(ecu, record, resp, timeout);
+
+	req[len++] = UDS_SID_DYNAMIC_DEFINE;
+	req[len++] = UDS_DDDI_DEFINE_BY_ID;
+	req[len++] = UDS_DID_HIGH(record);
+	req[len++] = UDS_DID_LOW(record);
+	for (uint32_t i = 0; i < count; i++) {
+		req[len++] = UDS_DID_HIGH(sources[i].did);
+		req[len++] = UDS_DID_LOW(sources[i].did);
+		req[len++] = 1;
+		req[len++] = sources[i].len;
+	}
+	return uds_request(ecu, req, len, resp, timeout);
+}
+
+/**
+ * Clear a dynamically defined record
+ *
+ * ecu: Response ID of ECU record is defined on
+ * record: Identifier of record
+ * resp: Destination to store response
+ * timeout: Time to wait for response (ms)
+ *
+ * Return: Status indicating success or failure
+ * */
+BusStatus uds_clear_record(uint32_t ecu, uint16_t record, BusResponse* resp, uint32_t timeout) {
+	uint8_t req[UDS_DDDI_HEADER_LEN] = {UDS_SID_DYNAMIC_DEFINE, UDS_DDDI_CLEAR,
+			UDS_DID_HIGH(record), UDS_DID_LOW(record)};
+
+	return uds_request(ecu, req, sizeof(req), resp, timeout);
+}
+
+/**
+ * Make a request to ECU streaming periodic identifiers, a response is waited for but
+ * not used
+ *
+ * data: Request
+ * len: Length of request
+ * timeout: Time to wait for response (ms)
+ *
+ * Return: True if ECU responded positively, false otherwise
+ * */
+static bool uds_periodic_request(uint8_t* data, uint32_t len, uint32_t timeout) {
+	BusResponse resp = {0};
+
+	return (uds_request(periodicEcu, data, len, &resp, timeout) == BUS_OK) &&
+			(uds_nrc(&resp) == UDS_NRC_NONE);
+}
+
+/**
+ * Have ECU stream periodic identifiers. ECU is switched to extended session first (most
+ * ECUs only stream outside default session), then each identifier is defined as a
+ * record of its PIDs and started at its transmission mode. Anything already streaming
+ * is stopped first.
+ *
+ * ecu: Response ID of ECU to stream from
+ * ids: Periodic identifiers to stream (id 0xE0 - 0xEF)
+ * count: Number of identifiers (at most UDS_PERIODIC_ID_COUNT)
+ * timeout: Time to wait for each response (ms)
+ *
+ * Return: True if ECU is streaming every identifier, false otherwise (nothing is left
+ * 		   streaming)
+ * */
+bool uds_periodic_start(uint32_t ecu, const UDSPeriodic* ids, uint32_t count, uint32_t timeout) {
+	BusResponse resp = {0};
+	UDSDataId sources[UDS_PERIODIC_DATA_MAX];
+	uint8_t session[] = {UDS_SID_SESSION, UDS_SESSION_EXTENDED};
+	uint8_t req[2 + UDS_PERIODIC_ID_COUNT];
+	uint8_t modes[] = {UDS_PERIODIC_FAST, UDS_PERIODIC_MEDIUM, UDS_PERIODIC_SLOW};
+	uint32_t len;
+
+	uds_periodic_stop(timeout);
+	if ((count == 0) || (count > UDS_PERIODIC_ID_COUNT)) {
+		return false;
+	}
+	periodicEcu = ecu;
+	if (uds_request(ecu, session, sizeof(session), &resp, timeout) != BUS_OK) {
+		return false;
+	}
+	// some ECUs stream in default session so carry on if session is refused
+	sessionChanged = uds_nrc(&resp) == UDS_NRC_NONE;
+	testerPresentDue = xTaskGetTickCount() + pdMS_TO_TICKS(UDS_TESTER_PRESENT_PERIOD);
+
+	memcpy(periodic, ids, count * sizeof(UDSPeriodic));
+	for (periodicDefined = 0; periodicDefined < count; periodicDefined++) {
+		const UDSPeriodic* id = &ids[periodicDefined];
+
+		for (uint32_t i = 0; i < id->count; i++) {
+			sources[i].did = UDS_DID_OBD_PID(id->pids[i]);
+			sources[i].len = obd_pid_data_len(id->pids[i]);
+		}
+		if ((uds_define_record(ecu, UDS_DID_PERIODIC(id->id), sources, id->count, &resp, timeout) != BUS_OK) ||
+				(uds_nrc(&resp) != UDS_NRC_NONE)) {
+			uds_periodic_stop(timeout);
+			return false;
+		}
+		for (uint32_t i = 0; i < id->count; i++) {
+			periodicFed[id->pids[i] / 32] |= 1UL << (id->pids[i] % 32);
+		}
+	}
+	for (uint32_t i = 0; i < count; i++) {
+		periodicLast[i] = xTaskGetTickCount();
+	}
+	// frames may arrive as soon as first mode is started
+	__DMB();
+	periodicCount = count;
+
+	for (uint32_t m = 0; m < sizeof(modes); m++) {
+		req[0] = UDS_SID_PERIODIC;
+		req[1] = modes[m];
+		len = 2;
+		for (uint32_t i = 0; i < count; i++) {
+			if (ids[i].mode == modes[m]) {
+				req[len++] = ids[i].id;
+			}
+		}
+		if ((len > 2) && !uds_periodic_request(req, len, timeout)) {
+			uds_periodic_stop(timeout);
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * Stop ECU streaming periodic identifiers, clear their records and return ECU to
+ * default session. Frames still in flight are ignored from here on.
+ *
+ * timeout: Time to wait for each response (ms)
+ *
+ * Return: None
+ * */
+void uds_periodic_stop(uint32_t timeout) {
+	BusResponse resp = {0};
+	uint8_t stop[] = {UDS_SID_PERIODIC, UDS_PERIODIC_STOP};
+	uint8_t session[] = {UDS_SID_SESSION, UDS_SESSION_DEFAULT};
+	bool started = periodicCount != 0;
+
+	periodicCount = 0;
+	__DMB();
+	memset(periodicFed, 0, sizeof(periodicFed));
+	if (started) {
+		// stop with no identifiers stops all of them
+		uds_periodic_request(stop, sizeof(stop), timeout);
+	}
+	while (periodicDefined != 0) {
+		uds_clear_record(periodicEcu, UDS_DID_PERIODIC(periodic[--periodicDefined].id), &resp, timeout);
+	}
+	if (sessionChanged) {
+		uds_periodic_request(session, sizeof(session), timeout);
+		sessionChanged = false;
+	}
+}
+
+/**
+ * Keep ECU in extended session while it is streaming by sending TesterPresent every
+ * UDS_TESTER_PRESENT_PERIOD, and check ECU is still streaming. ECU is taken to have
+ * stopped if TesterPresent isn't answered or an identifier has had no frames for
+ * UDS_PERIODIC_LOST_PERIODS slow rate periods (e.g. ECU reset or left session).
+ *
+ * timeout: Time to wait for response (ms)
+ *
+ * Return: True if ECU is still streaming (or nothing is streamed), false if ECU has
+ * 		   stopped and stream should be stopped
+ * */
+bool uds_periodic_keep_alive(uint32_t timeout) {
+	uint8_t req[] = {UDS_SID_TESTER_PRESENT, 0x00};
+	TickType_t now = xTaskGetTickCount();
+
+	for (uint32_t i = 0; i < periodicCount; i++) {
+		if (now - periodicLast[i] > pdMS_TO_TICKS(UDS_PERIODIC_SLOW_PERIOD * UDS_PERIODIC_LOST_PERIODS)) {
+			return false;
+		}
+	}
+	if (!sessionChanged || ((int32_t) (now - testerPresentDue) < 0)) {
+		return true;
+	}
+	testerPresentDue = now + pdMS_TO_TICKS(UDS_TESTER_PRESENT_PERIOD);
+	return uds_periodic_request(req, sizeof(req), timeout);
+}
+
+/**
+ * Check if ECU is streaming exactly a set of periodic identifiers
+ *
+ * ids: Periodic identifiers
+ * count: Number of identifiers
+ *
+ * Return: True if identifiers are what ECU is streaming, false otherwise
+ * */
+bool uds_periodic_matches(const UDSPeriodic* ids, uint32_t count) {
+	return (count == periodicCount) && (memcmp(periodic, ids, count * sizeof(UDSPeriodic)) == 0);
+}
+
+/**
+ * Check if a PID is streamed by a periodic identifier
+ *
+ * pid: Mode 01 PID
+ *
+ * Return: True if PID is streamed, false otherwise
+ * */
+bool uds_periodic_feeds(uint8_t pid) {
+	return (periodicFed[pid / 32] & (1UL << (pid % 32))) != 0;
+}
+
+/**
+ * Check if a frame received on an ECU's response ID is a periodic frame. Only frames of
+ * the streaming ECU are checked so other ECUs' traffic is left to ISO-TP. Called from CAN
+ * receive interrupt.
+ *
+ * id: Response ID frame was received on
+ * data: Frame data
+ * len: Number of data bytes
+ *
+ * Return: Index of periodic identifier within frame, -1 if frame isn't periodic
+ * */
+int32_t uds_periodic_frame(uint32_t id, const uint8_t* data, uint32_t len) {
+	if ((periodicCount == 0) || (id != periodicEcu) || (len < 2)) {
+		return -1;
+	}
+	if ((data[0] & UDS_PERIODIC_ID_MASK) == UDS_PERIODIC_ID_FIRST) {
+		return 0;
+	}
+	if (((data[0] & ISOTP_PCI_TYPE_MASK) == ISOTP_PCI_SINGLE) && (len > 2) &&
+			(data[1] == UDS_SID_PERIODIC + UDS_SID_POSITIVE_OFFSET) &&
+			((data[2] & UDS_PERIODIC_ID_MASK) == UDS_PERIODIC_ID_FIRST)) {
+		return 2;
+	}
+	return -1;
+}
+
+/**
+ * Decode a periodic frame straight into the live data table. Called from CAN task, the
+ * only writer of streamed PIDs' channels while they are streamed.
+ *
+ * id: Response ID frame was received on
+ * data: Frame data
+ * len: Number of data bytes
+ * timestamp: Time frame was received (ms)
+ *
+ * Return: None
+ * */
+void uds_periodic_decode(uint32_t id, uint8_t* data, uint32_t len, uint32_t timestamp) {
+	int32_t at = uds_periodic_frame(id, data, len);
+	uint32_t count = periodicCount;
+	uint32_t end, dataLen;
+	int32_t value;
+
+	if (at < 0) {
+		return;
+	}
+	if (at != 0) {
+		// single frame length covers response SID and identifier
+		end = (data[0] & ISOTP_PCI_LOW_MASK) + 1;
+		len = (end < len) ? end : len;
+	}
+	for (uint32_t i = 0; i < count; i++) {
+		if (periodic[i].id != data[at]) {
+			continue;
+		}
+		periodicLast[i] = xTaskGetTickCount();
+		at++;
+		for (uint32_t j = 0; j < periodic[i].count; j++) {
+			dataLen = obd_pid_data_len(periodic[i].pids[j]);
+			if (at + dataLen > len) {
+				break;
+			}
+			if (obd_pid_convert_fixed(periodic[i].pids[j], data + at, &value)) {
+				dgas_live_write(LIVE_CHANNEL_PID(periodic[i].pids[j]), value, OBD_OK, timestamp);
+			}
+			at += dataLen;
+		}
+		return;
+	}
+}
@@ -14,6 +14,7 @@
 #include <ui_debug.h>
 #include <dgas_obd.h>
 #include <kwp.h>
+#include <iso15765.h>
 #include <dgas_ui.h>
 #include <string.h>
 #include <stdio.h>
@@ -25,8 +26,16 @@ static TaskHandle_t taskHandleDebug;
 QueueHandle_t queueDebug;
 // flag to keep track of whether debug window is paused or not
 static bool debugPaused;
+// true if CAN traffic profile has been selected in place of the message log
+static bool profileView;
 // buffer for storing debug messages before flushing to UI
 static char debugLog[DGAS_DEBUG_BUFF_LEN];
+// CAN traffic profile reports, UI shows one while the other is built
+static char profileText[2][DGAS_DEBUG_PROFILE_TEXT_LEN];
+// index of profileText to build next report in
+static uint32_t profileNext;
+// statistics of each CAN ID for building report
+static CANIdStats profileIds[OBD_CAN_PROFILE_IDS];
 
 /**
  * Get task handle of debug task
@@ -55,6 +64,15 @@ void dgas_debug_resume(void) {
 	debugPaused = false;
 }
 
+/**
+ * Switch debug window between message log and CAN traffic profile
+ *
+ * Return: None
+ * */
+void dgas_debug_toggle_view(void) {
+	profileView = !profileView;
+}
+
 /**
  * Add string to destination string
  *
@@ -94,6 +112,10 @@ void dgas_debug_add_newline(char* dest) {
 void dgas_debug_log_msg(uint8_t* data, uint32_t dataLen, BusStatus status, BusID bid, BusDirection direction) {
 	DebugMsg msg = {0};
 
+	if (dataLen > sizeof(msg.data)) {
+		// only show as much as fits
+		dataLen = sizeof(msg.data);
+	}
 	if (data != NULL) {
 		memcpy(msg.data, data, dataLen);
 	}
@@ -109,6 +131,27 @@ void dgas_debug_log_msg(uint8_t* data, uint32_t dataLen, BusStatus status, BusID
 	}
 }
 
+/**
+ * Log a text note to the debugger (e.g. a change of bus timing). Can be called by bus
+ * tasks directly or using DGAS_DEBUG_LOG_NOTE
+ *
+ * bid: BusID of bus which logged note
+ * note: Note to log, truncated to DGAS_DEBUG_NOTE_LEN - 1 characters
+ *
+ * Return: None
+ * */
+void dgas_debug_log_note(BusID bid, const char* note) {
+	DebugMsg msg = {0};
+
+	strncpy(msg.note, note, sizeof(msg.note) - 1);
+	msg.bid = bid;
+	msg.status = BUS_OK;
+
+	if (queueDebug != NULL) {
+		xQueueSend(queueDebug, &msg, 0);
+	}
+}
+
 /**
  * Extract the OBD mode from data sent over bus
  *
@@ -224,6 +267,12 @@ void dgas_debug_add_error(char* dest, BusStatus status) {
  * */
 void dgas_debug_build_message(char* message, DebugMsg* msg) {
 
+	if (msg->note[0] != '\0') {
+		dgas_debug_add_str(message, "#00BFFF [INFO]# ");
+		// note may contain '%' so don't use it as a format string
+		sprintf(message + strlen(message), "%s\n", msg->note);
+		return;
+	}
 	dgas_debug_add_header(message, msg->status, msg->direction);
 	if (msg->status == BUS_OK) {
 		// receive data from stream
@@ -259,6 +308,46 @@ void dgas_debug_flush(void) {
 	memset(debugLog, 0, sizeof(debugLog));
 }
 
+/**
+ * Show CAN traffic profile on debug UI. Busiest IDs are listed with their frame count,
+ * average (min - max) period and which data bytes change.
+ *
+ * Return: None
+ * */
+void dgas_debug_show_can_profile(void) {
+	char* text = profileText[profileNext];
+	char line[DGAS_DEBUG_PROFILE_LINE_LEN];
+	CANBusStats stats;
+	CANIdStats tmp;
+	UIDebugProfile prof = {.pText = text};
+	uint32_t count = obd_can_profile_report(profileIds, OBD_CAN_PROFILE_IDS);
+	uint32_t shown = (count < DGAS_DEBUG_PROFILE_LINES) ? count : DGAS_DEBUG_PROFILE_LINES;
+
+	obd_can_get_bus_stats(&stats);
+	snprintf(text, DGAS_DEBUG_PROFILE_TEXT_LEN, "load %lu.%lu%% TEC %u REC %u off %lu ids %lu\n",
+			stats.load / 10, stats.load % 10, stats.tec, stats.rec, stats.busOff, count);
+
+	for (uint32_t i = 0; i < shown; i++) {
+		// only busiest IDs are shown so partial selection sort is enough
+		for (uint32_t j = i + 1; j < count; j++) {
+			if (profileIds[j].count > profileIds[i].count) {
+				memcpy(&tmp, &profileIds[i], sizeof(CANIdStats));
+				memcpy(&profileIds[i], &profileIds[j], sizeof(CANIdStats));
+				memcpy(&profileIds[j], &tmp, sizeof(CANIdStats));
+			}
+		}
+		CANIdStats* id = &profileIds[i];
+		uint32_t avg = obd_can_profile_avg_period(id) / 100;
+
+		snprintf(line, sizeof(line), "%03lX %lu %lu.%lums (%lu-%lu) %02X\n",
+				id->id, id->count, avg / 10, avg % 10,
+				(id->count < 2) ? 0 : (id->minPeriod / 1000), id->maxPeriod / 1000, id->changed);
+		strncat(text, line, DGAS_DEBUG_PROFILE_TEXT_LEN - strlen(text) - 1);
+	}
+	ui_debug_make_request(UI_CMD_DEBUG_PROFILE, &prof);
+	profileNext ^= 1;
+}
+
 /**
  * Handle a new debug message to log to debugger
  *
@@ -281,12 +370,21 @@ void dgas_debug_handle_message(DebugMsg* msg) {
  * */
 void task_debug(void) {
 	DebugMsg msg = {0};
+	TickType_t profileDue = xTaskGetTickCount();
 	debugPaused = false;
 	queueDebug = xQueueCreate(DGAS_DEBUG_QUEUE_LEN, sizeof(DebugMsg));
 	ui_debug_init();
 
 	for(;;) {
-		if (xQueueReceive(queueDebug, &msg, 0) == pdTRUE) {
+		if ((obd_get_active_bus() == BUS_ID_CAN) && (profileView || obd_can_is_listen_only())) {
+			// show traffic when selected, or when listening only since nothing is sent so
+			// there are no messages to log. Logged messages are dropped meanwhile
+			while (xQueueReceive(queueDebug, &msg, 0) == pdTRUE);
+			if (!debugPaused && ((int32_t) (xTaskGetTickCount() - profileDue) >= 0)) {
+				dgas_debug_show_can_profile();
+				profileDue = xTaskGetTickCount() + pdMS_TO_TICKS(DGAS_DEBUG_PROFILE_PERIOD);
+			}
+		} else if (xQueueReceive(queueDebug, &msg, 0) == pdTRUE) {
 			dgas_debug_handle_message(&msg);
 
 			if (!debugPaused) {
@@ -57,11 +57,11 @@ DStatus dgas_dtc_get(void) {
 	req.mode = OBD_MODE_DTC;
 	req.pid = 0; // unused for DTC
 	req.timeout = DGAS_DTC_OBD_TIMEOUT;
+	req.priority = OBD_PRIORITY_BACKGROUND;
 
-	if (xQueueSend(queueOBDRequest, &req, DGAS_DTC_OBD_TIMEOUT) != pdTRUE) {
+	if (dgas_obd_request(&req, &resp) != OBD_OK) {
 		return DGAS_STATUS_ERROR;
 	}
-	while(xQueueReceive(queueOBDResponse, &resp, portMAX_DELAY) != pdTRUE);
-
+	return DGAS_STATUS_OK;
 }
 
@@ -9,6 +9,9 @@
 #include <dgas_param.h>
 #include <dgas_adc.h>
 #include <dgas_obd.h>
+#include <dgas_vehicle.h>
+#include <dgas_live.h>
+#include <dgas_pid.h>
 #include <dgas_ui.h>
 #include <ui_gauge.h>
 #include <string.h>
@@ -18,8 +21,6 @@
 static TaskHandle_t taskHandleGauge;
 // Stores gauge state for gauge
 static GaugeState gState;
-// Queue for receiving gauge updates
-QueueHandle_t queueGaugeUpdate;
 // event group for changing gauge parameters
 EventGroupHandle_t eventGaugeParam;
 
@@ -46,11 +47,27 @@ void gauge_load_param(const GaugeParam* param) {
 	strcpy(gLoad.lName, param->name);
 	strcpy(gLoad.lUnits, param->units);
 
+	// swap polled PID over to new parameter
+	if (gState.param != NULL) {
+		dgas_obd_sched_remove(gState.param->pid);
+	}
+	dgas_obd_sched_add(param->pid, GAUGE_POLL_RATE);
+
 	gState.param = param;
 	gState.paramMax = 0;
 	gState.paramVal = 0;
+	gState.liveSeq = 0;
+	gState.stale = false;
+	gState.arcVal = 0;
+	memset(&gState.predict, 0, sizeof(GaugePredict));
 	// make request to update gauge UI
 	ui_gauge_make_request(UI_CMD_GAUGE_LOAD, &gLoad);
+
+	if (!dgas_vehicle_pid_supported(OBD_MODE_LIVE, param->pid)) {
+		// scheduler won't poll parameter so let user know why it isn't updating
+		gauge_set_obd_status_string(gState.obdStat, OBD_UNSUPPORTED);
+		gauge_update();
+	}
 }
 
 /**
@@ -62,7 +79,9 @@ void gauge_load_param(const GaugeParam* param) {
  * */
 void gauge_update(void) {
 	UIGaugeUpdate gUpdate = {.gVal = gState.paramVal,
-							 .gVbat = gState.vBat};
+							 .gArc = gState.arcVal,
+							 .gVbat = gState.vBat,
+							 .gStale = gState.stale};
 
 	strcpy(gUpdate.gObd, gState.obdStat);
 	// make request to UI to update gauge
@@ -84,6 +103,8 @@ void gauge_set_obd_status_string(char* dest, OBDStatus status) {
 		sprintf(dest, "#FF0000 ERROR#");
 	} else if (status == OBD_INIT) {
 		sprintf(dest, "#00FFFF INIT#");
+	} else if (status == OBD_UNSUPPORTED) {
+		sprintf(dest, "#FFA500 UNSUPPORTED#");
 	}
 }
 
@@ -133,48 +154,137 @@ void gauge_param_change_handler(EventBits_t uxBits) {
  * Return: None
  * */
 void gauge_get_supply_voltage(float* dest) {
-	if (queueADC != NULL) {
-		xQueueReceive(queueADC, dest, 0);
+	AdcSample sample;
+
+	if ((queueADC != NULL) && (xQueueReceive(queueADC, &sample, 0) == pdTRUE)) {
+		*dest = sample.voltage;
 	}
 }
 
 /**
- * Get update on a given OBD-II parameter to display on gauge
+ * Add a new sample to prediction stage
  *
- * update: Pointer to GaugeUpdate struct to populate
- * pid: PID of parameter to get update on
- * timeout: Timeout to use when waiting for response
+ * pred: Prediction stage
+ * value: Value of sample
+ * time: Time sample was taken
  *
- * Return: 0 if successfull update was received, 1 if failure occured
+ * Return: None
  * */
-int gauge_update_state(OBDPid pid, uint32_t timeout) {
-	OBDRequest req = {0};
-	OBDResponse resp = {0};
+static void gauge_predict_sample(GaugePredict* pred, int32_t value, uint32_t time) {
+	if (pred->lastTime == 0) {
+		// first sample so jump straight to it
+		pred->shown = value;
+	}
+	pred->prevValue = pred->lastValue;
+	pred->prevTime = pred->lastTime;
+	pred->lastValue = value;
+	pred->lastTime = time;
+}
 
-	req.mode = OBD_MODE_LIVE;
-	req.pid = pid;
-	req.timeout = timeout;
+/**
+ * Predict current value by extrapolating the trend of the last two samples. The
+ * extrapolation never runs past one sample interval (or GAUGE_PREDICT_HORIZON) so the
+ * needle can't overshoot by more than the last change.
+ *
+ * pred: Prediction stage
+ * now: Current time
+ *
+ * Return: Predicted value
+ * */
+static int32_t gauge_predict_value(GaugePredict* pred, uint32_t now) {
+	uint32_t interval = pred->lastTime - pred->prevTime;
+	uint32_t elapsed = now - pred->lastTime;
+
+	if ((pred->prevTime == 0) || (interval == 0)) {
+		return pred->lastValue;
+	}
+	if (elapsed > interval) {
+		elapsed = interval;
+	}
+	if (elapsed > GAUGE_PREDICT_HORIZON) {
+		elapsed = GAUGE_PREDICT_HORIZON;
+	}
+	return pred->lastValue + (int32_t) (((int64_t) (pred->lastValue - pred->prevValue) *
+			elapsed) / interval);
+}
+
+/**
+ * Advance needle one frame towards the predicted value
+ *
+ * pred: Prediction stage
+ * now: Current time
+ * stale: True if value is stale (needle holds at last sample)
+ *
+ * Return: None
+ * */
+static void gauge_predict_frame(GaugePredict* pred, uint32_t now, bool stale) {
+	int32_t target = stale ? pred->lastValue : gauge_predict_value(pred, now);
+	int32_t min = (int32_t) gState.param->min * OBD_PID_FIXED_ONE;
+	int32_t max = (int32_t) gState.param->max * OBD_PID_FIXED_ONE;
+	int32_t step;
+
+	// clamp against running off the end of the gauge
+	if (target < min) {
+		target = min;
+	} else if (target > max) {
+		target = max;
+	}
+	step = (target - pred->shown) / GAUGE_PREDICT_SMOOTHING;
+	if (step == 0) {
+		pred->shown = target;
+	} else {
+		pred->shown += step;
+	}
+}
+
+/**
+ * Get update on the gauge parameter from the live data table and advance the
+ * needle one frame
+ *
+ * Return: 0 if gauge needs updating, 1 otherwise
+ * */
+int gauge_update_state(void) {
+	LiveValue live;
+	bool stale;
+	bool changed = false;
+	uint32_t now = dgas_live_now();
+	int paramVal;
+	int arcVal;
 
 	// get most recent voltage readings
 	gauge_get_supply_voltage(&(gState.vBat));
 
-	if (obd_take_semaphore() == pdTRUE) {
-		// got semaphore so send request and get response
+	if (!dgas_live_read(LIVE_CHANNEL_PID(gState.param->pid), &live)) {
+		// parameter hasn't been sampled yet
+		return 1;
+	}
+	stale = (live.timestamp == 0) || (now - live.timestamp > LIVE_STALE_AGE);
 
-		xQueueSend(queueOBDRequest, &req, 10);
-		while(xQueueReceive(queueOBDResponse, &resp, 10) != pdTRUE) {
-			vTaskDelay(10);
+	if ((live.seq != gState.liveSeq) || (stale != gState.stale)) {
+		gState.liveSeq = live.seq;
+		gState.stale = stale;
+		// update the status string based on sample
+		gauge_set_obd_status_string(gState.obdStat, live.status);
+		if ((live.timestamp != 0) && (live.timestamp != gState.predict.lastTime)) {
+			gauge_predict_sample(&gState.predict, live.value, live.timestamp);
 		}
-		obd_give_semaphore();
+		changed = true;
+	}
+	if (gState.predict.lastTime == 0) {
+		// no value to show yet
+		return changed ? 0 : 1;
+	}
+	gauge_predict_frame(&gState.predict, now, stale);
 
-		// update the status string based on response
-		gauge_set_obd_status_string(gState.obdStat, resp.status);
-		if (resp.status == OBD_OK) {
-			gState.paramVal = obd_pid_convert(pid, resp.data);
-		}
-		return 0;
+	paramVal = OBD_PID_FIXED_TO_INT(gState.predict.shown);
+	arcVal = (gState.predict.shown * UI_GAUGE_ARC_SCALE) / OBD_PID_FIXED_ONE;
+
+	if ((paramVal != gState.paramVal) || (arcVal != gState.arcVal)) {
+		gState.paramVal = paramVal;
+		gState.arcVal = arcVal;
+		changed = true;
 	}
-	return 1;
+	return changed ? 0 : 1;
 }
 
 /**
@@ -184,7 +294,7 @@ int gauge_update_state(OBDPid pid, uint32_t timeout) {
  * */
 void task_dgas_gauge(void) {
 	EventBits_t uxBits;
-	queueGaugeUpdate = xQueueCreate(1, sizeof(GaugeUpdate));
+
 	eventGaugeParam = xEventGroupCreate();
 	// small delay to wait to UI to settle on startup
 	vTaskDelay(100);
@@ -192,15 +302,16 @@ void task_dgas_gauge(void) {
 	vTaskDelay(1000);
 
 	for(;;) {
-		if (gauge_update_state(gState.param->pid, 100) == 0) {
-			// got successful PID value so update gauge
+		if (gauge_update_state() == 0) {
+			// needle moved, got new sample or sample has gone stale so update gauge
 			gauge_update();
 		}
-		if ((uxBits = xEventGroupWaitBits(eventGaugeParam, EVT_GAUGE_PARAM, pdTRUE, pdFALSE, 10))) {
+		// wait for parameter change, timeout sets gauge frame rate
+		if ((uxBits = xEventGroupWaitBits(eventGaugeParam, EVT_GAUGE_PARAM, pdTRUE, pdFALSE,
+				pdMS_TO_TICKS(GAUGE_FRAME_PERIOD)))) {
 			// change parameter event occured
 			gauge_param_change_handler(uxBits);
 		}
-		vTaskDelay(75);
 	}
 }
 
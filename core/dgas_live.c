@@ -0,0 +1,143 @@
+/*
+ * dgas_live.c
+ *
+ *  Created on: 18 Oct. 2026
+ *      Author: rhett
+ */
+
+// System wide live data table. Holds the latest value of every channel so any task
+// (gauge, debug etc.) can read it without going through the OBD controller or
+// taking a semaphore
+
+#include <dgas_live.h>
+#include <dgas_time.h>
+#include <string.h>
+
+// live data table
+static LiveSlot liveTable[LIVE_CHANNEL_COUNT];
+
+/**
+ * Get current time in the timebase used for live data timestamps
+ *
+ * Return: Current time (ms)
+ * */
+uint32_t dgas_live_now(void) {
+	return dgas_time_ms();
+}
+
+/**
+ * Publish a new value to a slot
+ *
+ * slot: Slot to write
+ * val: Value to publish
+ *
+ * Return: None
+ * */
+static void live_publish(LiveSlot* slot, LiveValue* val) {
+	uint32_t next = slot->seq + 1;
+
+	// fill copy readers aren't using then make it the latest
+	val->seq = next;
+	memcpy(&slot->copy[next & 1], val, sizeof(LiveValue));
+	__DMB();
+	slot->seq = next;
+}
+
+/**
+ * Write a new value to a live data channel. Each channel must only be written from
+ * a single task.
+ *
+ * ch: Channel to write
+ * value: New value
+ * status: Status of sample
+ * timestamp: Time value was sampled (ms)
+ *
+ * Return: None
+ * */
+void dgas_live_write(LiveChannel ch, int32_t value, OBDStatus status, uint32_t timestamp) {
+	LiveValue val = {.value = value, .status = status, .timestamp = timestamp};
+
+	if (ch >= LIVE_CHANNEL_COUNT) {
+		return;
+	}
+	live_publish(&liveTable[ch], &val);
+}
+
+/**
+ * Update the status of a live data channel without changing its value or timestamp
+ * (e.g. a poll failed). Value keeps aging so readers can see it is stale.
+ *
+ * ch: Channel to write
+ * status: New status
+ *
+ * Return: None
+ * */
+void dgas_live_write_status(LiveChannel ch, OBDStatus status) {
+	LiveSlot* slot;
+	LiveValue val;
+
+	if (ch >= LIVE_CHANNEL_COUNT) {
+		return;
+	}
+	slot = &liveTable[ch];
+	// only writer of slot so latest copy can't change under us
+	memcpy(&val, &slot->copy[slot->seq & 1], sizeof(LiveValue));
+	val.status = status;
+	live_publish(slot, &val);
+}
+
+/**
+ * Read latest value of a live data channel. Never blocks, if the writer publishes
+ * while reading the read is retried.
+ *
+ * ch: Channel to read
+ * dest: Destination to store value
+ *
+ * Return: True if channel has been written, false otherwise
+ * */
+bool dgas_live_read(LiveChannel ch, LiveValue* dest) {
+	LiveSlot* slot;
+	uint32_t seq;
+
+	if (ch >= LIVE_CHANNEL_COUNT) {
+		return false;
+	}
+	slot = &liveTable[ch];
+
+	do {
+		seq = slot->seq;
+		__DMB();
+		memcpy(dest, &slot->copy[seq & 1], sizeof(LiveValue));
+		__DMB();
+	} while (seq != slot->seq);
+
+	return seq != 0;
+}
+
+/**
+ * Get age of a live data channel's value
+ *
+ * ch: Channel to get age of
+ *
+ * Return: Time since value was sampled (ms), LIVE_AGE_NEVER if never written
+ * */
+uint32_t dgas_live_age(LiveChannel ch) {
+	LiveValue val;
+
+	if (!dgas_live_read(ch, &val) || (val.timestamp == 0)) {
+		return LIVE_AGE_NEVER;
+	}
+	return dgas_live_now() - val.timestamp;
+}
+
+/**
+ * Check if a live data channel's value is stale
+ *
+ * ch: Channel to check
+ * maxAge: Maximum age (ms) before value is stale
+ *
+ * Return: True if value is stale or has never been written, false otherwise
+ * */
+bool dgas_live_is_stale(LiveChannel ch, uint32_t maxAge) {
+	return dgas_live_age(ch) > maxAge;
+}
@@ -13,9 +13,15 @@
 #include <dgas_types.h>
 #include <dgas_sys.h>
 #include <dgas_obd.h>
+#include <dgas_vehicle.h>
+#include <dgas_live.h>
+#include <dgas_signal.h>
+#include <dgas_pid.h>
+#include <dgas_time.h>
 #include <kwp.h>
 #include <iso15765.h>
 #include <iso9141.h>
+#include <uds.h>
 #include <bus.h>
 #include <string.h>
 #include <stdbool.h>
@@ -24,14 +30,50 @@
 static TaskHandle_t handleBusControl;
 // stores currently active bus being used to make OBD requests
 static BusHandle bus;
-// semaphore for exclusion to access to OBD controller
-static SemaphoreHandle_t semaphoreOBD;
 // queue for making OBD requests
 QueueHandle_t queueOBDRequest;
-// queue for sending OBD responses
-QueueHandle_t queueOBDResponse;
+// ID of next OBD request
+static uint32_t nextRequestId = 1;
+// request to result latency of OBD requests
+static OBDLatencyStats latency;
+// requests waiting to be sent on bus, one entry per priority class
+static OBDPendingClass pending[OBD_PRIORITY_COUNT];
+// statistics of each priority class
+static OBDPriorityStats priorityStats[OBD_PRIORITY_COUNT];
+// most recently received data of each mode 01 PID
+static OBDCacheEntry pidCache[OBD_CACHE_PID_COUNT];
+// cache and request merging statistics
+static OBDCacheStats cacheStats;
 // event group to change OBD bus dynamically
 EventGroupHandle_t eventOBDChangeBus;
+// channels polled by acquisition scheduler
+static OBDChannel channels[OBD_SCHED_CHANNEL_MAX];
+// callbacks to publish scheduler samples to
+static OBDSampleCallback subscribers[OBD_SCHED_SUBSCRIBER_MAX];
+// true if ECU accepts batched (multi-PID) mode 01 requests
+static bool batchSupported;
+// number of consecutive batched requests rejected by ECU
+static uint32_t batchRejects;
+// true once connected vehicle has been discovered
+static bool vehicleDiscovered;
+// tick count at which vehicle discovery is next attempted
+static TickType_t vehicleDiscoverDue;
+// true once UDS support has been checked on current bus
+static bool udsChecked;
+// true if ECU answers UDS ReadDataByIdentifier for OBD PIDs (DID 0xF400 | PID)
+static bool udsSupported;
+// response ID of ECU UDS requests are sent to
+static uint32_t udsEcu;
+// true until ECU rejects dynamically defined record
+static bool recordSupported;
+// true until ECU fails to stream periodic identifiers
+static bool periodicSupported;
+// PIDs dynamically defined record is made of in record order, no record is defined if
+// recordCount is 0
+static OBDPid recordPids[UDS_DDDI_SOURCES_MAX];
+static uint32_t recordCount;
+// reply slots of polls in flight to each ECU at once, too large for task stack
+static BusResponse pipelineReplies[OBD_CAN_ECU_COUNT];
 
 /**
  * Get task handle of OBD controller task
@@ -43,109 +85,507 @@ TaskHandle_t task_dgas_obd_get_handle(void) {
 }
 
 /**
- * Take OBD semaphore
+ * Get the bus ID of the currently active OBD-II bus
+ *
+ * Return: Bus ID of the currently active OBD-II bus
+ * */
+BusID obd_get_active_bus(void) {
+	return bus.bid;
+}
+
+/**
+ * Get number of data bytes an ECU will respond with for a mode 01 PID
+ *
+ * pid: Mode 01 PID
+ *
+ * Return: Number of data bytes, 0 if unknown
+ * */
+uint8_t obd_pid_data_len(OBDPid pid) {
+	const OBDPidDesc* desc = obd_pid_desc(pid);
+
+	if (desc == NULL) {
+		return 0;
+	}
+	return desc->len;
+}
+
+/**
+ * Get number of header bytes repeated at the start of each message of a response
  *
- * Return: pdTRUE if taken, pdFALSE otherwise
+ * mode: Response mode byte (OBD mode + OBD_RESPONSE_MODE_OFFSET)
+ *
+ * Return: Number of header bytes
  * */
-BaseType_t obd_take_semaphore(void) {
-	if (semaphoreOBD != NULL) {
-		return xSemaphoreTake(semaphoreOBD, portMAX_DELAY);
+static uint32_t obd_response_header_len(uint8_t mode) {
+	switch (mode - OBD_RESPONSE_MODE_OFFSET) {
+		case OBD_MODE_VEHICLE_INFO:
+			return OBD_RESPONSE_HEADER_LEN_INFO;
+		case OBD_MODE_DTC:
+		case OBD_MODE_DTC_PENDING:
+		case OBD_MODE_DTC_PERMANENT:
+			return OBD_RESPONSE_HEADER_LEN_DTC;
+		default:
+			return OBD_RESPONSE_HEADER_LEN;
 	}
-	return pdFALSE;
 }
 
 /**
- * Give OBD semaphore
+ * Reduce a response gathered from several frames to a single message from the primary
+ * ECU, the positive responder with the lowest address (i.e. the engine ECU). Further
+ * frames from that ECU continue the message (e.g. mode 09 VIN, mode 03 DTC lists) so
+ * their repeated header bytes are dropped.
+ *
+ * resp: Response to reduce, data is rearranged in place
  *
  * Return: None
  * */
-void obd_give_semaphore(void) {
-	xSemaphoreGive(semaphoreOBD);
+static void obd_response_assemble(BusResponse* resp) {
+	BusFrame* f;
+	uint32_t primary = 0;
+	bool found = false;
+	bool positive = false;
+	uint32_t len = 0;
+	uint32_t skip;
+
+	if (resp->frameCount < 2) {
+		return;
+	}
+	for (uint32_t i = 0; i < resp->frameCount; i++) {
+		f = &resp->frames[i];
+		bool pos = (f->len != 0) && (resp->data[f->offset] != OBD_RESPONSE_NEGATIVE);
+
+		if (!found || (pos && !positive) || ((pos == positive) && (f->src < primary))) {
+			primary = f->src;
+			positive = pos;
+			found = true;
+		}
+	}
+	for (uint32_t i = 0; i < resp->frameCount; i++) {
+		f = &resp->frames[i];
+		if ((f->src != primary) || (f->len == 0)) {
+			continue;
+		}
+		skip = (len == 0) ? 0 : obd_response_header_len(resp->data[f->offset]);
+		if (skip > f->len) {
+			skip = f->len;
+		}
+		// data only ever moves towards the start so frames not yet visited are intact
+		memmove(resp->data + len, resp->data + f->offset + skip, f->len - skip);
+		len += f->len - skip;
+	}
+	resp->dataLen = len;
+	resp->frames[0].src = primary;
+	resp->frames[0].offset = 0;
+	resp->frames[0].len = len;
+	resp->frameCount = 1;
 }
 
 /**
- * Get the bus ID of the currently active OBD-II bus
+ * Make a transaction on the currently active bus. Where the bus driver allows it the
+ * transaction is made directly from the controller task rather than through the bus
+ * task's queues.
  *
- * Return: Bus ID of the currently active OBD-II bus
+ * req: Bus request to make
+ * resp: Bus response to store result
+ *
+ * Return: None
  * */
-BusID obd_get_active_bus(void) {
-	return bus.bid;
+static void obd_bus_transaction(BusRequest* req, BusResponse* resp) {
+	if (bus.transact != NULL) {
+		resp->status = bus.transact(req, resp);
+	} else {
+		xQueueSend(*(bus.outBound), req, portMAX_DELAY);
+		// we should get a response regardless since we set a timeout on the request
+		xQueueReceive(*(bus.inBound), resp, portMAX_DELAY);
+	}
+	if (resp->status == BUS_OK) {
+		obd_response_assemble(resp);
+	}
+}
+
+/**
+ * Get ECU a response came from
+ *
+ * resp: Assembled response
+ *
+ * Return: Response ID of ECU on CAN, 0 if unknown or not on CAN
+ * */
+static uint32_t obd_response_ecu(BusResponse* resp) {
+	if ((bus.bid != BUS_ID_CAN) || (resp->frameCount == 0)) {
+		return 0;
+	}
+	return resp->frames[0].src;
 }
 
 /**
- * Convert from the four raw OBD-II bytes (A, B, C, D) to the actual parameter
+ * Convert from the raw OBD-II bytes (A, B, C, D) to the actual parameter
  * value depending on PID.
  *
  * pid: PID to get value of
  * data: Raw OBD-II bytes from request for PID
  *
- * Return: Actual PID value
+ * Return: Actual PID value (whole units), 0 if PID has no numeric value
  * */
 int obd_pid_convert(OBDPid pid, uint8_t* data) {
-	uint8_t A = data[0];
-	uint8_t B = data[1];
-
-	if (pid == OBD_PID_LIVE_ENGINE_SPEED) {
-		return OBD_CONV_ENGINE_SPEED(A, B);
-	} else if (pid == OBD_PID_LIVE_COOLANT_TEMP) {
-		return OBD_CONV_COOLANT_TEMP(A);
-	} else if ((pid == OBD_PID_LIVE_LTFT_BANK_1) || (pid == OBD_PID_LIVE_LTFT_BANK_2) ||
-				(pid == OBD_PID_LIVE_STFT_BANK_1) || (pid == OBD_PID_LIVE_STFT_BANK_2)) {
-		return OBD_CONV_FUEL_TRIM(A);
-	} else if (pid == OBD_PID_LIVE_FUEL_PRESSURE) {
-		return OBD_CONV_FUEL_PRESSURE(A);
-	} else if (pid == OBD_PID_LIVE_ENGINE_LOAD) {
-		return OBD_CONV_ENGINE_LOAD(A);
-	} else if (pid == OBD_PID_LIVE_TIMING_ADVANCE) {
-		return OBD_CONV_TIMING_ADVANCE(A);
-	} else if (pid == OBD_PID_LIVE_INTAKE_AIR_TEMP) {
-		return OBD_CONV_INTAKE_AIR_TEMP(A);
-	} else if (pid == OBD_PID_LIVE_MAF_FLOW_RATE) {
-		return OBD_CONV_MAF(A, B);
-	} else if (pid == OBD_PID_LIVE_THROTTLE_POSITION) {
-		return OBD_CONV_THROTTLE_POSITION(A);
-	}
-	return 0;
+	int32_t value;
+
+	if (!obd_pid_convert_fixed(pid, data, &value)) {
+		return 0;
+	}
+	return OBD_PID_FIXED_TO_INT(value);
 }
 
 /**
- * Get a measurement parameter
+ * Get a measurement parameter and the ECU which answered
  *
  * pid: PID to get
  * mode: OBD mode to use (both live and vehicle info mode use PIDs)
  * dest: Destination array to store received data
  * timeout: Time to wait for response
+ * ecu: Destination to store response ID of ECU which answered (0 if unknown)
  *
  * Return: Number of data bytes received
  * */
-uint32_t dgas_obd_get_pid(OBDPid pid, OBDMode mode, uint8_t* dest, uint32_t timeout) {
+static uint32_t obd_get_pid(OBDPid pid, OBDMode mode, uint8_t* dest, uint32_t timeout, uint32_t* ecu) {
 	BusRequest req = {0};
 	BusResponse resp = {0};
 
+	*ecu = 0;
+	if (!dgas_vehicle_pid_supported(mode, pid)) {
+		// don't waste a timeout on a PID vehicle doesn't support
+		return 0;
+	}
 	req.data[0] = mode;
 	req.data[1] = pid;
 	req.dataLen = sizeof(uint8_t) + sizeof(uint8_t); // mode and pid are both size uint8_t
 	req.timeout = timeout;
 
-	// send request to bus
-	xQueueSend(*(bus.outBound), &req, 10);
-	// wait for response, we should get a response regardless
-	// since we set a timeout on the request
-	while(xQueueReceive(*(bus.inBound), &resp, 10) != pdTRUE) {
-		vTaskDelay(10);
-	}
+	obd_bus_transaction(&req, &resp);
 	uint32_t dataCount = OBD_RESPONSE_GET_NUMBER_OF_DATA_BYTES(resp.dataLen);
 	// we got response, as per OBD-II spec we should get data of form
 	// [OBD mode + 0x40, pid, A, B, C, D] where A, B, C, D are the pid
 	// data bytes
-	if (resp.status != BUS_OK) {
+	if ((resp.status != BUS_OK) || (resp.dataLen < OBD_RESPONSE_DATA_START_INDEX)) {
 		return 0;
 	} else {
+		if (dataCount > OBD_BUS_RESPONSE_MAX) {
+			// destination only holds a single OBD response
+			dataCount = OBD_BUS_RESPONSE_MAX;
+		}
 		memcpy(dest, resp.data + OBD_RESPONSE_DATA_START_INDEX, dataCount);
+		*ecu = obd_response_ecu(&resp);
 	}
 	return dataCount;
 }
 
+/**
+ * Get a measurement parameter
+ *
+ * pid: PID to get
+ * mode: OBD mode to use (both live and vehicle info mode use PIDs)
+ * dest: Destination array to store received data
+ * timeout: Time to wait for response
+ *
+ * Return: Number of data bytes received
+ * */
+uint32_t dgas_obd_get_pid(OBDPid pid, OBDMode mode, uint8_t* dest, uint32_t timeout) {
+	uint32_t ecu;
+
+	return obd_get_pid(pid, mode, dest, timeout, &ecu);
+}
+
+/**
+ * Store received mode 01 PID data in value cache
+ *
+ * pid: PID which was received
+ * data: Raw PID data bytes
+ * len: Number of data bytes
+ * tick: Tick count at which data was received
+ *
+ * Return: None
+ * */
+static void obd_cache_store(OBDPid pid, uint8_t* data, uint32_t len, TickType_t tick) {
+	OBDCacheEntry* entry = &pidCache[pid];
+
+	entry->dataLen = (len > OBD_PID_DATA_MAX) ? OBD_PID_DATA_MAX : len;
+	memcpy(entry->data, data, entry->dataLen);
+	entry->tick = tick;
+}
+
+/**
+ * Get mode 01 PID data from value cache if it is fresh enough
+ *
+ * pid: PID to get
+ * maxAge: Oldest (ticks) cached data may be
+ * resp: Response to store data in
+ *
+ * Return: True if cached data was used, false otherwise
+ * */
+static bool obd_cache_lookup(OBDPid pid, uint32_t maxAge, OBDResponse* resp) {
+	OBDCacheEntry* entry = &pidCache[pid];
+
+	if ((maxAge == 0) || (entry->dataLen == 0) ||
+			(xTaskGetTickCount() - entry->tick > maxAge)) {
+		return false;
+	}
+	memcpy(resp->data, entry->data, entry->dataLen);
+	resp->dataLen = entry->dataLen;
+	return true;
+}
+
+/**
+ * Clear value cache (e.g. when bus or vehicle changes)
+ *
+ * Return: None
+ * */
+static void obd_cache_clear(void) {
+	memset(pidCache, 0, sizeof(pidCache));
+}
+
+/**
+ * Check if batched mode 01 requests can be used on the active bus
+ *
+ * Return: True if batching can be used, false otherwise
+ * */
+static bool obd_batch_enabled(void) {
+	return (bus.bid == BUS_ID_CAN) && batchSupported;
+}
+
+/**
+ * Calculate size of an ECU's response to a batched mode 01 request
+ *
+ * pids: PIDs in batch
+ * count: Number of PIDs in batch
+ *
+ * Return: Response size in bytes, 0 if size can't be determined
+ * */
+static uint32_t obd_batch_response_len(OBDPid* pids, uint32_t count) {
+	// response starts with mode byte and each PID is echoed before its data
+	uint32_t len = sizeof(uint8_t);
+
+	for (uint32_t i = 0; i < count; i++) {
+		uint8_t dataLen = obd_pid_data_len(pids[i]);
+
+		if (dataLen == 0) {
+			return 0;
+		}
+		len += sizeof(OBDPid) + dataLen;
+	}
+	return len;
+}
+
+/**
+ * Split the data of a batched mode 01 response into per-PID samples. Response takes
+ * form [pid, A, B..., pid, A, B...] (mode byte already removed). ECU may respond with
+ * PIDs in any order and omits PIDs it doesn't support.
+ *
+ * data: Response data following mode byte
+ * len: Length of response data
+ * pids: PIDs which were requested
+ * count: Number of PIDs requested
+ * dest: Array of samples (one per requested PID) to populate
+ *
+ * Return: Number of PIDs extracted
+ * */
+static uint32_t obd_batch_split(uint8_t* data, uint32_t len, OBDPid* pids, uint32_t count, OBDSample* dest) {
+	uint32_t found = 0;
+	uint32_t i = 0;
+
+	while (i < len) {
+		OBDPid pid = data[i++];
+		uint8_t dataLen = obd_pid_data_len(pid);
+
+		if ((dataLen == 0) || (i + dataLen > len)) {
+			// malformed response, keep what has been extracted so far
+			break;
+		}
+		for (uint32_t j = 0; j < count; j++) {
+			if ((pids[j] == pid) && (dest[j].status != OBD_OK)) {
+				dest[j].dataLen = (dataLen > OBD_PID_DATA_MAX) ? OBD_PID_DATA_MAX : dataLen;
+				memcpy(dest[j].data, data + i, dest[j].dataLen);
+				obd_pid_convert_fixed(pid, data + i, &dest[j].value);
+				dest[j].status = OBD_OK;
+				found++;
+				break;
+			}
+		}
+		i += dataLen;
+	}
+	return found;
+}
+
+/**
+ * Check if UDS ReadDataByIdentifier can be used on the active bus
+ *
+ * Return: True if UDS can be used, false otherwise
+ * */
+static bool obd_uds_enabled(void) {
+	return (bus.bid == BUS_ID_CAN) && udsSupported;
+}
+
+/**
+ * Store raw PID data received for a sample, convert it and cache it
+ *
+ * sample: Sample to store data in (PID already set)
+ * data: Raw PID data bytes
+ * len: Number of data bytes
+ * tick: Tick count at which data was received
+ * time: Time data was received (us)
+ *
+ * Return: None
+ * */
+static void obd_sample_store(OBDSample* sample, uint8_t* data, uint32_t len, TickType_t tick, uint64_t time) {
+	sample->dataLen = (len > OBD_PID_DATA_MAX) ? OBD_PID_DATA_MAX : len;
+	memcpy(sample->data, data, sample->dataLen);
+	obd_pid_convert_fixed(sample->pid, data, &sample->value);
+	sample->status = OBD_OK;
+	sample->tick = tick;
+	sample->time = time;
+	obd_cache_store(sample->pid, data, len, tick);
+}
+
+/**
+ * Get several mode 01 PIDs as UDS data identifiers (0xF400 | PID) in a single
+ * ReadDataByIdentifier request
+ *
+ * pids: PIDs to get (at most OBD_BATCH_PID_MAX)
+ * count: Number of PIDs
+ * dest: Array of samples to store results in, each PID is stored in the sample with
+ * 		 the same PID
+ * destCount: Number of samples
+ * timeout: Time to wait for response
+ *
+ * Return: Number of PIDs received
+ * */
+static uint32_t obd_uds_get_pids(OBDPid* pids, uint32_t count, OBDSample* dest, uint32_t destCount,
+		uint32_t timeout) {
+	BusResponse resp = {0};
+	UDSDataId dids[OBD_BATCH_PID_MAX];
+	uint8_t* values[OBD_BATCH_PID_MAX];
+	TickType_t tick;
+	uint64_t time;
+	uint32_t found = 0;
+
+	for (uint32_t i = 0; i < count; i++) {
+		dids[i].did = UDS_DID_OBD_PID(pids[i]);
+		if ((dids[i].len = obd_pid_data_len(pids[i])) == 0) {
+			return 0;
+		}
+	}
+	if (uds_read_dids(udsEcu, dids, count, &resp, timeout) != BUS_OK) {
+		return 0;
+	}
+	if (uds_nrc(&resp) == UDS_NRC_SERVICE_NOT_SUPPORTED) {
+		udsSupported = false;
+		return 0;
+	}
+	uds_split_dids(&resp, dids, count, values);
+	tick = xTaskGetTickCount();
+	time = dgas_time_us();
+	for (uint32_t i = 0; i < destCount; i++) {
+		dest[i].tick = tick;
+		dest[i].time = time;
+		for (uint32_t j = 0; j < count; j++) {
+			if ((values[j] != NULL) && (pids[j] == dest[i].pid)) {
+				obd_sample_store(&dest[i], values[j], dids[j].len, tick, time);
+				found++;
+				break;
+			}
+		}
+	}
+	return found;
+}
+
+/**
+ * Get several mode 01 PIDs. When the ECU speaks UDS the PIDs are read as data
+ * identifiers in a single ReadDataByIdentifier request, otherwise on CAN the PIDs are
+ * packed into a single mode 01 request (up to OBD_BATCH_PID_MAX) and the multi-PID
+ * response is split back into per-PID samples. If the ECU rejects batched requests
+ * the PIDs are requested one at a time.
+ *
+ * pids: PIDs to get
+ * count: Number of PIDs
+ * dest: Array of samples (one per PID) to store results
+ * timeout: Time to wait for each response
+ *
+ * Return: Number of PIDs successfully received
+ * */
+uint32_t dgas_obd_get_pids(OBDPid* pids, uint32_t count, OBDSample* dest, uint32_t timeout) {
+	BusRequest req = {0};
+	BusResponse resp = {0};
+	uint8_t data[OBD_BUS_RESPONSE_MAX];
+	OBDPid supported[OBD_BATCH_PID_MAX];
+	uint32_t supportedCount = 0;
+	uint32_t found = 0;
+
+	for (uint32_t i = 0; i < count; i++) {
+		memset(&dest[i], 0, sizeof(OBDSample));
+		dest[i].pid = pids[i];
+		dest[i].status = OBD_ERROR;
+
+		if ((count <= OBD_BATCH_PID_MAX) && dgas_vehicle_pid_supported(OBD_MODE_LIVE, pids[i])) {
+			// only supported PIDs are included in batch
+			supported[supportedCount++] = pids[i];
+		}
+	}
+
+	if (obd_uds_enabled() && (supportedCount != 0) &&
+			((found = obd_uds_get_pids(supported, supportedCount, dest, count, timeout)) != 0)) {
+		return found;
+	}
+	if (obd_batch_enabled() && (supportedCount > 1)) {
+		uint32_t respLen = obd_batch_response_len(supported, supportedCount);
+
+		if ((respLen != 0) && (respLen <= OBD_BATCH_RESPONSE_MAX)) {
+			req.data[0] = OBD_MODE_LIVE;
+			memcpy(req.data + 1, supported, supportedCount);
+			req.dataLen = sizeof(uint8_t) + supportedCount;
+			req.timeout = timeout;
+
+			obd_bus_transaction(&req, &resp);
+
+			if ((resp.status == BUS_OK) && (resp.dataLen > 1) &&
+					(resp.data[0] == OBD_MODE_LIVE + OBD_RESPONSE_MODE_OFFSET)) {
+				found = obd_batch_split(resp.data + 1, resp.dataLen - 1, pids, count, dest);
+			}
+			if (found != 0) {
+				batchRejects = 0;
+				for (uint32_t i = 0; i < count; i++) {
+					dest[i].tick = xTaskGetTickCount();
+					dest[i].time = dgas_time_us();
+					if (dest[i].status == OBD_OK) {
+						dest[i].ecu = obd_response_ecu(&resp);
+						obd_cache_store(dest[i].pid, dest[i].data, dest[i].dataLen, dest[i].tick);
+					}
+				}
+				return found;
+			}
+		}
+	}
+	// batch not possible or rejected so make single requests
+	for (uint32_t i = 0; i < count; i++) {
+		uint32_t len = obd_get_pid(pids[i], OBD_MODE_LIVE, data, timeout, &dest[i].ecu);
+
+		dest[i].tick = xTaskGetTickCount();
+		dest[i].time = dgas_time_us();
+		if (len != 0) {
+			dest[i].dataLen = (len > OBD_PID_DATA_MAX) ? OBD_PID_DATA_MAX : len;
+			memcpy(dest[i].data, data, dest[i].dataLen);
+			obd_pid_convert_fixed(pids[i], data, &dest[i].value);
+			obd_cache_store(pids[i], data, len, dest[i].tick);
+			dest[i].status = OBD_OK;
+			found++;
+		}
+	}
+	if ((req.dataLen != 0) && (found != 0)) {
+		// batch failed but ECU answered single requests so batch was rejected
+		if (++batchRejects >= OBD_BATCH_REJECT_LIMIT) {
+			batchSupported = false;
+		}
+	}
+	return found;
+}
+
 /**
  * Get diagnostic trouble codes
  *
@@ -160,16 +600,15 @@ uint32_t dgas_obd_get_dtc(uint8_t* dest) {
 	req.data[0] = OBD_MODE_DTC;
 	req.dataLen = sizeof(uint8_t);
 
-	// send request to bus
-	xQueueSend(*(bus.outBound), &req, 10);
-	while(xQueueReceive(*(bus.inBound), &resp, 10) != pdTRUE) {
-		vTaskDelay(10);
-	}
+	obd_bus_transaction(&req, &resp);
 	uint32_t dataCount = OBD_RESPONSE_GET_NUMBER_OF_DATA_BYTES(resp.dataLen);
 
-	if (resp.status != BUS_OK) {
+	if ((resp.status != BUS_OK) || (resp.dataLen < OBD_RESPONSE_DATA_START_INDEX)) {
 		return 0;
 	} else {
+		if (dataCount > OBD_BUS_RESPONSE_MAX) {
+			dataCount = OBD_BUS_RESPONSE_MAX;
+		}
 		memcpy(dest, resp.data + OBD_RESPONSE_DATA_START_INDEX, dataCount);
 	}
 	return dataCount;
@@ -197,7 +636,25 @@ uint32_t dgas_obd_get_vehicle_info(OBDPid pid, uint8_t* dest) {
  * */
 OBDStatus dgas_obd_handle_request(OBDRequest* req, OBDResponse* resp) {
 	if (req->mode == OBD_MODE_LIVE) {
+		int32_t value;
+
+		if (obd_cache_lookup(req->pid, req->maxAge, resp)) {
+			// recent enough value has already been received, no need to use bus
+			cacheStats.hits++;
+			return OBD_OK;
+		}
+		cacheStats.misses++;
 		resp->dataLen = dgas_obd_get_pid(req->pid, OBD_MODE_LIVE, resp->data, req->timeout);
+
+		if (resp->dataLen != 0) {
+			obd_cache_store(req->pid, resp->data, resp->dataLen, xTaskGetTickCount());
+
+			// channels fed by broadcast signals or streamed by ECU are only written by CAN task
+			if (!dgas_signal_feeds(LIVE_CHANNEL_PID(req->pid)) && !uds_periodic_feeds(req->pid) &&
+					obd_pid_convert_fixed(req->pid, resp->data, &value)) {
+				dgas_live_write(LIVE_CHANNEL_PID(req->pid), value, OBD_OK, dgas_live_now());
+			}
+		}
 	} else if (req->mode == OBD_MODE_DTC) {
 		resp->dataLen = dgas_obd_get_dtc(resp->data);
 	} else if (req->mode == OBD_MODE_VEHICLE_INFO) {
@@ -210,81 +667,1255 @@ OBDStatus dgas_obd_handle_request(OBDRequest* req, OBDResponse* resp) {
 }
 
 /**
- * Handle a OBD bus change. Used to dynamically change which bus is used
- * to make OBD requests
+ * Make an asynchronous OBD request. Returns as soon as request is queued, the reply slot
+ * is marked complete and the caller notified (OBD_NOTIFY_INDEX) once the result is stored.
+ * Several requests may be outstanding at once, each with its own reply slot.
  *
- * uxBits: Event bits from eventOBDChangeBus
+ * req: Request to make (mode, pid and timeout must be set)
+ * reply: Reply slot to store result, must remain valid until request completes
  *
- * Return: Status indicating success or failure
+ * Return: Request ID, 0 if request couldn't be made
  * */
-OBDStatus dgas_obd_bus_change_handler(EventBits_t uxBits) {
-	if (uxBits & EVT_OBD_BUS_CHANGE_KWP) {
-		if (bus.bid == BUS_ID_KWP) {
-			// same bus as already being used so don't do anything
-			return OBD_OK;
+uint32_t dgas_obd_request_async(OBDRequest* req, OBDResponse* reply) {
+	if (queueOBDRequest == NULL) {
+		return 0;
+	}
+	taskENTER_CRITICAL();
+	req->id = nextRequestId++;
+	if (nextRequestId == 0) {
+		// 0 is reserved for failure
+		nextRequestId = 1;
+	}
+	taskEXIT_CRITICAL();
+
+	req->caller = xTaskGetCurrentTaskHandle();
+	req->reply = reply;
+	req->issued = xTaskGetTickCount();
+	if (reply != NULL) {
+		reply->complete = false;
+	}
+
+	if (req->priority >= OBD_PRIORITY_COUNT) {
+		req->priority = OBD_PRIORITY_BACKGROUND;
+	}
+
+	if (xQueueSend(queueOBDRequest, req, 0) != pdTRUE) {
+		return 0;
+	}
+	return req->id;
+}
+
+/**
+ * Wait for an asynchronous OBD request to complete. Notifications only wake the caller,
+ * the reply slot is checked after every wake since any outstanding request may have
+ * completed.
+ *
+ * reply: Reply slot given to dgas_obd_request_async
+ * timeout: Time to wait for completion
+ *
+ * Return: Status of request, OBD_TIMEOUT if request didn't complete in time
+ * */
+OBDStatus dgas_obd_request_wait(OBDResponse* reply, uint32_t timeout) {
+	TickType_t start = xTaskGetTickCount();
+	TickType_t elapsed;
+
+	while (!reply->complete) {
+		if (((elapsed = xTaskGetTickCount() - start) > timeout) ||
+				(ulTaskNotifyTakeIndexed(OBD_NOTIFY_INDEX, pdTRUE, timeout - elapsed) == 0)) {
+			if (!reply->complete) {
+				return OBD_TIMEOUT;
+			}
+			break;
 		}
-		// initialise bus and set in bound and out bound queues
-		task_init_kwp_bus();
-		bus.inBound = &queueKwpResponse;
-		bus.outBound = &queueKwpRequest;
-	} else if (uxBits & EVT_OBD_BUS_CHANGE_9141) {
-		return OBD_OK;
-	} else if (uxBits & EVT_OBD_BUS_CHANGE_CAN) {
-		return OBD_OK;
 	}
-	return OBD_OK;
+	__DMB();
+	return reply->status;
 }
 
 /**
- * Check if OBD-II bus is ready for communication
+ * Make an OBD request and block until it completes
  *
- * Return: True if bus is ready, false otherwise
+ * req: Request to make (mode, pid and timeout must be set)
+ * reply: Reply slot to store result
+ *
+ * Return: Status of request
  * */
-bool obd_bus_ready(void) {
-	if ((*(bus.inBound) == NULL) || (*(bus.outBound) == NULL)) {
-		return false;
+OBDStatus dgas_obd_request(OBDRequest* req, OBDResponse* reply) {
+	if (dgas_obd_request_async(req, reply) == 0) {
+		return OBD_ERROR;
 	}
-	return true;
+	// controller completes every request since bus requests have a timeout so reply
+	// slot can't be written after we return
+	return dgas_obd_request_wait(reply, portMAX_DELAY);
 }
 
 /**
- * Thread function for OBD controller task
+ * Complete a request, store result in caller's reply slot and notify caller
+ *
+ * req: Request which has been handled
+ * resp: Result of request
  *
  * Return: None
  * */
-void task_dgas_obd(void) {
-	// on init, bus controller will need to be told which bus to use
-	// by dgas_sys
-	OBDRequest obdReq = {0};
-	OBDResponse obdResp = {0};
-	EventBits_t uxBits;
-	// TODO: get dgas_sys to tell this OBD controller which bus to use
-	// based on config stored in flash. The task shouldn't start until it knows which
-	// bus to use. For now just default to KWP
-	task_init_kwp_bus();
+static void obd_request_complete(OBDRequest* req, OBDResponse* resp) {
+	uint32_t elapsed = xTaskGetTickCount() - req->issued;
 
-	bus.inBound = &queueKwpResponse;
-	bus.outBound = &queueKwpRequest;
-	bus.bid = BUS_ID_KWP;
+	resp->id = req->id;
+	if (req->reply != NULL) {
+		resp->complete = false;
+		memcpy(req->reply, resp, sizeof(OBDResponse));
+		// result must be visible before slot is marked complete
+		__DMB();
+		req->reply->complete = true;
+	}
+	latency.count++;
+	latency.total += elapsed;
+	latency.last = elapsed;
+	if (elapsed > latency.max) {
+		latency.max = elapsed;
+	}
+	if (req->caller != NULL) {
+		// only wakes caller, which checks its reply slot
+		xTaskNotifyGiveIndexed(req->caller, OBD_NOTIFY_INDEX);
+	}
+}
 
-	queueOBDResponse = xQueueCreate(TASK_BUS_CONTROL_QUEUE_LENGTH, sizeof(OBDResponse));
-	queueOBDRequest = xQueueCreate(TASK_BUS_CONTROL_QUEUE_LENGTH, sizeof(OBDRequest));
-	eventOBDChangeBus = xEventGroupCreate();
-	semaphoreOBD = xSemaphoreCreateBinary();
-	obd_give_semaphore();
+/**
+ * Complete a request without sending it on the bus
+ *
+ * req: Request to complete
+ * status: Status to complete request with
+ *
+ * Return: None
+ * */
+static void obd_request_reject(OBDRequest* req, OBDStatus status) {
+	OBDResponse resp = {0};
 
-	for(;;) {
-		if (xQueueReceive(queueOBDRequest, &obdReq, 10) == pdTRUE) {
-			if (!obd_bus_ready()) {
-				obdResp.status = OBD_INIT;
-			} else {
-				// keep track of the mode
-				obdResp.mode = obdReq.mode;
-				// got request from dgas_sys
-				obdResp.status = dgas_obd_handle_request(&obdReq, &obdResp);
+	resp.mode = req->mode;
+	resp.status = status;
+	obd_request_complete(req, &resp);
+}
+
+/**
+ * Add a request to the pending requests of its priority class
+ *
+ * req: Request to add
+ *
+ * Return: None
+ * */
+static void obd_pending_push(OBDRequest* req) {
+	OBDPendingClass* cls = &pending[req->priority];
+	OBDResponse resp = {0};
+
+	if ((req->mode == OBD_MODE_LIVE) && obd_cache_lookup(req->pid, req->maxAge, &resp)) {
+		// served from cache so doesn't need to wait for the bus
+		cacheStats.hits++;
+		resp.mode = req->mode;
+		resp.status = OBD_OK;
+		obd_request_complete(req, &resp);
+		return;
+	}
+	if (cls->count == OBD_PENDING_MAX) {
+		priorityStats[req->priority].overflow++;
+		obd_request_reject(req, OBD_ERROR);
+		return;
+	}
+	memcpy(&cls->req[cls->count++], req, sizeof(OBDRequest));
+}
+
+/**
+ * Remove a request from the pending requests of a class
+ *
+ * cls: Class to remove request from
+ * index: Index of request to remove
+ *
+ * Return: None
+ * */
+static void obd_pending_remove(OBDPendingClass* cls, uint32_t index) {
+	cls->count--;
+	memmove(&cls->req[index], &cls->req[index + 1], (cls->count - index) * sizeof(OBDRequest));
+}
+
+/**
+ * Move all requests waiting in intake queue into the pending requests
+ *
+ * wait: Time to wait for first request
+ *
+ * Return: None
+ * */
+static void obd_pending_intake(TickType_t wait) {
+	OBDRequest req;
+
+	while (xQueueReceive(queueOBDRequest, &req, wait) == pdTRUE) {
+		obd_pending_push(&req);
+		wait = 0;
+	}
+}
+
+/**
+ * Drop pending requests whose deadline has passed before they reach the bus
+ *
+ * now: Current tick count
+ *
+ * Return: None
+ * */
+static void obd_pending_drop_expired(TickType_t now) {
+	for (uint32_t p = 0; p < OBD_PRIORITY_COUNT; p++) {
+		OBDPendingClass* cls = &pending[p];
+
+		for (uint32_t i = 0; i < cls->count;) {
+			OBDRequest* req = &cls->req[i];
+
+			if ((req->maxWait != 0) && (now - req->issued > req->maxWait)) {
+				priorityStats[p].dropped++;
+				obd_request_reject(req, OBD_TIMEOUT);
+				obd_pending_remove(cls, i);
+			} else {
+				i++;
+			}
+		}
+	}
+}
+
+/**
+ * Check if there are any pending requests
+ *
+ * Return: True if there are pending requests, false otherwise
+ * */
+static bool obd_pending_any(void) {
+	for (uint32_t p = 0; p < OBD_PRIORITY_COUNT; p++) {
+		if (pending[p].count != 0) {
+			return true;
+		}
+	}
+	return false;
+}
+
+/**
+ * Pick priority class to serve next. A class which has been passed over
+ * OBD_STARVATION_LIMIT times is promoted ahead of every other class.
+ *
+ * promoted: Set to true if picked class was promoted due to starvation
+ *
+ * Return: Priority class to serve, OBD_PRIORITY_COUNT if nothing is pending
+ * */
+static OBDPriority obd_pending_pick(bool* promoted) {
+	*promoted = false;
+
+	for (uint32_t p = 0; p < OBD_PRIORITY_COUNT; p++) {
+		if ((pending[p].count != 0) && (pending[p].skipped >= OBD_STARVATION_LIMIT)) {
+			*promoted = true;
+			return p;
+		}
+	}
+	for (uint32_t p = 0; p < OBD_PRIORITY_COUNT; p++) {
+		if (pending[p].count != 0) {
+			return p;
+		}
+	}
+	return OBD_PRIORITY_COUNT;
+}
+
+/**
+ * Record that a class was served and every other class with pending requests
+ * was passed over
+ *
+ * served: Priority class which was served
+ *
+ * Return: None
+ * */
+static void obd_pending_served(OBDPriority served) {
+	for (uint32_t p = 0; p < OBD_PRIORITY_COUNT; p++) {
+		if (p == served) {
+			pending[p].skipped = 0;
+		} else if (pending[p].count != 0) {
+			pending[p].skipped++;
+			priorityStats[p].starved++;
+		}
+	}
+}
+
+/**
+ * Check if two requests can be served by the same bus transaction
+ *
+ * a: First request
+ * b: Second request
+ *
+ * Return: True if requests are identical reads, false otherwise
+ * */
+static bool obd_request_mergeable(OBDRequest* a, OBDRequest* b) {
+	if ((a->mode != b->mode) || (a->pid != b->pid)) {
+		return false;
+	}
+	return (a->mode == OBD_MODE_LIVE) || (a->mode == OBD_MODE_DTC) ||
+			(a->mode == OBD_MODE_VEHICLE_INFO);
+}
+
+/**
+ * Complete every pending request identical to one which has just been served
+ * with its result
+ *
+ * req: Request which was served
+ * resp: Result of served request
+ *
+ * Return: None
+ * */
+static void obd_pending_merge(OBDRequest* req, OBDResponse* resp) {
+	OBDResponse merged;
+
+	for (uint32_t p = 0; p < OBD_PRIORITY_COUNT; p++) {
+		OBDPendingClass* cls = &pending[p];
+
+		for (uint32_t i = 0; i < cls->count;) {
+			if (obd_request_mergeable(req, &cls->req[i])) {
+				memcpy(&merged, resp, sizeof(OBDResponse));
+				cacheStats.merged++;
+				priorityStats[p].served++;
+				obd_request_complete(&cls->req[i], &merged);
+				obd_pending_remove(cls, i);
+			} else {
+				i++;
+			}
+		}
+	}
+}
+
+/**
+ * Send oldest pending request of a class on the bus and complete it along with any
+ * identical pending requests
+ *
+ * p: Priority class to serve
+ *
+ * Return: None
+ * */
+static void obd_pending_serve(OBDPriority p) {
+	OBDRequest req;
+	OBDResponse resp = {0};
+	uint32_t waited;
+
+	memcpy(&req, &pending[p].req[0], sizeof(OBDRequest));
+	obd_pending_remove(&pending[p], 0);
+	obd_pending_served(p);
+
+	waited = xTaskGetTickCount() - req.issued;
+	priorityStats[p].served++;
+	if (waited > priorityStats[p].maxWait) {
+		priorityStats[p].maxWait = waited;
+	}
+	// keep track of the mode
+	resp.mode = req.mode;
+	resp.status = dgas_obd_handle_request(&req, &resp);
+	obd_pending_merge(&req, &resp);
+	// hand result straight back to the task which made request
+	obd_request_complete(&req, &resp);
+}
+
+/**
+ * Get statistics of mode 01 value cache and request merging
+ *
+ * dest: Destination to store statistics
+ *
+ * Return: None
+ * */
+void dgas_obd_get_cache_stats(OBDCacheStats* dest) {
+	taskENTER_CRITICAL();
+	memcpy(dest, &cacheStats, sizeof(OBDCacheStats));
+	taskEXIT_CRITICAL();
+}
+
+/**
+ * Get statistics of each request priority class
+ *
+ * dest: Array of OBD_PRIORITY_COUNT entries to store statistics
+ *
+ * Return: None
+ * */
+void dgas_obd_get_priority_stats(OBDPriorityStats* dest) {
+	taskENTER_CRITICAL();
+	memcpy(dest, priorityStats, sizeof(priorityStats));
+	taskEXIT_CRITICAL();
+}
+
+/**
+ * Get request to result latency statistics of OBD requests
+ *
+ * dest: Destination to store statistics
+ *
+ * Return: None
+ * */
+void dgas_obd_get_latency(OBDLatencyStats* dest) {
+	taskENTER_CRITICAL();
+	memcpy(dest, &latency, sizeof(OBDLatencyStats));
+	taskEXIT_CRITICAL();
+}
+
+/**
+ * Find the scheduler channel polling a given PID
+ *
+ * pid: PID to find
+ *
+ * Return: Pointer to channel, NULL if PID is not being polled
+ * */
+static OBDChannel* obd_sched_find(OBDPid pid) {
+	for (uint32_t i = 0; i < OBD_SCHED_CHANNEL_MAX; i++) {
+		if ((channels[i].refs != 0) && (channels[i].pid == pid)) {
+			return &channels[i];
+		}
+	}
+	return NULL;
+}
+
+/**
+ * Add a PID to the acquisition scheduler. If the PID is already being polled the
+ * faster of the two rates is kept.
+ *
+ * pid: Mode 01 PID to poll
+ * rate: Target poll rate in mHz (e.g. 20000 for 20Hz, 500 for 0.5Hz)
+ *
+ * Return: Status indicating success or failure
+ * */
+OBDStatus dgas_obd_sched_add(OBDPid pid, uint32_t rate) {
+	OBDChannel* chan;
+
+	if (rate == 0) {
+		return OBD_ERROR;
+	}
+	taskENTER_CRITICAL();
+	if ((chan = obd_sched_find(pid)) != NULL) {
+		chan->refs++;
+		if (rate > chan->rate) {
+			chan->rate = rate;
+			chan->period = OBD_SCHED_RATE_TO_PERIOD(rate);
+			chan->adaptPeriod = chan->period;
+			chan->still = 0;
+		}
+		taskEXIT_CRITICAL();
+		return OBD_OK;
+	}
+	for (uint32_t i = 0; i < OBD_SCHED_CHANNEL_MAX; i++) {
+		if (channels[i].refs == 0) {
+			memset(&channels[i], 0, sizeof(OBDChannel));
+			channels[i].pid = pid;
+			channels[i].rate = rate;
+			channels[i].period = OBD_SCHED_RATE_TO_PERIOD(rate);
+			channels[i].adaptPeriod = channels[i].period;
+			channels[i].added = xTaskGetTickCount();
+			channels[i].nextDue = channels[i].added;
+			channels[i].refs = 1;
+			taskEXIT_CRITICAL();
+			return OBD_OK;
+		}
+	}
+	taskEXIT_CRITICAL();
+	// no free channels
+	return OBD_ERROR;
+}
+
+/**
+ * Remove a PID from the acquisition scheduler. The channel is only freed once every
+ * consumer which added it has removed it.
+ *
+ * pid: PID to stop polling
+ *
+ * Return: Status indicating success or failure
+ * */
+OBDStatus dgas_obd_sched_remove(OBDPid pid) {
+	OBDChannel* chan;
+
+	taskENTER_CRITICAL();
+	if ((chan = obd_sched_find(pid)) == NULL) {
+		taskEXIT_CRITICAL();
+		return OBD_ERROR;
+	}
+	chan->refs--;
+	taskEXIT_CRITICAL();
+	return OBD_OK;
+}
+
+/**
+ * Subscribe to samples published by the acquisition scheduler. Callbacks are called
+ * from the OBD controller task so should not block.
+ *
+ * cb: Callback to call with each sample
+ *
+ * Return: Status indicating success or failure
+ * */
+OBDStatus dgas_obd_sched_subscribe(OBDSampleCallback cb) {
+	for (uint32_t i = 0; i < OBD_SCHED_SUBSCRIBER_MAX; i++) {
+		if (subscribers[i] == NULL) {
+			subscribers[i] = cb;
+			return OBD_OK;
+		}
+	}
+	return OBD_ERROR;
+}
+
+/**
+ * Get report of requested and achieved poll rates of each scheduled channel
+ *
+ * dest: Destination array of reports
+ * max: Maximum number of reports to store
+ *
+ * Return: Number of reports stored
+ * */
+uint32_t dgas_obd_sched_report(OBDChannelReport* dest, uint32_t max) {
+	uint32_t count = 0;
+	TickType_t now = xTaskGetTickCount();
+
+	for (uint32_t i = 0; (i < OBD_SCHED_CHANNEL_MAX) && (count < max); i++) {
+		if (channels[i].refs == 0) {
+			continue;
+		}
+		uint32_t elapsed = (now - channels[i].added) * portTICK_PERIOD_MS;
+
+		dest[count].pid = channels[i].pid;
+		dest[count].requested = channels[i].rate;
+		dest[count].adapted = OBD_SCHED_PERIOD_TO_RATE(channels[i].adaptPeriod);
+		dest[count].samples = channels[i].samples;
+		dest[count].errors = channels[i].errors;
+		// rate in mHz is samples per 1000 seconds
+		dest[count].achieved = (elapsed == 0) ? 0 :
+				(uint32_t) (((uint64_t) channels[i].samples * 1000000) / elapsed);
+		count++;
+	}
+	return count;
+}
+
+/**
+ * Publish a sample to all scheduler subscribers
+ *
+ * sample: Sample to publish
+ *
+ * Return: None
+ * */
+static void obd_sched_publish(OBDSample* sample) {
+	for (uint32_t i = 0; i < OBD_SCHED_SUBSCRIBER_MAX; i++) {
+		if (subscribers[i] != NULL) {
+			subscribers[i](sample);
+		}
+	}
+}
+
+/**
+ * Check if a scheduler channel is in use and its PID has to be read from vehicle. PIDs
+ * the vehicle doesn't support and channels fed by a decoded broadcast signal aren't read.
+ *
+ * chan: Channel to check
+ *
+ * Return: True if channel's PID has to be read, false otherwise
+ * */
+static bool obd_sched_wanted(OBDChannel* chan) {
+	return (chan->refs != 0) && dgas_vehicle_pid_supported(OBD_MODE_LIVE, chan->pid) &&
+			!dgas_signal_feeds(LIVE_CHANNEL_PID(chan->pid));
+}
+
+/**
+ * Check if a scheduler channel should be polled. Channels the ECU streams as a UDS
+ * periodic identifier aren't polled.
+ *
+ * chan: Channel to check
+ *
+ * Return: True if channel should be polled, false otherwise
+ * */
+static bool obd_sched_active(OBDChannel* chan) {
+	return obd_sched_wanted(chan) && !uds_periodic_feeds(chan->pid);
+}
+
+/**
+ * Check if channel has already been picked for current batch
+ *
+ * chan: Channel to check
+ * batch: Channels picked so far
+ * count: Number of channels picked so far
+ *
+ * Return: True if channel is in batch, false otherwise
+ * */
+static bool obd_sched_in_batch(OBDChannel* chan, OBDChannel** batch, uint32_t count) {
+	for (uint32_t i = 0; i < count; i++) {
+		if (batch[i] == chan) {
+			return true;
+		}
+	}
+	return false;
+}
+
+/**
+ * Pick the next channel to poll. Channels which are due are served earliest deadline
+ * first (deadline being the end of the channel's current period) so that when the bus
+ * is saturated fast channels are not starved by slow ones and the bus is never left
+ * idle while a channel is due. Once a batch has been started, channels which are within
+ * half a period of being due may also join it since they cost no extra round trip.
+ *
+ * now: Current tick count
+ * batch: Channels already picked for this transaction
+ * count: Number of channels already picked
+ *
+ * Return: Channel to poll, NULL if no channel is due
+ * */
+static OBDChannel* obd_sched_next(TickType_t now, OBDChannel** batch, uint32_t count) {
+	OBDChannel* next = NULL;
+	TickType_t nextDeadline = 0;
+
+	for (uint32_t i = 0; i < OBD_SCHED_CHANNEL_MAX; i++) {
+		OBDChannel* chan = &channels[i];
+		TickType_t early = (count == 0) ? 0 : (chan->adaptPeriod / 2);
+
+		if (!obd_sched_active(chan) || ((int32_t) (now + early - chan->nextDue) < 0)) {
+			// unused, unsupported or not yet due
+			continue;
+		}
+		if (obd_sched_in_batch(chan, batch, count)) {
+			continue;
+		}
+		TickType_t deadline = chan->nextDue + chan->adaptPeriod;
+
+		if ((next == NULL) || ((int32_t) (deadline - nextDeadline) < 0)) {
+			next = chan;
+			nextDeadline = deadline;
+		}
+	}
+	return next;
+}
+
+/**
+ * Collect channels to poll in next transaction. When batching is available as many
+ * channels as fit in a single batched response are collected.
+ *
+ * now: Current tick count
+ * batch: Array to store picked channels
+ * pids: Array to store PIDs of picked channels
+ *
+ * Return: Number of channels picked
+ * */
+static uint32_t obd_sched_collect(TickType_t now, OBDChannel** batch, OBDPid* pids) {
+	uint32_t max = (obd_batch_enabled() || obd_uds_enabled()) ? OBD_BATCH_PID_MAX : 1;
+	uint32_t count = 0;
+	OBDChannel* chan;
+
+	while ((count < max) && ((chan = obd_sched_next(now, batch, count)) != NULL)) {
+		pids[count] = chan->pid;
+
+		if ((count != 0) && ((obd_batch_response_len(pids, count + 1) == 0) ||
+				(obd_batch_response_len(pids, count + 1) > OBD_BATCH_RESPONSE_MAX))) {
+			// no room left in response
+			break;
+		}
+		batch[count++] = chan;
+	}
+	return count;
+}
+
+/**
+ * Get number of ticks until the next scheduler channel is due
+ *
+ * Return: Ticks until next channel is due (capped at OBD_SCHED_IDLE_WAIT)
+ * */
+static TickType_t obd_sched_ticks_to_next(void) {
+	TickType_t now = xTaskGetTickCount();
+	TickType_t wait = OBD_SCHED_IDLE_WAIT;
+
+	for (uint32_t i = 0; i < OBD_SCHED_CHANNEL_MAX; i++) {
+		if (!obd_sched_active(&channels[i])) {
+			continue;
+		}
+		int32_t until = (int32_t) (channels[i].nextDue - now);
+
+		if (until <= 0) {
+			return 0;
+		}
+		if ((TickType_t) until < wait) {
+			wait = until;
+		}
+	}
+	return wait;
+}
+
+/**
+ * Check if there is enough bus bandwidth freed by backed off channels to boost a
+ * channel to a faster poll period
+ *
+ * chan: Channel to boost
+ * boosted: Period channel would be boosted to
+ *
+ * Return: True if channel can be boosted, false otherwise
+ * */
+static bool obd_sched_can_boost(OBDChannel* chan, TickType_t boosted) {
+	int32_t spare = 0;
+
+	// bandwidth is in polls per 1000 seconds (mHz)
+	for (uint32_t i = 0; i < OBD_SCHED_CHANNEL_MAX; i++) {
+		if (!obd_sched_active(&channels[i])) {
+			continue;
+		}
+		spare += (int32_t) OBD_SCHED_PERIOD_TO_RATE(channels[i].period) -
+				(int32_t) OBD_SCHED_PERIOD_TO_RATE(channels[i].adaptPeriod);
+	}
+	spare -= (int32_t) OBD_SCHED_PERIOD_TO_RATE(boosted) -
+			(int32_t) OBD_SCHED_PERIOD_TO_RATE(chan->adaptPeriod);
+	return spare >= 0;
+}
+
+/**
+ * Adapt a channel's poll period to how fast its value is changing. Channels which
+ * haven't moved by their resolution back off, channels which move snap back to their
+ * requested period and, if backed off channels have freed enough bandwidth, are
+ * boosted beyond it.
+ *
+ * chan: Channel to adapt
+ * value: Value of new sample
+ *
+ * Return: True if channel snapped back from a backed off period, false otherwise
+ * */
+static bool obd_sched_adapt(OBDChannel* chan, int32_t value) {
+	int32_t delta = value - chan->lastValue;
+	bool first = chan->samples == 1;
+
+	chan->lastValue = value;
+	if (first) {
+		return false;
+	}
+	if (delta < 0) {
+		delta = -delta;
+	}
+
+	if (delta < obd_pid_resolution(chan->pid)) {
+		chan->moving = 0;
+		if (++chan->still >= OBD_SCHED_STILL_SAMPLES) {
+			chan->still = 0;
+			if (chan->adaptPeriod < chan->period) {
+				chan->adaptPeriod = chan->period;
+			} else if (chan->adaptPeriod < chan->period * OBD_SCHED_BACKOFF_MAX) {
+				chan->adaptPeriod *= 2;
+			}
+		}
+		return false;
+	}
+	chan->still = 0;
+	chan->moving++;
+
+	if (chan->adaptPeriod > chan->period) {
+		// value moved so snap back to requested rate
+		chan->adaptPeriod = chan->period;
+		return true;
+	} else if (chan->moving >= OBD_SCHED_MOVING_SAMPLES) {
+		TickType_t boosted = chan->period / OBD_SCHED_BOOST_MAX;
+
+		if ((boosted != 0) && (boosted < chan->adaptPeriod) && obd_sched_can_boost(chan, boosted)) {
+			chan->adaptPeriod = boosted;
+		}
+	}
+	return false;
+}
+
+/**
+ * Update channel after it has been polled and publish the sample
+ *
+ * chan: Channel which was polled
+ * sample: Result of poll
+ *
+ * Return: None
+ * */
+static void obd_sched_complete(OBDChannel* chan, OBDSample* sample) {
+	bool snapped = false;
+
+	if (sample->status == OBD_OK) {
+		chan->samples++;
+		chan->ecu = sample->ecu;
+		snapped = obd_sched_adapt(chan, sample->value);
+		dgas_live_write(LIVE_CHANNEL_PID(sample->pid), sample->value, OBD_OK,
+				(uint32_t) (sample->time / DGAS_TIME_US_PER_MS));
+	} else {
+		chan->errors++;
+		// ECU may have changed, next functional poll finds it again
+		chan->ecu = 0;
+		// keep last good value in live data table, it will age
+		dgas_live_write_status(LIVE_CHANNEL_PID(sample->pid), sample->status);
+	}
+	// schedule next poll, if we have fallen behind don't try to catch up with a burst
+	// of polls, just poll again as soon as possible
+	if (snapped) {
+		// value just started moving, don't wait out the rest of a backed off period
+		chan->nextDue = sample->tick + chan->adaptPeriod;
+	} else {
+		chan->nextDue += chan->adaptPeriod;
+	}
+	if ((int32_t) (chan->nextDue - sample->tick) < 0) {
+		chan->nextDue = sample->tick;
+	}
+	obd_sched_publish(sample);
+}
+
+/**
+ * Get time to wait for each scheduler poll. On KWP this follows P2max so a poll the
+ * ECU doesn't answer isn't waited on for longer than the ECU is allowed to take.
+ *
+ * Return: Response timeout (ms)
+ * */
+static uint32_t obd_sched_timeout(void) {
+	if (bus.bid == BUS_ID_KWP) {
+		return kwp_bus_response_timeout();
+	}
+	return OBD_SCHED_TIMEOUT;
+}
+
+/**
+ * Dynamically define the UDS record so it holds every channel being polled. Record is
+ * only defined again when the set of polled channels changes.
+ *
+ * timeout: Time to wait for each response
+ *
+ * Return: True if record holds every polled channel, false if it can't be used
+ * */
+static bool obd_uds_record_sync(uint32_t timeout) {
+	BusResponse resp = {0};
+	OBDPid pids[UDS_DDDI_SOURCES_MAX];
+	UDSDataId sources[UDS_DDDI_SOURCES_MAX];
+	uint32_t count = 0;
+
+	for (uint32_t i = 0; i < OBD_SCHED_CHANNEL_MAX; i++) {
+		if (!obd_sched_active(&channels[i])) {
+			continue;
+		}
+		if (count == UDS_DDDI_SOURCES_MAX) {
+			// more channels than a record can be defined from
+			return false;
+		}
+		sources[count].did = UDS_DID_OBD_PID(channels[i].pid);
+		if ((sources[count].len = obd_pid_data_len(channels[i].pid)) == 0) {
+			return false;
+		}
+		pids[count++] = channels[i].pid;
+	}
+	if ((count == recordCount) && (memcmp(pids, recordPids, count * sizeof(OBDPid)) == 0)) {
+		return count != 0;
+	}
+	recordCount = 0;
+	if (count == 0) {
+		return false;
+	}
+	if ((uds_define_record(udsEcu, UDS_DID_RECORD, sources, count, &resp, timeout) != BUS_OK) ||
+			(uds_nrc(&resp) != UDS_NRC_NONE)) {
+		// poll channels with multi-DID reads instead
+		recordSupported = false;
+		return false;
+	}
+	memcpy(recordPids, pids, count * sizeof(OBDPid));
+	recordCount = count;
+	return true;
+}
+
+/**
+ * Poll every channel at once by reading the UDS record. Due channels are completed, the
+ * rest have their live data refreshed without changing their schedule.
+ *
+ * Return: True if record was read, false if channels have to be polled individually
+ * */
+static bool obd_uds_sched_run(void) {
+	BusResponse resp = {0};
+	UDSDataId record = {.did = UDS_DID_RECORD, .len = 0};
+	OBDSample sample;
+	OBDChannel* chan;
+	uint8_t* data;
+	uint32_t timeout = obd_sched_timeout();
+	uint32_t len;
+
+	if (!obd_uds_enabled() || !recordSupported || !obd_uds_record_sync(timeout)) {
+		return false;
+	}
+	for (uint32_t i = 0; i < recordCount; i++) {
+		record.len += obd_pid_data_len(recordPids[i]);
+	}
+	if (uds_read_dids(udsEcu, &record, 1, &resp, timeout) != BUS_OK) {
+		return false;
+	}
+	if (uds_split_dids(&resp, &record, 1, &data) != 1) {
+		// ECU may have lost definition (e.g. it was reset), define it again next time
+		recordCount = 0;
+		return false;
+	}
+	// record is the data of each PID back to back in the order it was defined
+	for (uint32_t i = 0; i < recordCount; i++) {
+		memset(&sample, 0, sizeof(OBDSample));
+		sample.pid = recordPids[i];
+		len = obd_pid_data_len(sample.pid);
+		obd_sample_store(&sample, data, len, xTaskGetTickCount(), dgas_time_us());
+		data += len;
+
+		chan = obd_sched_find(sample.pid);
+		if ((chan != NULL) && ((int32_t) (sample.tick - chan->nextDue) >= 0)) {
+			obd_sched_complete(chan, &sample);
+		} else {
+			dgas_live_write(LIVE_CHANNEL_PID(sample.pid), sample.value, OBD_OK,
+					(uint32_t) (sample.time / DGAS_TIME_US_PER_MS));
+		}
+	}
+	return true;
+}
+
+/**
+ * Poll due channels of several ECUs at once on CAN. Due channels are grouped by the ECU
+ * which answers their PID and each group is sent to its ECU's physical request ID, so a
+ * request is in flight to every ECU at the same time, then the replies are collected.
+ * Channels whose ECU isn't known yet are left to a functional poll, which finds it.
+ *
+ * Return: True if channels were polled, false if the most urgent channel has to be
+ * 		   polled functionally
+ * */
+static bool obd_sched_run_pipelined(void) {
+	OBDChannel* picked[OBD_SCHED_CHANNEL_MAX];
+	OBDChannel* groups[OBD_CAN_ECU_COUNT][OBD_BATCH_PID_MAX];
+	OBDPid pids[OBD_CAN_ECU_COUNT][OBD_BATCH_PID_MAX];
+	uint32_t counts[OBD_CAN_ECU_COUNT] = {0};
+	OBDSample samples[OBD_BATCH_PID_MAX];
+	uint32_t max = obd_batch_enabled() ? OBD_BATCH_PID_MAX : 1;
+	TickType_t now = xTaskGetTickCount();
+	BusRequest req = {0};
+	BusResponse* reply;
+	OBDChannel* chan;
+	uint32_t pickedCount = 0;
+	uint32_t g;
+
+	if ((bus.bid != BUS_ID_CAN) || obd_uds_enabled()) {
+		// UDS reads all go to UDS ECU
+		return false;
+	}
+	while ((pickedCount < OBD_SCHED_CHANNEL_MAX) &&
+			((chan = obd_sched_next(now, picked, pickedCount)) != NULL)) {
+		picked[pickedCount++] = chan;
+		if (chan->ecu == 0) {
+			if (pickedCount == 1) {
+				return false;
+			}
+			// polled once it is most urgent
+			continue;
+		}
+		g = OBD_CAN_ECU_INDEX(chan->ecu);
+		if (counts[g] == max) {
+			continue;
+		}
+		pids[g][counts[g]] = chan->pid;
+		if ((counts[g] != 0) && ((obd_batch_response_len(pids[g], counts[g] + 1) == 0) ||
+				(obd_batch_response_len(pids[g], counts[g] + 1) > OBD_BATCH_RESPONSE_MAX))) {
+			// no room left in ECU's response
+			continue;
+		}
+		groups[g][counts[g]++] = chan;
+	}
+	if (pickedCount == 0) {
+		return false;
+	}
+	req.data[0] = OBD_MODE_LIVE;
+	req.timeout = obd_sched_timeout();
+	for (g = 0; g < OBD_CAN_ECU_COUNT; g++) {
+		if (counts[g] == 0) {
+			continue;
+		}
+		memcpy(req.data + 1, pids[g], counts[g]);
+		req.dataLen = sizeof(uint8_t) + counts[g];
+		if (obd_can_submit(OBD_CAN_ECU_ID(g), &req, &pipelineReplies[g]) != BUS_OK) {
+			pipelineReplies[g].status = BUS_TX_ERROR;
+		}
+	}
+	for (g = 0; g < OBD_CAN_ECU_COUNT; g++) {
+		if (counts[g] == 0) {
+			continue;
+		}
+		reply = &pipelineReplies[g];
+		for (uint32_t i = 0; i < counts[g]; i++) {
+			memset(&samples[i], 0, sizeof(OBDSample));
+			samples[i].pid = pids[g][i];
+			samples[i].status = OBD_ERROR;
+		}
+		// response takes same form whether one or several PIDs were requested
+		if ((obd_can_wait(reply) == BUS_OK) && (reply->dataLen > 1) &&
+				(reply->data[0] == OBD_MODE_LIVE + OBD_RESPONSE_MODE_OFFSET)) {
+			obd_batch_split(reply->data + 1, reply->dataLen - 1, pids[g], counts[g], samples);
+		}
+		for (uint32_t i = 0; i < counts[g]; i++) {
+			samples[i].tick = xTaskGetTickCount();
+			samples[i].time = dgas_time_us();
+			if (samples[i].status == OBD_OK) {
+				samples[i].ecu = OBD_CAN_ECU_ID(g);
+				obd_cache_store(samples[i].pid, samples[i].data, samples[i].dataLen, samples[i].tick);
+			}
+			obd_sched_complete(groups[g][i], &samples[i]);
+		}
+	}
+	return true;
+}
+
+/**
+ * Run one step of the acquisition scheduler. Polls the most urgent due channels (if any)
+ * and publishes the results. Where the ECU supports a UDS record every channel is read
+ * in a single request instead, and on CAN channels of different ECUs are polled at once.
+ *
+ * Return: None
+ * */
+static void obd_sched_run(void) {
+	OBDChannel* batch[OBD_BATCH_PID_MAX];
+	OBDPid pids[OBD_BATCH_PID_MAX];
+	OBDSample samples[OBD_BATCH_PID_MAX];
+	uint32_t count;
+
+	if (obd_uds_sched_run() || obd_sched_run_pipelined()) {
+		return;
+	}
+	if ((count = obd_sched_collect(xTaskGetTickCount(), batch, pids)) == 0) {
+		return;
+	}
+	dgas_obd_get_pids(pids, count, samples, obd_sched_timeout());
+
+	for (uint32_t i = 0; i < count; i++) {
+		obd_sched_complete(batch[i], &samples[i]);
+	}
+}
+
+/**
+ * Make the next bus transaction. Interactive requests are served first, then due
+ * scheduler channels (which feed the display), then the remaining classes in order
+ * of priority unless a class has been starved.
+ *
+ * Return: None
+ * */
+static void obd_dispatch(void) {
+	bool promoted;
+	OBDPriority p;
+
+	obd_pending_drop_expired(xTaskGetTickCount());
+	p = obd_pending_pick(&promoted);
+
+	if (!promoted && (p != OBD_PRIORITY_INTERACTIVE) && (obd_sched_ticks_to_next() == 0)) {
+		// scheduler polls count as interactive traffic
+		obd_pending_served(OBD_PRIORITY_INTERACTIVE);
+		obd_sched_run();
+	} else if (p != OBD_PRIORITY_COUNT) {
+		obd_pending_serve(p);
+	}
+}
+
+/**
+ * Discover connected vehicle if it hasn't been already. Retried periodically
+ * until the ECU responds.
+ *
+ * Return: None
+ * */
+static void obd_vehicle_discover(void) {
+	TickType_t now = xTaskGetTickCount();
+	CANConfig config;
+
+	if (vehicleDiscovered && (bus.bid == BUS_ID_CAN) && obd_can_take_detected_config(&config)) {
+		// CAN task (re)detected bus, cache it here so only this task writes profiles
+		dgas_vehicle_save_can_config(&config);
+	}
+	if (vehicleDiscovered || ((int32_t) (now - vehicleDiscoverDue) < 0)) {
+		return;
+	}
+	if (dgas_vehicle_discover(VEHICLE_DISCOVER_TIMEOUT) == DGAS_STATUS_OK) {
+		vehicleDiscovered = true;
+	} else {
+		vehicleDiscoverDue = xTaskGetTickCount() + pdMS_TO_TICKS(VEHICLE_DISCOVER_RETRY);
+	}
+}
+
+/**
+ * Check if ECU answers UDS requests once vehicle has been discovered on CAN. Supported
+ * PIDs 0x01 - 0x20 are read from all ECUs as DID 0xF400, the ECU which answers is sent
+ * UDS requests from then on.
+ *
+ * Return: None
+ * */
+static void obd_uds_check(void) {
+	BusResponse resp = {0};
+	UDSDataId did = {.did = UDS_DID_OBD_PID(OBD_PID_LIVE_SUPPORTED_PID), .len = VEHICLE_PID_BITMAP_LEN};
+	uint8_t* data;
+
+	if (udsChecked || !vehicleDiscovered || (bus.bid != BUS_ID_CAN)) {
+		return;
+	}
+	udsChecked = true;
+	if ((uds_read_dids(OBD_CAN_ID_REQUEST, &did, 1, &resp, VEHICLE_DISCOVER_TIMEOUT) == BUS_OK) &&
+			(uds_split_dids(&resp, &did, 1, &data) == 1)) {
+		udsSupported = true;
+		recordSupported = true;
+		periodicSupported = true;
+		recordCount = 0;
+		udsEcu = resp.frames[0].src;
+	}
+}
+
+/**
+ * Have ECU stream the fastest channels as UDS periodic identifiers instead of polling
+ * them. Channels are grouped by the transmission mode their requested rate calls for and
+ * packed into identifiers of up to UDS_PERIODIC_DATA_MAX bytes. Stream is restarted when
+ * the set of channels changes (e.g. on screen change) and kept alive otherwise. If ECU
+ * stops streaming the stream is stopped and channels are polled.
+ *
+ * Return: None
+ * */
+static void obd_uds_periodic_sync(void) {
+	const uint32_t rates[] = {OBD_UDS_PERIODIC_FAST, OBD_UDS_PERIODIC_MEDIUM, OBD_UDS_PERIODIC_SLOW};
+	const uint8_t modes[] = {UDS_PERIODIC_FAST, UDS_PERIODIC_MEDIUM, UDS_PERIODIC_SLOW};
+	UDSPeriodic ids[UDS_PERIODIC_ID_COUNT];
+	UDSPeriodic* id = NULL;
+	OBDChannel* chan;
+	uint32_t count = 0;
+	uint32_t used = 0;
+	uint8_t len;
+
+	if (!obd_uds_enabled() || !periodicSupported) {
+		return;
+	}
+	memset(ids, 0, sizeof(ids));
+	for (uint32_t m = 0; m < sizeof(modes); m++) {
+		for (uint32_t i = 0; i < OBD_SCHED_CHANNEL_MAX; i++) {
+			chan = &channels[i];
+			if (!obd_sched_wanted(chan) || (chan->rate < rates[m]) ||
+					((m != 0) && (chan->rate >= rates[m - 1])) ||
+					((len = obd_pid_data_len(chan->pid)) == 0) || (len > UDS_PERIODIC_DATA_MAX)) {
+				// PIDs too long for a periodic frame are polled
+				continue;
+			}
+			if ((id == NULL) || (id->mode != modes[m]) || (used + len > UDS_PERIODIC_DATA_MAX)) {
+				if (count == UDS_PERIODIC_ID_COUNT) {
+					// no identifiers left, rest are polled
+					break;
+				}
+				id = &ids[count];
+				id->id = UDS_PERIODIC_ID_FIRST + count;
+				id->mode = modes[m];
+				count++;
+				used = 0;
+			}
+			id->pids[id->count++] = chan->pid;
+			used += len;
+		}
+	}
+	if (uds_periodic_matches(ids, count)) {
+		if (!uds_periodic_keep_alive(OBD_SCHED_TIMEOUT)) {
+			// ECU stopped streaming, poll channels instead
+			uds_periodic_stop(OBD_SCHED_TIMEOUT);
+			recordCount = 0;
+			periodicSupported = false;
+		}
+		return;
+	}
+	// stopping and starting change session which clears dynamically defined records
+	recordCount = 0;
+	if (count == 0) {
+		uds_periodic_stop(OBD_SCHED_TIMEOUT);
+	} else if (!uds_periodic_start(udsEcu, ids, count, OBD_SCHED_TIMEOUT)) {
+		// poll channels instead
+		periodicSupported = false;
+	}
+}
+
+/**
+ * Handle a OBD bus change. Used to dynamically change which bus is used
+ * to make OBD requests
+ *
+ * uxBits: Event bits from eventOBDChangeBus
+ *
+ * Return: Status indicating success or failure
+ * */
+OBDStatus dgas_obd_bus_change_handler(EventBits_t uxBits) {
+	if (((uxBits & EVT_OBD_BUS_CHANGE_KWP) && (bus.bid != BUS_ID_KWP)) ||
+			((uxBits & EVT_OBD_BUS_CHANGE_CAN) && (bus.bid != BUS_ID_CAN))) {
+		if (bus.bid == BUS_ID_CAN) {
+			// stop ECU streaming while CAN is still the active bus
+			uds_periodic_stop(OBD_SCHED_TIMEOUT);
+		} else if (bus.bid == BUS_ID_KWP) {
+			// stop keeping KWP session alive while it isn't in use
+			kwp_bus_suspend();
+		}
+		// may be a different vehicle on new bus so rediscover it
+		dgas_vehicle_clear_active();
+		obd_cache_clear();
+		vehicleDiscovered = false;
+		vehicleDiscoverDue = xTaskGetTickCount();
+		udsChecked = false;
+		udsSupported = false;
+	}
+	if (uxBits & EVT_OBD_BUS_CHANGE_KWP) {
+		if (bus.bid == BUS_ID_KWP) {
+			// same bus as already being used so don't do anything
+			return OBD_OK;
+		}
+		// initialise (or resume) bus and set in bound and out bound queues
+		task_init_kwp_bus();
+		bus.inBound = &queueKwpResponse;
+		bus.outBound = &queueKwpRequest;
+		bus.transact = &kwp_bus_handle_request;
+		bus.bid = BUS_ID_KWP;
+	} else if (uxBits & EVT_OBD_BUS_CHANGE_9141) {
+		return OBD_OK;
+	} else if (uxBits & EVT_OBD_BUS_CHANGE_CAN) {
+		if (bus.bid == BUS_ID_CAN) {
+			return OBD_OK;
+		}
+		task_init_obd_can();
+		bus.inBound = &queueCANResponse;
+		bus.outBound = &queueCANRequest;
+		bus.transact = &obd_can_make_request;
+		bus.bid = BUS_ID_CAN;
+		// assume new ECU supports batching until it rejects a batch
+		batchSupported = true;
+		batchRejects = 0;
+	}
+	return OBD_OK;
+}
+
+/**
+ * Check if OBD-II bus is ready for communication
+ *
+ * Return: True if bus is ready, false otherwise
+ * */
+bool obd_bus_ready(void) {
+	if ((*(bus.inBound) == NULL) || (*(bus.outBound) == NULL)) {
+		return false;
+	}
+	return true;
+}
+
+/**
+ * Thread function for OBD controller task
+ *
+ * Return: None
+ * */
+void task_dgas_obd(void) {
+	// on init, bus controller will need to be told which bus to use
+	// by dgas_sys
+	EventBits_t uxBits;
+	// TODO: get dgas_sys to tell this OBD controller which bus to use
+	// based on config stored in flash. The task shouldn't start until it knows which
+	// bus to use. For now just default to KWP
+	task_init_kwp_bus();
+
+	bus.inBound = &queueKwpResponse;
+	bus.outBound = &queueKwpRequest;
+	bus.transact = &kwp_bus_handle_request;
+	bus.bid = BUS_ID_KWP;
+
+	queueOBDRequest = xQueueCreate(OBD_INTAKE_QUEUE_LENGTH, sizeof(OBDRequest));
+	eventOBDChangeBus = xEventGroupCreate();
+
+	for(;;) {
+		// block on requests until next scheduler channel is due, don't block if
+		// requests are already waiting
+		obd_pending_intake(obd_pending_any() ? 0 : obd_sched_ticks_to_next());
+
+		if (obd_bus_ready()) {
+			obd_vehicle_discover();
+			obd_uds_check();
+			obd_uds_periodic_sync();
+			obd_dispatch();
+		} else {
+			// bus isn't up yet so fail pending requests
+			for (uint32_t p = 0; p < OBD_PRIORITY_COUNT; p++) {
+				while (pending[p].count != 0) {
+					obd_request_reject(&pending[p].req[0], OBD_INIT);
+					obd_pending_remove(&pending[p], 0);
+				}
 			}
-			// send the response to dgas_sys
-			xQueueSend(queueOBDResponse, &obdResp, 10);
 		}
 		if ((uxBits = xEventGroupWaitBits(eventOBDChangeBus,
 				EVT_OBD_BUS_CHANGE, pdTRUE, pdFALSE, 0))) {
@@ -293,7 +1924,6 @@ void task_dgas_obd(void) {
 				// let dgas_sys know about failure
 			}
 		}
-		vTaskDelay(10);
 	}
 }
 
@@ -0,0 +1,276 @@
+/*
+ * dgas_pid.c
+ *
+ *  Created on: 18 Oct. 2026
+ *      Author: rhett
+ */
+
+// Descriptors of SAE J1979 mode 01 PIDs and the fixed point conversion engine.
+// Conversions are integer only so no double precision emulation is needed
+
+#include <dgas_pid.h>
+
+// descriptor helpers, numeric PID, numeric PID with raw value after a support bitmap and
+// bitfield PID
+#define PID(len, rawLen, flags, mul, div, offset, units)	{len, rawLen, flags, mul, div, offset, units}
+#define PID_AT(start, len, rawLen, flags, mul, div, offset, units)	\
+															{len, rawLen, flags, mul, div, offset, units, start}
+#define PID_BITS(len)										{len, 0, OBD_PID_FLAG_BITFIELD, 0, 1, 0, ""}
+
+// commonly used scales (milli-units per raw count)
+// A * 100 / 255 (percent)
+#define PID_PERCENT			PID(1, 1, 0, 20000, 51, 0, "%")
+// A - 40 (degrees C)
+#define PID_TEMP			PID(1, 1, 0, 1000, 1, -40000, "C")
+// A * 100 / 128 - 100 (percent fuel trim)
+#define PID_TRIM			PID(1, 1, 0, 3125, 4, -100000, "%")
+// 256A + B * 2 / 65536 (equivalence ratio)
+#define PID_LAMBDA			PID(4, 2, 0, 125, 4096, 0, "")
+// A * 1 (plain count/unit)
+#define PID_UNIT(u)			PID(1, 1, 0, 1000, 1, 0, u)
+// 256A + B (plain count/unit)
+#define PID_UNIT16(u)		PID(2, 2, 0, 1000, 1, 0, u)
+
+// mode 01 PID descriptor table, indexed by PID
+static const OBDPidDesc pidDesc[OBD_PID_DESC_COUNT] = {
+	[0x00] = PID_BITS(4),								// supported PIDs 0x01 - 0x20
+	[0x01] = PID_BITS(4),								// monitor status since DTCs cleared
+	[0x02] = PID_BITS(2),								// DTC that caused freeze frame
+	[0x03] = PID_BITS(2),								// fuel system status
+	[0x04] = PID_PERCENT,								// calculated engine load
+	[0x05] = PID_TEMP,									// coolant temperature
+	[0x06] = PID_TRIM,									// short term fuel trim bank 1
+	[0x07] = PID_TRIM,									// long term fuel trim bank 1
+	[0x08] = PID_TRIM,									// short term fuel trim bank 2
+	[0x09] = PID_TRIM,									// long term fuel trim bank 2
+	[0x0A] = PID(1, 1, 0, 3000, 1, 0, "kPa"),			// fuel pressure
+	[0x0B] = PID_UNIT("kPa"),							// intake manifold absolute pressure
+	[0x0C] = PID(2, 2, 0, 250, 1, 0, "rpm"),			// engine speed
+	[0x0D] = PID_UNIT("km/h"),							// vehicle speed
+	[0x0E] = PID(1, 1, 0, 500, 1, -64000, "deg"),		// timing advance
+	[0x0F] = PID_TEMP,									// intake air temperature
+	[0x10] = PID(2, 2, 0, 10, 1, 0, "g/s"),				// MAF air flow rate
+	[0x11] = PID_PERCENT,								// throttle position
+	[0x12] = PID_BITS(1),								// commanded secondary air status
+	[0x13] = PID_BITS(1),								// oxygen sensors present (2 banks)
+	[0x14] = PID(2, 1, 0, 5, 1, 0, "V"),				// oxygen sensor 1 voltage
+	[0x15] = PID(2, 1, 0, 5, 1, 0, "V"),				// oxygen sensor 2 voltage
+	[0x16] = PID(2, 1, 0, 5, 1, 0, "V"),				// oxygen sensor 3 voltage
+	[0x17] = PID(2, 1, 0, 5, 1, 0, "V"),				// oxygen sensor 4 voltage
+	[0x18] = PID(2, 1, 0, 5, 1, 0, "V"),				// oxygen sensor 5 voltage
+	[0x19] = PID(2, 1, 0, 5, 1, 0, "V"),				// oxygen sensor 6 voltage
+	[0x1A] = PID(2, 1, 0, 5, 1, 0, "V"),				// oxygen sensor 7 voltage
+	[0x1B] = PID(2, 1, 0, 5, 1, 0, "V"),				// oxygen sensor 8 voltage
+	[0x1C] = PID_BITS(1),								// OBD standards vehicle conforms to
+	[0x1D] = PID_BITS(1),								// oxygen sensors present (4 banks)
+	[0x1E] = PID_BITS(1),								// auxiliary input status
+	[0x1F] = PID_UNIT16("s"),							// run time since engine start
+	[0x20] = PID_BITS(4),								// supported PIDs 0x21 - 0x40
+	[0x21] = PID_UNIT16("km"),							// distance travelled with MIL on
+	[0x22] = PID(2, 2, 0, 79, 1, 0, "kPa"),				// fuel rail pressure (relative to vacuum)
+	[0x23] = PID(2, 2, 0, 10000, 1, 0, "kPa"),			// fuel rail gauge pressure
+	[0x24] = PID_LAMBDA,								// oxygen sensor 1 equivalence ratio
+	[0x25] = PID_LAMBDA,								// oxygen sensor 2 equivalence ratio
+	[0x26] = PID_LAMBDA,								// oxygen sensor 3 equivalence ratio
+	[0x27] = PID_LAMBDA,								// oxygen sensor 4 equivalence ratio
+	[0x28] = PID_LAMBDA,								// oxygen sensor 5 equivalence ratio
+	[0x29] = PID_LAMBDA,								// oxygen sensor 6 equivalence ratio
+	[0x2A] = PID_LAMBDA,								// oxygen sensor 7 equivalence ratio
+	[0x2B] = PID_LAMBDA,								// oxygen sensor 8 equivalence ratio
+	[0x2C] = PID_PERCENT,								// commanded EGR
+	[0x2D] = PID_TRIM,									// EGR error
+	[0x2E] = PID_PERCENT,								// commanded evaporative purge
+	[0x2F] = PID_PERCENT,								// fuel tank level input
+	[0x30] = PID_UNIT(""),								// warm-ups since codes cleared
+	[0x31] = PID_UNIT16("km"),							// distance travelled since codes cleared
+	[0x32] = PID(2, 2, OBD_PID_FLAG_SIGNED, 250, 1, 0, "Pa"),	// evap system vapour pressure
+	[0x33] = PID_UNIT("kPa"),							// absolute barometric pressure
+	[0x34] = PID_LAMBDA,								// oxygen sensor 1 equivalence ratio (current)
+	[0x35] = PID_LAMBDA,								// oxygen sensor 2 equivalence ratio (current)
+	[0x36] = PID_LAMBDA,								// oxygen sensor 3 equivalence ratio (current)
+	[0x37] = PID_LAMBDA,								// oxygen sensor 4 equivalence ratio (current)
+	[0x38] = PID_LAMBDA,								// oxygen sensor 5 equivalence ratio (current)
+	[0x39] = PID_LAMBDA,								// oxygen sensor 6 equivalence ratio (current)
+	[0x3A] = PID_LAMBDA,								// oxygen sensor 7 equivalence ratio (current)
+	[0x3B] = PID_LAMBDA,								// oxygen sensor 8 equivalence ratio (current)
+	[0x3C] = PID(2, 2, 0, 100, 1, -40000, "C"),			// catalyst temperature bank 1 sensor 1
+	[0x3D] = PID(2, 2, 0, 100, 1, -40000, "C"),			// catalyst temperature bank 2 sensor 1
+	[0x3E] = PID(2, 2, 0, 100, 1, -40000, "C"),			// catalyst temperature bank 1 sensor 2
+	[0x3F] = PID(2, 2, 0, 100, 1, -40000, "C"),			// catalyst temperature bank 2 sensor 2
+	[0x40] = PID_BITS(4),								// supported PIDs 0x41 - 0x60
+	[0x41] = PID_BITS(4),								// monitor status this drive cycle
+	[0x42] = PID(2, 2, 0, 1, 1, 0, "V"),				// control module voltage
+	[0x43] = PID(2, 2, 0, 20000, 51, 0, "%"),			// absolute load value
+	[0x44] = PID(2, 2, 0, 125, 4096, 0, ""),			// commanded air-fuel equivalence ratio
+	[0x45] = PID_PERCENT,								// relative throttle position
+	[0x46] = PID_TEMP,									// ambient air temperature
+	[0x47] = PID_PERCENT,								// absolute throttle position B
+	[0x48] = PID_PERCENT,								// absolute throttle position C
+	[0x49] = PID_PERCENT,								// accelerator pedal position D
+	[0x4A] = PID_PERCENT,								// accelerator pedal position E
+	[0x4B] = PID_PERCENT,								// accelerator pedal position F
+	[0x4C] = PID_PERCENT,								// commanded throttle actuator
+	[0x4D] = PID_UNIT16("min"),							// time run with MIL on
+	[0x4E] = PID_UNIT16("min"),							// time since codes cleared
+	[0x4F] = PID_BITS(4),								// maximum values for ratio, voltage, current, MAP
+	[0x50] = PID(4, 1, 0, 10000, 1, 0, "g/s"),			// maximum MAF air flow rate
+	[0x51] = PID_BITS(1),								// fuel type
+	[0x52] = PID_PERCENT,								// ethanol fuel percentage
+	[0x53] = PID(2, 2, 0, 5, 1, 0, "kPa"),				// absolute evap system vapour pressure
+	[0x54] = PID(2, 2, OBD_PID_FLAG_SIGNED, 1000, 1, 0, "Pa"),	// evap system vapour pressure
+	[0x55] = PID(2, 1, 0, 3125, 4, -100000, "%"),		// short term secondary O2 trim bank 1/3
+	[0x56] = PID(2, 1, 0, 3125, 4, -100000, "%"),		// long term secondary O2 trim bank 1/3
+	[0x57] = PID(2, 1, 0, 3125, 4, -100000, "%"),		// short term secondary O2 trim bank 2/4
+	[0x58] = PID(2, 1, 0, 3125, 4, -100000, "%"),		// long term secondary O2 trim bank 2/4
+	[0x59] = PID(2, 2, 0, 10000, 1, 0, "kPa"),			// fuel rail absolute pressure
+	[0x5A] = PID_PERCENT,								// relative accelerator pedal position
+	[0x5B] = PID_PERCENT,								// hybrid battery pack remaining life
+	[0x5C] = PID_TEMP,									// engine oil temperature
+	[0x5D] = PID(2, 2, 0, 125, 16, -210000, "deg"),		// fuel injection timing
+	[0x5E] = PID(2, 2, 0, 50, 1, 0, "L/h"),				// engine fuel rate
+	[0x5F] = PID_BITS(1),								// emission requirements
+	[0x60] = PID_BITS(4),								// supported PIDs 0x61 - 0x80
+	[0x61] = PID(1, 1, 0, 1000, 1, -125000, "%"),		// driver's demand engine torque
+	[0x62] = PID(1, 1, 0, 1000, 1, -125000, "%"),		// actual engine torque
+	[0x63] = PID_UNIT16("Nm"),							// engine reference torque
+	[0x64] = PID(5, 1, 0, 1000, 1, -125000, "%"),		// engine percent torque data (idle)
+	[0x65] = PID_BITS(2),								// auxiliary inputs/outputs supported
+	[0x66] = PID_AT(1, 5, 2, 0, 125, 4, 0, "g/s"),		// MAF sensor A
+	[0x67] = PID_AT(1, 3, 1, 0, 1000, 1, -40000, "C"),	// coolant temperature sensor 1
+	[0x68] = PID_AT(1, 7, 1, 0, 1000, 1, -40000, "C"),	// intake air temperature bank 1 sensor 1
+	[0x69] = PID_AT(1, 7, 1, 0, 20000, 51, 0, "%"),	// commanded EGR A duty cycle
+	[0x6A] = PID_AT(1, 5, 1, 0, 20000, 51, 0, "%"),	// commanded diesel intake air flow A
+	[0x6B] = PID_AT(1, 5, 1, 0, 1000, 1, -40000, "C"),	// EGR temperature bank 1 sensor 1
+	[0x6C] = PID_AT(1, 5, 1, 0, 20000, 51, 0, "%"),	// commanded throttle actuator A
+	[0x6D] = PID_BITS(11),								// fuel pressure control system
+	[0x6E] = PID_BITS(9),								// injection pressure control system
+	[0x6F] = PID_AT(1, 3, 1, 0, 1000, 1, 0, "kPa"),	// turbocharger A compressor inlet pressure
+	[0x70] = PID_BITS(10),								// boost pressure control
+	[0x71] = PID_BITS(6),								// variable geometry turbo control
+	[0x72] = PID_BITS(5),								// wastegate control
+	[0x73] = PID_AT(1, 5, 2, 0, 10, 1, 0, "kPa"),		// exhaust pressure bank 1
+	[0x74] = PID_AT(1, 5, 2, 0, 10000, 1, 0, "rpm"),	// turbocharger A speed
+	[0x75] = PID_BITS(7),								// turbocharger A temperatures
+	[0x76] = PID_BITS(7),								// turbocharger B temperatures
+	[0x77] = PID_AT(1, 5, 1, 0, 1000, 1, -40000, "C"),	// charge air cooler temperature bank 1
+	[0x78] = PID_AT(1, 9, 2, 0, 100, 1, -40000, "C"),	// exhaust gas temperature bank 1 sensor 1
+	[0x79] = PID_AT(1, 9, 2, 0, 100, 1, -40000, "C"),	// exhaust gas temperature bank 2 sensor 1
+	[0x7A] = PID_AT(1, 7, 2, OBD_PID_FLAG_SIGNED, 10, 1, 0, "kPa"),	// DPF bank 1 delta pressure
+	[0x7B] = PID_AT(1, 7, 2, OBD_PID_FLAG_SIGNED, 10, 1, 0, "kPa"),	// DPF bank 2 delta pressure
+	[0x7C] = PID_AT(1, 9, 2, 0, 100, 1, -40000, "C"),	// DPF bank 1 inlet temperature
+	[0x7D] = PID_BITS(1),								// NOx NTE control area status
+	[0x7E] = PID_BITS(1),								// PM NTE control area status
+	[0x7F] = PID_BITS(13),								// engine run time (exceeds milli-unit range)
+	[0x80] = PID_BITS(4),								// supported PIDs 0x81 - 0xA0
+	[0x81] = PID_BITS(41),								// run time for AECD #1 - #5
+	[0x82] = PID_BITS(41),								// run time for AECD #6 - #10
+	[0x83] = PID_AT(1, 9, 2, 0, 1000, 1, 0, "ppm"),	// NOx sensor bank 1 sensor 1
+	[0x84] = PID_TEMP,									// manifold surface temperature
+	[0x85] = PID_BITS(10),								// NOx reagent system
+	[0x86] = PID_BITS(5),								// particulate matter sensor
+	[0x87] = PID_AT(1, 5, 2, 0, 125, 4, 0, "kPa"),		// intake manifold absolute pressure A
+	[0x88] = PID_BITS(13),								// SCR inducement system
+	[0x89] = PID_BITS(41),								// run time for AECD #11 - #15
+	[0x8A] = PID_BITS(41),								// run time for AECD #16 - #20
+	[0x8B] = PID_BITS(7),								// diesel aftertreatment status
+	[0x8C] = PID_BITS(17),								// wide range oxygen sensors
+	[0x8D] = PID_PERCENT,								// throttle position G
+	[0x8E] = PID(1, 1, 0, 1000, 1, -125000, "%"),		// engine friction percent torque
+	[0x8F] = PID_BITS(7),								// particulate matter sensor bank 1 & 2
+	[0x90] = PID_BITS(3),								// WWH-OBD vehicle OBD system information
+	[0x91] = PID_BITS(5),								// WWH-OBD ECU OBD system information
+	[0x92] = PID_BITS(2),								// fuel system control
+	[0x93] = PID_BITS(3),								// WWH-OBD counters support
+	[0x94] = PID_BITS(12),								// NOx warning and inducement system
+	[0x98] = PID_AT(1, 9, 2, 0, 100, 1, -40000, "C"),	// exhaust gas temperature bank 1 sensor 5
+	[0x99] = PID_AT(1, 9, 2, 0, 100, 1, -40000, "C"),	// exhaust gas temperature bank 2 sensor 5
+	[0x9A] = PID_AT(1, 6, 2, 0, 125, 8, 0, "V"),		// hybrid/EV battery voltage
+	[0x9B] = PID_BITS(4),								// diesel exhaust fluid sensor data
+	[0x9C] = PID_BITS(17),								// oxygen sensor data
+	[0x9D] = PID(4, 2, 0, 20, 1, 0, "g/s"),				// engine fuel rate
+	[0x9E] = PID(2, 2, 0, 200, 1, 0, "kg/h"),			// engine exhaust flow rate
+	[0x9F] = PID_BITS(9),								// fuel system percentage use
+	[0xA0] = PID_BITS(4),								// supported PIDs 0xA1 - 0xC0
+	[0xA1] = PID_AT(1, 9, 2, 0, 1000, 1, 0, "ppm"),	// NOx sensor corrected bank 1 sensor 1
+	[0xA2] = PID(2, 2, 0, 125, 4, 0, "mg"),				// cylinder fuel rate (per stroke)
+	[0xA3] = PID_BITS(9),								// evap system vapour pressure
+	[0xA4] = PID_AT(2, 4, 2, 0, 1, 1, 0, ""),			// transmission actual gear ratio
+	[0xA5] = PID_AT(1, 4, 1, 0, 500, 1, 0, "%"),		// commanded DEF dosing
+	[0xA6] = PID(4, 4, 0, 100, 1, 0, "km"),				// odometer
+	[0xA7] = PID_BITS(4),								// NOx sensor concentration sensors 3 and 4
+	[0xA8] = PID_BITS(4),								// NOx corrected concentration sensors 3 and 4
+	[0xA9] = PID_BITS(4),								// ABS disable switch state
+	[0xC0] = PID_BITS(4),								// supported PIDs 0xC1 - 0xE0
+};
+
+/**
+ * Get descriptor of a mode 01 PID
+ *
+ * pid: PID to get descriptor of
+ *
+ * Return: Pointer to descriptor, NULL if PID isn't known
+ * */
+const OBDPidDesc* obd_pid_desc(uint8_t pid) {
+	if ((pid >= OBD_PID_DESC_COUNT) || (pidDesc[pid].len == 0)) {
+		return NULL;
+	}
+	return &pidDesc[pid];
+}
+
+/**
+ * Convert data bytes of a mode 01 PID to its fixed point value
+ *
+ * pid: PID data is for
+ * data: Data bytes (A, B, C...) from ECU response
+ * dest: Destination to store value (milli-units)
+ *
+ * Return: True if PID has a numeric value, false otherwise
+ * */
+bool obd_pid_convert_fixed(uint8_t pid, uint8_t* data, int32_t* dest) {
+	const OBDPidDesc* desc = obd_pid_desc(pid);
+	int32_t raw;
+
+	if ((desc == NULL) || (desc->rawLen == 0)) {
+		return false;
+	}
+	data += desc->rawStart;
+	if (desc->rawLen == 4) {
+		// 32 bit raw values (odometer) would overflow 32 bit multiply
+		uint32_t raw32 = ((uint32_t) data[0] << 24) | (data[1] << 16) | (data[2] << 8) | data[3];
+
+		*dest = (int32_t) ((((int64_t) raw32 * desc->mul) / desc->div) + desc->offset);
+		return true;
+	}
+	if (desc->rawLen == 2) {
+		raw = (data[0] << 8) | data[1];
+		if (desc->flags & OBD_PID_FLAG_SIGNED) {
+			raw = (int16_t) raw;
+		}
+	} else {
+		raw = data[0];
+		if (desc->flags & OBD_PID_FLAG_SIGNED) {
+			raw = (int8_t) raw;
+		}
+	}
+	*dest = ((raw * desc->mul) / desc->div) + desc->offset;
+	return true;
+}
+
+/**
+ * Get resolution of a mode 01 PID i.e. the change in value of one raw count
+ *
+ * pid: PID to get resolution of
+ *
+ * Return: Resolution in milli-units (at least 1), 0 if PID has no numeric value
+ * */
+int32_t obd_pid_resolution(uint8_t pid) {
+	const OBDPidDesc* desc = obd_pid_desc(pid);
+
+	if ((desc == NULL) || (desc->rawLen == 0)) {
+		return 0;
+	}
+	if (desc->mul < desc->div) {
+		return 1;
+	}
+	return desc->mul / desc->div;
+}
@@ -0,0 +1,97 @@
+/*
+ * dgas_ring.c
+ *
+ *  Created on: 18 Oct. 2026
+ *      Author: rhett
+ */
+
+// Single producer single consumer ring buffer used to pass data from ISRs to tasks
+// without disabling interrupts
+
+#include <dgas_ring.h>
+#include <string.h>
+
+/**
+ * Initialise a ring buffer
+ *
+ * ring: Ring to initialise
+ * buff: Storage for elements (elemSize * count bytes)
+ * elemSize: Size of each element in bytes
+ * count: Number of elements (must be a power of 2)
+ *
+ * Return: None
+ * */
+void dgas_ring_init(DRing* ring, void* buff, uint32_t elemSize, uint32_t count) {
+	ring->buff = (uint8_t*) buff;
+	ring->elemSize = elemSize;
+	ring->count = count;
+	ring->head = 0;
+	ring->tail = 0;
+	ring->dropped = 0;
+}
+
+/**
+ * Push an element onto ring, must only be called by the producer
+ *
+ * ring: Ring to push to
+ * elem: Element to push
+ *
+ * Return: True if element was pushed, false if ring was full
+ * */
+bool dgas_ring_push(DRing* ring, const void* elem) {
+	uint32_t head = ring->head;
+
+	if (head - ring->tail >= ring->count) {
+		ring->dropped++;
+		return false;
+	}
+	memcpy(&ring->buff[(head & (ring->count - 1)) * ring->elemSize], elem, ring->elemSize);
+	// element must be written before consumer can see it
+	__DMB();
+	ring->head = head + 1;
+	return true;
+}
+
+/**
+ * Pop an element from ring, must only be called by the consumer
+ *
+ * ring: Ring to pop from
+ * dest: Destination to store element
+ *
+ * Return: True if element was popped, false if ring was empty
+ * */
+bool dgas_ring_pop(DRing* ring, void* dest) {
+	uint32_t tail = ring->tail;
+
+	if (tail == ring->head) {
+		return false;
+	}
+	__DMB();
+	memcpy(dest, &ring->buff[(tail & (ring->count - 1)) * ring->elemSize], ring->elemSize);
+	// element must be read before producer can overwrite it
+	__DMB();
+	ring->tail = tail + 1;
+	return true;
+}
+
+/**
+ * Get number of elements waiting in ring
+ *
+ * ring: Ring to check
+ *
+ * Return: Number of elements in ring
+ * */
+uint32_t dgas_ring_used(DRing* ring) {
+	return ring->head - ring->tail;
+}
+
+/**
+ * Discard all elements in ring, must only be called by the consumer
+ *
+ * ring: Ring to flush
+ *
+ * Return: None
+ * */
+void dgas_ring_flush(DRing* ring) {
+	ring->tail = ring->head;
+}
@@ -12,6 +12,7 @@
 #include <accelerometer.h>
 #include <flash.h>
 #include <dram.h>
+#include <dgas_time.h>
 #include <stdio.h>
 
 static TaskHandle_t taskHandleSelfTest;
@@ -98,14 +99,14 @@ DeviceStatus dgas_self_test_dram(MemTestDesc* mDesc) {
 	// Although we can access DRAM via pointer we should not when self-testing
 	// as if DRAM is faulty we may get segfault and go to hardfault handler. So
 	// access DRAM using HAL_SDRAM functions
-	uint32_t readTick = HAL_GetTick();
+	uint32_t readTick = dgas_time_ms();
 
 	if ((mDesc->readFailAddr = dram_test_read_access()) != 0) {
 		return DEV_READ_ERROR;
 	}
 	// We can't test write functionality to DRAM since it stores frame buffers so we
 	// can only test read access
-	mDesc->readTime = HAL_GetTick() - readTick;
+	mDesc->readTime = dgas_time_ms() - readTick;
 	mDesc->used = dram_calc_used();
 	mDesc->free = dram_calc_free();
 	return DEV_OK;
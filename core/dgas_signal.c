@@ -0,0 +1,262 @@
+/*
+ * dgas_signal.c
+ *
+ *  Created on: 18 Oct. 2026
+ *      Author: rhett
+ */
+
+// Broadcast signal database. Many vehicles broadcast values such as engine speed on the
+// powertrain CAN without being asked. Signal definitions are loaded from flash and
+// compiled into extractors, frames received while the CAN driver is listening are
+// decoded through them straight into the live data table
+
+#include <dgas_signal.h>
+#include <string.h>
+
+// compiled signals sorted by ID so all signals of a frame are adjacent
+static SignalExtractor table[SIGNAL_MAX];
+// number of compiled signals in table
+static volatile uint32_t tableCount;
+// signal definitions as read from flash
+static SignalDef stored[SIGNAL_MAX];
+// database image being written to flash
+static uint8_t image[sizeof(SignalDbHeader) + (SIGNAL_MAX * sizeof(SignalDef))];
+// live data channels fed by a compiled signal, one bit per channel
+static volatile uint32_t fed[(LIVE_CHANNEL_COUNT + 31) / 32];
+
+/**
+ * Calculate checksum of signal definitions
+ *
+ * defs: Signal definitions
+ * count: Number of signal definitions
+ *
+ * Return: Checksum
+ * */
+static uint32_t signal_checksum(const SignalDef* defs, uint32_t count) {
+	const uint8_t* bytes = (const uint8_t*) defs;
+	uint32_t sum = 0;
+
+	for (uint32_t i = 0; i < count * sizeof(SignalDef); i++) {
+		sum += bytes[i];
+	}
+	return sum;
+}
+
+/**
+ * Compile a signal definition into an extractor
+ *
+ * def: Signal definition
+ * dest: Destination to store extractor
+ *
+ * Return: True if signal is valid and was compiled, false otherwise
+ * */
+static bool signal_compile(const SignalDef* def, SignalExtractor* dest) {
+	uint32_t lsb, msb;
+
+	if ((def->length == 0) || (def->length > SIGNAL_LENGTH_MAX) || (def->divisor == 0) ||
+			(def->channel >= LIVE_CHANNEL_COUNT) || (def->start >= SIGNAL_FRAME_LEN * 8)) {
+		return false;
+	}
+	if (def->flags & SIGNAL_FLAG_BIG_ENDIAN) {
+		// word is read big endian so bit b of byte k is at (7 - k) * 8 + b, signal runs
+		// towards bit 0 from its most significant bit
+		msb = ((SIGNAL_FRAME_LEN - 1 - (def->start / 8)) * 8) + (def->start % 8);
+		if (msb + 1 < def->length) {
+			return false;
+		}
+		lsb = msb + 1 - def->length;
+		dest->minLen = SIGNAL_FRAME_LEN - (lsb / 8);
+	} else {
+		lsb = def->start;
+		if (lsb + def->length > SIGNAL_FRAME_LEN * 8) {
+			return false;
+		}
+		dest->minLen = ((lsb + def->length - 1) / 8) + 1;
+	}
+	dest->id = def->id;
+	dest->shift = lsb;
+	dest->mask = (1ULL << def->length) - 1;
+	dest->signBit = 1ULL << (def->length - 1);
+	dest->flags = def->flags;
+	dest->channel = def->channel;
+	dest->factor = def->factor;
+	dest->divisor = def->divisor;
+	dest->offset = def->offset;
+	return true;
+}
+
+/**
+ * Stop decoding signals
+ *
+ * Return: None
+ * */
+void dgas_signal_clear(void) {
+	tableCount = 0;
+	memset((void*) fed, 0, sizeof(fed));
+}
+
+/**
+ * Load signal database from flash and compile it. Invalid signal definitions are
+ * skipped.
+ *
+ * Return: Status indicating success or failure (no valid database in flash)
+ * */
+DStatus dgas_signal_load(void) {
+	SignalDbHeader header;
+	SignalExtractor ext;
+	uint32_t size, chunk;
+	uint32_t count = 0;
+	uint32_t i;
+
+	dgas_signal_clear();
+	if (flash_request(FLASH_CMD_READ, SIGNAL_FLASH_ADDR, &header, sizeof(header)) != DEV_OK) {
+		return DGAS_STATUS_ERROR;
+	}
+	if ((header.magic != SIGNAL_DB_MAGIC) || (header.count > SIGNAL_MAX)) {
+		return DGAS_STATUS_ERROR;
+	}
+	size = header.count * sizeof(SignalDef);
+	for (uint32_t done = 0; done < size; done += chunk) {
+		chunk = ((size - done) > sizeof(FlashBuf)) ? sizeof(FlashBuf) : (size - done);
+		if (flash_request(FLASH_CMD_READ, SIGNAL_FLASH_ADDR + sizeof(header) + done,
+				(uint8_t*) stored + done, chunk) != DEV_OK) {
+			return DGAS_STATUS_ERROR;
+		}
+	}
+	if (header.checksum != signal_checksum(stored, header.count)) {
+		return DGAS_STATUS_ERROR;
+	}
+	for (uint32_t n = 0; n < header.count; n++) {
+		if (!signal_compile(&stored[n], &ext)) {
+			continue;
+		}
+		// insertion sort by ID, signals of same ID keep database order
+		for (i = count; (i > 0) && (table[i - 1].id > ext.id); i--) {
+			memcpy(&table[i], &table[i - 1], sizeof(SignalExtractor));
+		}
+		memcpy(&table[i], &ext, sizeof(SignalExtractor));
+		fed[ext.channel / 32] |= 1UL << (ext.channel % 32);
+		count++;
+	}
+	tableCount = count;
+	return (count != 0) ? DGAS_STATUS_OK : DGAS_STATUS_ERROR;
+}
+
+/**
+ * Store a signal database in flash, replacing any existing database. Takes effect the
+ * next time the database is loaded.
+ *
+ * defs: Signal definitions
+ * count: Number of signal definitions (up to SIGNAL_MAX)
+ *
+ * Return: Status indicating success or failure
+ * */
+DStatus dgas_signal_store(const SignalDef* defs, uint32_t count) {
+	SignalDbHeader header = {.magic = SIGNAL_DB_MAGIC, .count = count};
+	uint32_t size = sizeof(header) + (count * sizeof(SignalDef));
+	uint32_t chunk;
+
+	if (count > SIGNAL_MAX) {
+		return DGAS_STATUS_ERROR;
+	}
+	header.checksum = signal_checksum(defs, count);
+	memcpy(image, &header, sizeof(header));
+	memcpy(image + sizeof(header), defs, count * sizeof(SignalDef));
+
+	if (flash_request(FLASH_CMD_ERASE_SECTOR, SIGNAL_FLASH_ADDR, NULL, 0) != DEV_OK) {
+		return DGAS_STATUS_ERROR;
+	}
+	// write a page at a time, database starts on a sector so chunks never cross a page
+	for (uint32_t done = 0; done < size; done += chunk) {
+		chunk = ((size - done) > FLASH_PAGE_SIZE) ? FLASH_PAGE_SIZE : (size - done);
+		if (flash_request(FLASH_CMD_WRITE, SIGNAL_FLASH_ADDR + done, image + done,
+				chunk) != DEV_OK) {
+			return DGAS_STATUS_ERROR;
+		}
+	}
+	return DGAS_STATUS_OK;
+}
+
+/**
+ * Get number of compiled signals being decoded
+ *
+ * Return: Number of signals
+ * */
+uint32_t dgas_signal_count(void) {
+	return tableCount;
+}
+
+/**
+ * Check if a live data channel is fed by a broadcast signal (so doesn't need polling)
+ *
+ * ch: Channel to check
+ *
+ * Return: True if a compiled signal publishes to channel, false otherwise
+ * */
+bool dgas_signal_feeds(LiveChannel ch) {
+	if (ch >= LIVE_CHANNEL_COUNT) {
+		return false;
+	}
+	return (fed[ch / 32] & (1UL << (ch % 32))) != 0;
+}
+
+/**
+ * Decode every signal of a received frame and publish the values to the live data
+ * table. Must only be called from a single task (the writer of the signals' channels).
+ *
+ * id: CAN ID of frame (SIGNAL_ID_EXTENDED set for 29-bit IDs)
+ * data: Frame data
+ * len: Number of data bytes
+ * timestamp: Time frame was received (ms)
+ *
+ * Return: Number of signals decoded
+ * */
+uint32_t dgas_signal_decode(uint32_t id, const uint8_t* data, uint32_t len, uint32_t timestamp) {
+	uint8_t bytes[SIGNAL_FRAME_LEN] = {0};
+	uint64_t le = 0;
+	uint64_t be = 0;
+	uint64_t raw;
+	int64_t value;
+	uint32_t lo = 0;
+	uint32_t hi = tableCount;
+	uint32_t decoded = 0;
+
+	// find first signal of frame
+	while (lo < hi) {
+		uint32_t mid = (lo + hi) / 2;
+
+		if (table[mid].id < id) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	if ((lo == tableCount) || (table[lo].id != id)) {
+		return 0;
+	}
+	if (len > SIGNAL_FRAME_LEN) {
+		len = SIGNAL_FRAME_LEN;
+	}
+	memcpy(bytes, data, len);
+	for (uint32_t i = 0; i < SIGNAL_FRAME_LEN; i++) {
+		le |= (uint64_t) bytes[i] << (i * 8);
+		be = (be << 8) | bytes[i];
+	}
+
+	for (uint32_t i = lo; (i < tableCount) && (table[i].id == id); i++) {
+		SignalExtractor* ext = &table[i];
+
+		if (len < ext->minLen) {
+			continue;
+		}
+		raw = (((ext->flags & SIGNAL_FLAG_BIG_ENDIAN) ? be : le) >> ext->shift) & ext->mask;
+		value = (int64_t) raw;
+		if ((ext->flags & SIGNAL_FLAG_SIGNED) && (raw & ext->signBit)) {
+			value -= (int64_t) ext->mask + 1;
+		}
+		value = ((value * ext->factor) / ext->divisor) + ext->offset;
+		dgas_live_write(ext->channel, (int32_t) value, OBD_OK, timestamp);
+		decoded++;
+	}
+	return decoded;
+}
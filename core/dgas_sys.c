@@ -14,6 +14,7 @@
 #include <dgas_selftest.h>
 #include <dgas_settings.h>
 #include <dgas_param.h>
+#include <dgas_time.h>
 #include <accelerometer.h>
 #include <dgas_adc.h>
 #include <dram.h>
@@ -23,6 +24,7 @@
 #include <buttons.h>
 #include <stdio.h>
 #include <kwp.h>
+#include <iso15765.h>
 
 // Task handle of DGAS system task
 static TaskHandle_t taskHandleSys;
@@ -64,6 +66,8 @@ void debug_event_handler(UIEventCode eCode) {
 		dgas_debug_pause();
 	} else if (eCode == UI_EVENT_DEBUG_RESUME) {
 		dgas_debug_resume();
+	} else if (eCode == UI_EVENT_DEBUG_VIEW) {
+		dgas_debug_toggle_view();
 	}
 }
 
@@ -93,9 +97,17 @@ void dtc_event_handler(UIEventCode eCode) {
 void settings_event_handler(UIEventCode eCode, UISettingsState* state) {
 	if (eCode == UI_EVENT_SETTINGS_SAVE) {
 		GaugeConfig conf = {0};
-		conf.bid = (BusID) state->sBus;
+		bool listen = (state->sBus == UI_SETTINGS_BUS_CAN_LISTEN);
+
+		conf.bid = listen ? BUS_ID_CAN : (BusID) state->sBus;
 		conf.gid = (GaugeParamID) state->sParam;
 		dgas_settings_config_save(&conf);
+
+		// listening only isn't saved, it lasts until another bus is selected
+		obd_can_set_listen_only(listen);
+		if (listen && (eventOBDChangeBus != NULL)) {
+			xEventGroupSetBits(eventOBDChangeBus, EVT_OBD_BUS_CHANGE_CAN);
+		}
 	}
 }
 
@@ -158,6 +170,7 @@ uint32_t dgas_sys_wait_on_object(void** obj, uint32_t timeout) {
  * Return: 0 on success, error number otherwise
  * */
 uint32_t dgas_sys_hardware_init(void) {
+	dgas_time_init();
 	dram_init();
 	display_init();
 	flash_init();
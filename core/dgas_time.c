@@ -0,0 +1,157 @@
+/*
+ * dgas_time.c
+ *
+ *  Created on: 18 Oct. 2026
+ *      Author: rhett
+ */
+
+// Microsecond monotonic timebase shared by bus drivers, devices and the OBD controller.
+// On target it is built on the DWT cycle counter which is extended to 64 bits in
+// software, so it must be read at least once per counter wrap (~19s at 216MHz). Tasks
+// may go quiet for longer than that so a software timer reads it periodically. When
+// DGAS_CONFIG_TIME_VIRTUAL is defined (host builds) time only moves when
+// dgas_time_advance() is called.
+
+#include <dgas_time.h>
+
+#ifndef DGAS_CONFIG_TIME_VIRTUAL
+
+#include <timers.h>
+
+// upper 32 bits of extended cycle count
+static uint32_t cyclesHigh;
+// cycle count at last read, used to detect counter wrapping
+static uint32_t cyclesLast;
+// core clock cycles per microsecond
+static uint32_t cyclesPerUs;
+// timer which reads timebase so no counter wrap is missed
+static TimerHandle_t timerWrap;
+
+/**
+ * Callback of wrap timer, reads timebase to account for any counter wrap
+ *
+ * timer: Timer which expired
+ *
+ * Return: None
+ * */
+static void time_wrap_callback(TimerHandle_t timer) {
+	(void) timer;
+	(void) dgas_time_us();
+}
+
+/**
+ * Initialise timebase, enables DWT cycle counter and starts wrap timer
+ *
+ * Return: None
+ * */
+void dgas_time_init(void) {
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->LAR = DGAS_TIME_DWT_LAR_KEY;
+	DWT->CYCCNT = 0;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+	cyclesHigh = 0;
+	cyclesLast = 0;
+	cyclesPerUs = SystemCoreClock / 1000000;
+
+	if (timerWrap == NULL) {
+		timerWrap = xTimerCreate("TimeWrap", pdMS_TO_TICKS(DGAS_TIME_WRAP_CHECK_MS), pdTRUE,
+				NULL, time_wrap_callback);
+	}
+	if (timerWrap != NULL) {
+		xTimerStart(timerWrap, 0);
+	}
+}
+
+/**
+ * Get time since timebase was initialised. Safe to call from tasks and ISRs.
+ *
+ * Return: Time in microseconds
+ * */
+uint64_t dgas_time_us(void) {
+	uint32_t primask = __get_PRIMASK();
+	uint32_t cycles;
+	uint64_t total;
+
+	__disable_irq();
+	cycles = DWT->CYCCNT;
+	if (cycles < cyclesLast) {
+		// counter wrapped since last read
+		cyclesHigh++;
+	}
+	cyclesLast = cycles;
+	total = ((uint64_t) cyclesHigh << 32) | cycles;
+	__set_PRIMASK(primask);
+
+	return total / cyclesPerUs;
+}
+
+/**
+ * Busy wait for a number of microseconds. Only for short waits (e.g. bus bit timing),
+ * use vTaskDelay() for anything longer than a tick.
+ *
+ * us: Microseconds to wait
+ *
+ * Return: None
+ * */
+void dgas_time_delay_us(uint32_t us) {
+	uint64_t start = dgas_time_us();
+
+	while (dgas_time_us() - start < us);
+}
+
+#else
+
+// virtual clock for host builds
+static uint64_t virtualNow;
+
+/**
+ * Initialise timebase, resets virtual clock
+ *
+ * Return: None
+ * */
+void dgas_time_init(void) {
+	virtualNow = 0;
+}
+
+/**
+ * Get current time of virtual clock
+ *
+ * Return: Time in microseconds
+ * */
+uint64_t dgas_time_us(void) {
+	return virtualNow;
+}
+
+/**
+ * Advance virtual clock
+ *
+ * us: Microseconds to advance clock by
+ *
+ * Return: None
+ * */
+void dgas_time_advance(uint64_t us) {
+	virtualNow += us;
+}
+
+/**
+ * Wait for a number of microseconds, on virtual clock this just advances time
+ *
+ * us: Microseconds to wait
+ *
+ * Return: None
+ * */
+void dgas_time_delay_us(uint32_t us) {
+	dgas_time_advance(us);
+}
+
+#endif
+
+/**
+ * Get time since timebase was initialised in milliseconds
+ *
+ * Return: Time in milliseconds (wraps after ~49 days)
+ * */
+uint32_t dgas_time_ms(void) {
+	return (uint32_t) (dgas_time_us() / DGAS_TIME_US_PER_MS);
+}
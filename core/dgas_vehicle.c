@@ -0,0 +1,483 @@
+/*
+ * dgas_vehicle.c
+ *
+ *  Created on: 18 Oct. 2026
+ *      Author: rhett
+ */
+
+// Per vehicle (VIN) profiles. Supported PIDs are discovered once per vehicle and
+// cached in flash so requests for unsupported PIDs are never made
+
+#include <dgas_vehicle.h>
+#include <dgas_obd.h>
+#include <flash.h>
+#include <string.h>
+#include <stddef.h>
+
+// profile of currently connected vehicle
+static VehicleProfile active;
+// true if active profile has been discovered/loaded
+static volatile bool activeValid;
+// index of next free flash slot, VEHICLE_FLASH_SLOT_COUNT if not yet known
+static uint32_t nextFreeSlot = VEHICLE_FLASH_SLOT_COUNT;
+// true once nextFreeSlot has been found
+static bool nextFreeKnown;
+// other vehicles kept when profile sector is compacted
+static VehicleProfile keep[VEHICLE_FLASH_KEEP];
+
+/**
+ * Calculate checksum of a vehicle profile
+ *
+ * profile: Profile to calculate checksum of
+ *
+ * Return: Checksum
+ * */
+static uint32_t vehicle_profile_checksum(VehicleProfile* profile) {
+	uint8_t* bytes = (uint8_t*) profile;
+	uint32_t sum = 0;
+
+	for (uint32_t i = 0; i < offsetof(VehicleProfile, checksum); i++) {
+		sum += bytes[i];
+	}
+	return sum;
+}
+
+/**
+ * Read a profile from a flash slot
+ *
+ * slot: Slot to read
+ * dest: Destination profile
+ *
+ * Return: True if slot holds a valid profile, false otherwise
+ * */
+static bool vehicle_slot_read(uint32_t slot, VehicleProfile* dest) {
+	if (flash_request(FLASH_CMD_READ, VEHICLE_FLASH_SLOT_ADDR(slot), dest,
+			sizeof(VehicleProfile)) != DEV_OK) {
+		return false;
+	}
+	return (dest->magic == VEHICLE_PROFILE_MAGIC) &&
+			(dest->checksum == vehicle_profile_checksum(dest));
+}
+
+/**
+ * Check if a flash slot is unused (erased)
+ *
+ * slot: Slot to check
+ *
+ * Return: True if slot is erased, false otherwise
+ * */
+static bool vehicle_slot_erased(uint32_t slot) {
+	uint32_t magic = 0;
+
+	if (flash_request(FLASH_CMD_READ, VEHICLE_FLASH_SLOT_ADDR(slot), &magic,
+			sizeof(uint32_t)) != DEV_OK) {
+		return false;
+	}
+	return magic == VEHICLE_PROFILE_ERASED;
+}
+
+/**
+ * Find the first unused flash slot. Slots are filled in order so every slot after the
+ * first unused slot is also unused.
+ *
+ * Return: Index of first unused slot, VEHICLE_FLASH_SLOT_COUNT if sector is full
+ * */
+static uint32_t vehicle_slot_find_free(void) {
+	if (nextFreeKnown) {
+		return nextFreeSlot;
+	}
+	for (nextFreeSlot = 0; nextFreeSlot < VEHICLE_FLASH_SLOT_COUNT; nextFreeSlot++) {
+		if (vehicle_slot_erased(nextFreeSlot)) {
+			break;
+		}
+	}
+	nextFreeKnown = true;
+	return nextFreeSlot;
+}
+
+/**
+ * Find most recently saved profile of a vehicle
+ *
+ * vin: VIN of vehicle
+ * dest: Destination to store profile
+ *
+ * Return: Status indicating success or failure (profile not found)
+ * */
+DStatus dgas_vehicle_profile_find(const char* vin, VehicleProfile* dest) {
+	VehicleProfile profile;
+
+	// newest profile is the last one written
+	for (uint32_t slot = vehicle_slot_find_free(); slot-- > 0;) {
+		if (vehicle_slot_read(slot, &profile) && (strcmp(profile.vin, vin) == 0)) {
+			memcpy(dest, &profile, sizeof(VehicleProfile));
+			return DGAS_STATUS_OK;
+		}
+	}
+	return DGAS_STATUS_ERROR;
+}
+
+/**
+ * Erase profile sector keeping only the most recent profiles of up to VEHICLE_FLASH_KEEP
+ * other vehicles
+ *
+ * vin: VIN of vehicle about to be saved (not kept)
+ *
+ * Return: Status indicating success or failure
+ * */
+static DStatus vehicle_profile_compact(const char* vin) {
+	VehicleProfile profile;
+	uint32_t kept = 0;
+
+	for (uint32_t slot = VEHICLE_FLASH_SLOT_COUNT; (slot-- > 0) && (kept < VEHICLE_FLASH_KEEP);) {
+		bool duplicate = false;
+
+		if (!vehicle_slot_read(slot, &profile) || (strcmp(profile.vin, vin) == 0)) {
+			continue;
+		}
+		for (uint32_t i = 0; i < kept; i++) {
+			if (strcmp(keep[i].vin, profile.vin) == 0) {
+				duplicate = true;
+				break;
+			}
+		}
+		if (!duplicate) {
+			memcpy(&keep[kept++], &profile, sizeof(VehicleProfile));
+		}
+	}
+	if (flash_request(FLASH_CMD_ERASE_SECTOR, VEHICLE_FLASH_ADDR, NULL, 0) != DEV_OK) {
+		nextFreeKnown = false;
+		return DGAS_STATUS_ERROR;
+	}
+	// write back oldest first so order is preserved
+	nextFreeSlot = 0;
+	while (kept-- > 0) {
+		if (flash_request(FLASH_CMD_WRITE, VEHICLE_FLASH_SLOT_ADDR(nextFreeSlot), &keep[kept],
+				sizeof(VehicleProfile)) != DEV_OK) {
+			nextFreeKnown = false;
+			return DGAS_STATUS_ERROR;
+		}
+		nextFreeSlot++;
+	}
+	return DGAS_STATUS_OK;
+}
+
+/**
+ * Save a vehicle profile to flash. Profile becomes the most recent profile for its VIN.
+ *
+ * profile: Profile to save
+ *
+ * Return: Status indicating success or failure
+ * */
+DStatus dgas_vehicle_profile_save(VehicleProfile* profile) {
+	profile->magic = VEHICLE_PROFILE_MAGIC;
+	profile->checksum = vehicle_profile_checksum(profile);
+
+	if (vehicle_slot_find_free() >= VEHICLE_FLASH_SLOT_COUNT) {
+		if (vehicle_profile_compact(profile->vin) != DGAS_STATUS_OK) {
+			return DGAS_STATUS_ERROR;
+		}
+	}
+	if (flash_request(FLASH_CMD_WRITE, VEHICLE_FLASH_SLOT_ADDR(nextFreeSlot), profile,
+			sizeof(VehicleProfile)) != DEV_OK) {
+		// slot may have been partially written
+		nextFreeKnown = false;
+		return DGAS_STATUS_ERROR;
+	}
+	nextFreeSlot++;
+	return DGAS_STATUS_OK;
+}
+
+/**
+ * Read a supported PIDs bitmap by walking PIDs 0x00, 0x20, 0x40... of a mode until
+ * ECU indicates no further groups are supported
+ *
+ * mode: OBD mode to walk
+ * bitmap: Bitmap to populate (VEHICLE_PID_BITMAP_WORDS long)
+ * timeout: Time to wait for each response
+ *
+ * Return: Status indicating success or failure (ECU didn't respond to first group)
+ * */
+static DStatus vehicle_walk_supported(OBDMode mode, uint32_t* bitmap, uint32_t timeout) {
+	uint8_t data[OBD_BUS_RESPONSE_MAX];
+
+	memset(bitmap, 0, VEHICLE_PID_BITMAP_WORDS * sizeof(uint32_t));
+
+	for (uint32_t group = 0; group < VEHICLE_PID_BITMAP_WORDS; group++) {
+		OBDPid base = group * VEHICLE_PID_GROUP_SIZE;
+
+		if (dgas_obd_get_pid(base, mode, data, timeout) < VEHICLE_PID_BITMAP_LEN) {
+			return (group == 0) ? DGAS_STATUS_ERROR : DGAS_STATUS_OK;
+		}
+		bitmap[group] = (data[0] << 24) | (data[1] << 16) | (data[2] << 8) | data[3];
+
+		if ((bitmap[group] & VEHICLE_PID_NEXT_GROUP) == 0) {
+			break;
+		}
+	}
+	return DGAS_STATUS_OK;
+}
+
+/**
+ * Set the active vehicle profile
+ *
+ * profile: Profile to make active
+ *
+ * Return: None
+ * */
+static void vehicle_set_active(VehicleProfile* profile) {
+	// same critical section as dgas_vehicle_get_active so a copy is never torn
+	taskENTER_CRITICAL();
+	memcpy(&active, profile, sizeof(VehicleProfile));
+	activeValid = true;
+	taskEXIT_CRITICAL();
+}
+
+/**
+ * Discover the connected vehicle. Reads VIN and loads vehicle's cached profile if
+ * there is one, otherwise walks supported PIDs of modes 01 and 09 and caches the result.
+ * Should be called from OBD controller task once bus is ready.
+ *
+ * timeout: Time to wait for each response
+ *
+ * Return: Status indicating success or failure
+ * */
+DStatus dgas_vehicle_discover(uint32_t timeout) {
+	VehicleProfile profile = {0};
+	uint8_t data[OBD_BUS_RESPONSE_MAX];
+	uint32_t len;
+	KWPInitMethod kwpInit = KWP_INIT_UNKNOWN;
+	uint8_t kwpTiming[KWP_ATP_PARAM_COUNT];
+	bool kwpTimingValid = false;
+	CANConfig canConfig;
+	bool canConfigValid = false;
+	bool changed = false;
+
+	dgas_vehicle_clear_active();
+
+	if (obd_get_active_bus() == BUS_ID_KWP) {
+		kwpInit = kwp_bus_get_init_method();
+		kwpTimingValid = kwp_bus_get_negotiated_timing(kwpTiming);
+	} else if (obd_get_active_bus() == BUS_ID_CAN) {
+		canConfigValid = obd_can_get_config(&canConfig);
+	}
+	// VIN response is [message count, VIN...], take the last 17 bytes
+	len = dgas_obd_get_pid(OBD_PID_VEHICLE_INFO_VIN, OBD_MODE_VEHICLE_INFO, data, timeout);
+	if (len >= VEHICLE_VIN_LEN) {
+		memcpy(profile.vin, data + len - VEHICLE_VIN_LEN, VEHICLE_VIN_LEN);
+
+		if (dgas_vehicle_profile_find(profile.vin, &profile) == DGAS_STATUS_OK) {
+			if ((kwpInit != KWP_INIT_UNKNOWN) && (profile.kwpInit != kwpInit)) {
+				// remember which init worked so it is tried first next time
+				profile.kwpInit = kwpInit;
+				changed = true;
+			}
+			if (kwpTimingValid && (!profile.kwpTimingValid ||
+					(memcmp(profile.kwpTiming, kwpTiming, sizeof(kwpTiming)) != 0))) {
+				memcpy(profile.kwpTiming, kwpTiming, sizeof(kwpTiming));
+				profile.kwpTimingValid = 1;
+				changed = true;
+			}
+			if (canConfigValid && (!profile.canConfigValid ||
+					(memcmp(&profile.canConfig, &canConfig, sizeof(canConfig)) != 0))) {
+				memcpy(&profile.canConfig, &canConfig, sizeof(canConfig));
+				profile.canConfigValid = 1;
+				changed = true;
+			}
+			vehicle_set_active(&profile);
+			if (changed) {
+				dgas_vehicle_profile_save(&profile);
+			}
+			return DGAS_STATUS_OK;
+		}
+	}
+	profile.kwpInit = kwpInit;
+	if (kwpTimingValid) {
+		memcpy(profile.kwpTiming, kwpTiming, sizeof(kwpTiming));
+		profile.kwpTimingValid = 1;
+	}
+	if (canConfigValid) {
+		memcpy(&profile.canConfig, &canConfig, sizeof(canConfig));
+		profile.canConfigValid = 1;
+	}
+	if (vehicle_walk_supported(OBD_MODE_LIVE, profile.pidsLive, timeout) != DGAS_STATUS_OK) {
+		// ECU not responding
+		return DGAS_STATUS_ERROR;
+	}
+	// mode 09 is optional, no response leaves all mode 09 PIDs unsupported
+	vehicle_walk_supported(OBD_MODE_VEHICLE_INFO, profile.pidsInfo, timeout);
+	vehicle_set_active(&profile);
+
+	if (profile.vin[0] != '\0') {
+		// only vehicles with a known VIN can be found again
+		dgas_vehicle_profile_save(&profile);
+	}
+	return DGAS_STATUS_OK;
+}
+
+/**
+ * Get KWP bus initialisation method of most recently saved vehicle profile. The bus
+ * has to be initialised before the vehicle can be identified so the most recently
+ * saved vehicle is assumed to be the one connected.
+ *
+ * Return: Initialisation method, KWP_INIT_UNKNOWN if there is no saved profile
+ * */
+KWPInitMethod dgas_vehicle_last_kwp_init(void) {
+	VehicleProfile profile;
+
+	for (uint32_t slot = vehicle_slot_find_free(); slot-- > 0;) {
+		if (vehicle_slot_read(slot, &profile)) {
+			return profile.kwpInit;
+		}
+	}
+	return KWP_INIT_UNKNOWN;
+}
+
+/**
+ * Get KWP timing parameters of most recently saved vehicle profile (see
+ * dgas_vehicle_last_kwp_init)
+ *
+ * dest: Destination to store KWP_ATP_PARAM_COUNT AccessTimingParameters bytes
+ *
+ * Return: True if most recent profile has negotiated timing, false otherwise
+ * */
+bool dgas_vehicle_last_kwp_timing(uint8_t* dest) {
+	VehicleProfile profile;
+
+	for (uint32_t slot = vehicle_slot_find_free(); slot-- > 0;) {
+		if (vehicle_slot_read(slot, &profile)) {
+			if (!profile.kwpTimingValid) {
+				return false;
+			}
+			memcpy(dest, profile.kwpTiming, sizeof(profile.kwpTiming));
+			return true;
+		}
+	}
+	return false;
+}
+
+/**
+ * Cache KWP timing parameters negotiated with active vehicle. If the vehicle hasn't
+ * been discovered yet they are picked up by discovery instead.
+ *
+ * timing: KWP_ATP_PARAM_COUNT AccessTimingParameters bytes ECU accepted
+ *
+ * Return: None
+ * */
+void dgas_vehicle_save_kwp_timing(const uint8_t* timing) {
+	VehicleProfile profile;
+
+	if (!dgas_vehicle_get_active(&profile) || (profile.vin[0] == '\0')) {
+		return;
+	}
+	if (profile.kwpTimingValid && (memcmp(profile.kwpTiming, timing, sizeof(profile.kwpTiming)) == 0)) {
+		// already cached
+		return;
+	}
+	memcpy(profile.kwpTiming, timing, sizeof(profile.kwpTiming));
+	profile.kwpTimingValid = 1;
+	vehicle_set_active(&profile);
+	dgas_vehicle_profile_save(&profile);
+}
+
+/**
+ * Get CAN bus configuration of most recently saved vehicle profile (see
+ * dgas_vehicle_last_kwp_init)
+ *
+ * dest: Destination to store configuration
+ *
+ * Return: True if most recent profile has a detected configuration, false otherwise
+ * */
+bool dgas_vehicle_last_can_config(CANConfig* dest) {
+	VehicleProfile profile;
+
+	for (uint32_t slot = vehicle_slot_find_free(); slot-- > 0;) {
+		if (vehicle_slot_read(slot, &profile)) {
+			if (!profile.canConfigValid) {
+				return false;
+			}
+			memcpy(dest, &profile.canConfig, sizeof(CANConfig));
+			return true;
+		}
+	}
+	return false;
+}
+
+/**
+ * Cache CAN bus configuration detected for active vehicle. If the vehicle hasn't been
+ * discovered yet it is picked up by discovery instead. Must be called from OBD
+ * controller task, which does all profile saving.
+ *
+ * config: Configuration bus was detected with
+ *
+ * Return: None
+ * */
+void dgas_vehicle_save_can_config(const CANConfig* config) {
+	VehicleProfile profile;
+
+	if (!dgas_vehicle_get_active(&profile) || (profile.vin[0] == '\0')) {
+		return;
+	}
+	if (profile.canConfigValid && (memcmp(&profile.canConfig, config, sizeof(CANConfig)) == 0)) {
+		// already cached
+		return;
+	}
+	memcpy(&profile.canConfig, config, sizeof(CANConfig));
+	profile.canConfigValid = 1;
+	vehicle_set_active(&profile);
+	dgas_vehicle_profile_save(&profile);
+}
+
+/**
+ * Clear active vehicle profile (e.g. on bus change). Until a new profile is discovered
+ * all PIDs are treated as supported.
+ *
+ * Return: None
+ * */
+void dgas_vehicle_clear_active(void) {
+	activeValid = false;
+}
+
+/**
+ * Get a copy of the active vehicle profile
+ *
+ * dest: Destination profile
+ *
+ * Return: True if there is an active profile, false otherwise
+ * */
+bool dgas_vehicle_get_active(VehicleProfile* dest) {
+	if (!activeValid) {
+		return false;
+	}
+	taskENTER_CRITICAL();
+	memcpy(dest, &active, sizeof(VehicleProfile));
+	taskEXIT_CRITICAL();
+	return true;
+}
+
+/**
+ * Check if active vehicle supports a PID. PID 0x00 is always supported and PIDs of
+ * modes without a supported PIDs bitmap are assumed supported.
+ *
+ * mode: OBD mode of PID
+ * pid: PID to check
+ *
+ * Return: True if PID is supported or vehicle isn't known yet, false otherwise
+ * */
+bool dgas_vehicle_pid_supported(OBDMode mode, OBDPid pid) {
+	uint32_t* bitmap;
+
+	if (!activeValid || (pid == 0)) {
+		return true;
+	}
+	if (mode == OBD_MODE_LIVE) {
+		bitmap = active.pidsLive;
+	} else if (mode == OBD_MODE_VEHICLE_INFO) {
+		bitmap = active.pidsInfo;
+	} else {
+		return true;
+	}
+	// PID n is bit (32 - n) of its group, i.e. A7 is the first PID of the group
+	uint32_t index = pid - 1;
+	return (bitmap[index / VEHICLE_PID_GROUP_SIZE] &
+			(1U << (31 - (index % VEHICLE_PID_GROUP_SIZE)))) != 0;
+}
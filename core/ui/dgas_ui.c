@@ -8,6 +8,7 @@
 #include <dgas_types.h>
 #include <dgas_ui.h>
 #include <dgas_param.h>
+#include <dgas_vehicle.h>
 #include <display.h>
 #include <dram.h>
 #include <flash.h>
@@ -112,6 +113,39 @@ static void ui_flush_frame_buffer(lv_display_t* disp, const lv_area_t* area, uin
 	lv_display_flush_ready(disp);
 }
 
+/**
+ * Disable buttons on measure screen for parameters the vehicle doesn't support
+ *
+ * Return: None
+ * */
+static void ui_meas_update_supported(void) {
+	lv_obj_t* buttons[] = {objects.eng_speed_btn,
+						   objects.vehicle_speed_btn,
+						   objects.eng_load_btn,
+						   objects.coolant_temp_btn,
+						   objects.boost_btn,
+						   objects.intake_temp_btn,
+						   objects.maf_btn,
+						   objects.fuel_pressure_btn};
+	// parameters in same order as buttons
+	const GaugeParam* params[] = {&paramRPM,
+								  &paramSpeed,
+								  &paramEngineLoad,
+								  &paramCoolant,
+								  &paramBoost,
+								  &paramAirTemp,
+								  &paramMAF,
+								  &paramFuelPressure};
+
+	for (uint32_t i = 0; i < sizeof(buttons)/sizeof(lv_obj_t*); i++) {
+		if (dgas_vehicle_pid_supported(OBD_MODE_LIVE, params[i]->pid)) {
+			lv_obj_remove_state(buttons[i], LV_STATE_DISABLED);
+		} else {
+			lv_obj_add_state(buttons[i], LV_STATE_DISABLED);
+		}
+	}
+}
+
 /**
  * LVGL event callback function for menu screen.
  *
@@ -122,6 +156,7 @@ static void ui_flush_frame_buffer(lv_display_t* disp, const lv_area_t* area, uin
 static void ui_event_callback_menu(lv_event_code_t code, lv_obj_t* focus) {
 	if (code == LV_EVENT_CLICKED) {
 		if (focus == objects.measure_btn) {
+			ui_meas_update_supported();
 			ui_load_screen(&uiMeas);
 		} else if (focus == objects.obd2_debug_btn) {
 			ui_load_screen(&uiDebug);
@@ -151,6 +186,10 @@ static void ui_event_callback_menu(lv_event_code_t code, lv_obj_t* focus) {
 static void ui_event_callback_meas(lv_event_code_t code, lv_obj_t* focus) {
 	GaugeParamID param = 0;
 
+	if (lv_obj_has_state(focus, LV_STATE_DISABLED)) {
+		// parameter not supported by vehicle
+		return;
+	}
 	if (code == LV_EVENT_CLICKED) {
 		if (focus == objects.eng_speed_btn) {
 			param = GAUGE_PARAM_ID_RPM;
@@ -191,6 +230,11 @@ static void ui_event_callback_debug(lv_event_code_t code, lv_obj_t* focus) {
 		} else if (focus == objects.obd2_resume_btn) {
 			ui_dispatch_event(UI_UID_DEBUG, UI_EVENT_DEBUG_RESUME, NULL, 0);
 		}
+	} else if (code == LV_EVENT_LONG_PRESSED) {
+		if (focus == objects.obd2_resume_btn) {
+			// holding resume switches between message log and CAN traffic profile
+			ui_dispatch_event(UI_UID_DEBUG, UI_EVENT_DEBUG_VIEW, NULL, 0);
+		}
 	}
 
 }
@@ -435,6 +479,9 @@ void ui_init_all_uis(void) {
 
 	lv_obj_t* aboutEventable[]    = {objects.about_exit_btn};
 
+	// listen only CAN isn't part of generated settings screen
+	lv_dropdown_add_option(objects.settings_bus_dropdown, "CAN Listen Only", LV_DROPDOWN_POS_LAST);
+
 	// initialise UI structs
 	ui_init_struct(&uiGauge, objects.gauge_main_ui, NULL, 0);
 
@@ -29,6 +29,17 @@ static void ui_debug_flush(UIDebugFlush* flush) {
 
 }
 
+/**
+ * Replace contents of debug window UI with a report
+ *
+ * prof: Report to show
+ *
+ * Return: None
+ * */
+static void ui_debug_profile(UIDebugProfile* prof) {
+	lv_textarea_set_text(objects.obd2_debug_textarea, prof->pText);
+}
+
 /**
  * Handle debug UI request:
  *
@@ -44,8 +55,19 @@ static void ui_debug_handle_request(UIRequest* req) {
 				return;
 			}
 			UIDebugFlush dFlush = {0};
-			memcpy(&dFlush, req->uData, sizeof(UIDebugFlush));
+			// request only carries as much of message as fits
+			strncpy(dFlush.dStr, (char*) req->uData, UI_REQUEST_DATA_MAX - 1);
 			ui_debug_flush(&dFlush);
+			break;
+		}
+		case UI_CMD_DEBUG_PROFILE: {
+			if (lv_screen_active() != objects.obd2_debug) {
+				return;
+			}
+			UIDebugProfile dProf;
+			memcpy(&dProf, req->uData, sizeof(UIDebugProfile));
+			ui_debug_profile(&dProf);
+			break;
 		}
 		default:
 			break;
@@ -67,9 +89,12 @@ void ui_debug_make_request(UICmd cmd, void* arg) {
 
 	if (arg != NULL) {
 		if (cmd == UI_CMD_DEBUG_FLUSH) {
-			memcpy(req.uData, (UIDebugFlush*) arg, sizeof(UIDebugFlush));
+			strncpy((char*) req.uData, ((UIDebugFlush*) arg)->dStr, UI_REQUEST_DATA_MAX - 1);
+		} else if (cmd == UI_CMD_DEBUG_PROFILE) {
+			memcpy(req.uData, (UIDebugProfile*) arg, sizeof(UIDebugProfile));
 		}
 	}
+	ui_make_request(&req);
 }
 
 /**
@@ -19,6 +19,8 @@
 static UIGaugeUpdate lastUpdate;
 // Current max value of parameter
 static float gMax;
+// Colour of currently loaded parameter
+static uint32_t gColour;
 
 /**
  * LVGL animation callback function to animate the gauge
@@ -46,7 +48,7 @@ static void ui_gauge_animate(void) {
     lv_anim_set_exec_cb(&a, ui_gauge_animate_cb);
 
     lv_anim_set_time(&a, UI_GAUGE_ANIM_TIME);
-    lv_anim_set_values(&a, 0, UI_GAUGE_ANIM_ARC_END_VALUE);
+    lv_anim_set_values(&a, 0, UI_GAUGE_ANIM_ARC_END_VALUE * UI_GAUGE_ARC_SCALE);
 
     lv_anim_set_playback_time(&a, UI_GAUGE_ANIM_TIME);
 
@@ -83,11 +85,14 @@ static void ui_gauge_adjust_scale_labels(int32_t min, int32_t max, lv_obj_t** sc
  * */
 static void ui_gauge_load(UIGaugeLoad* gLoad) {
 	gMax = 0;
+	gColour = gLoad->lColour;
+	lastUpdate.gStale = false;
 	lv_obj_t* scaleLabels[] = {objects.gauge_tick_0, objects.gauge_tick_1, objects.gauge_tick_2,
 							   objects.gauge_tick_3, objects.gauge_tick_4, objects.gauge_tick_5,
 							   objects.gauge_tick_6};
 
-	lv_arc_set_range(objects.gauge_arc, gLoad->lMin, gLoad->lMax);
+	lv_arc_set_range(objects.gauge_arc, gLoad->lMin * UI_GAUGE_ARC_SCALE,
+					 gLoad->lMax * UI_GAUGE_ARC_SCALE);
 	lv_scale_set_range(objects.gauge_scale, gLoad->lMin, gLoad->lMax);
 	lv_label_set_text(objects.parameter_label, gLoad->lName);
 	lv_label_set_text(objects.param_units_label, gLoad->lUnits);
@@ -116,7 +121,6 @@ static void ui_gauge_update(UIGaugeUpdate* gUpdate) {
 		char buff[UI_GAUGE_PARAM_VAL_BUFF_LEN];
 		sprintf(buff, "%i", gUpdate->gVal);
 		// parameter value has changed so update it
-		lv_arc_set_value(objects.gauge_arc, gUpdate->gVal);
 		lv_label_set_text(objects.param_val, buff);
 		if (gUpdate->gVal > lastUpdate.gVal) {
 			// param value has exceeded current maximum so update label
@@ -124,12 +128,25 @@ static void ui_gauge_update(UIGaugeUpdate* gUpdate) {
 			gMax = gUpdate->gVal;
 		}
 	}
+	if (gUpdate->gArc != lastUpdate.gArc) {
+		lv_arc_set_value(objects.gauge_arc, gUpdate->gArc);
+		lastUpdate.gArc = gUpdate->gArc;
+	}
 	if (strcmp(gUpdate->gObd, lastUpdate.gObd)) {
 		// status string is different so update it
 		lv_label_set_text(objects.obd_status_label, gUpdate->gObd);
 		// update stat
 		strcpy(lastUpdate.gObd, gUpdate->gObd);
 	}
+	if (gUpdate->gStale != lastUpdate.gStale) {
+		// grey out value if it is stale
+		uint32_t colour = gUpdate->gStale ? UI_GAUGE_STALE_COLOUR : gColour;
+		lv_obj_set_style_text_color(objects.param_val, lv_color_hex(colour),
+									LV_PART_MAIN | LV_STATE_DEFAULT);
+		lv_obj_set_style_arc_color(objects.gauge_arc, lv_color_hex(colour),
+									LV_PART_INDICATOR | LV_STATE_DEFAULT);
+		lastUpdate.gStale = gUpdate->gStale;
+	}
 	if (gUpdate->gVbat != lastUpdate.gVbat) {
 		char buff[UI_GAUGE_VBAT_BUFF_LEN];
 		sprintf(buff, "%.1fV", gUpdate->gVbat);
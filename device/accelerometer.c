@@ -6,6 +6,7 @@
  */
 
 #include <accelerometer.h>
+#include <dgas_time.h>
 #include <stm32f7xx.h>
 #include <stdbool.h>
 #include <i2c.h>
@@ -382,6 +383,7 @@ DeviceStatus accelerometer_get_update(AccelData* data) {
 	data->accX = accData[0];
 	data->accY = accData[1];
 	data->accZ = accData[2];
+	data->time = dgas_time_us();
 	return DEV_OK;
 }
 
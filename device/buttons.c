@@ -6,6 +6,7 @@
  */
 
 #include <buttons.h>
+#include <dgas_time.h>
 
 // debounce tick for select button
 static uint32_t lastSel;
@@ -66,15 +67,15 @@ void EXTI15_10_IRQHandler(void) {
 
 	if ((EXTI->PR & EXTI_PR_PR14) == EXTI_PR_PR14) {
 		EXTI->PR |= EXTI_PR_PR14;
-		if (HAL_GetTick() > lastNav + BTN_DEBOUNCE_INTERVAL) {
+		if (dgas_time_ms() - lastNav > BTN_DEBOUNCE_INTERVAL) {
 			xEventGroupSetBitsFromISR(eventButtons, EVT_BUTTON_SEL_PRESSED, 0);
-			lastNav = HAL_GetTick();
+			lastNav = dgas_time_ms();
 		}
 	} else if ((EXTI->PR & EXTI_PR_PR15) == EXTI_PR_PR15) {
 		EXTI->PR |= EXTI_PR_PR15;
-		if (HAL_GetTick() > lastSel + BTN_DEBOUNCE_INTERVAL) {
+		if (dgas_time_ms() - lastSel > BTN_DEBOUNCE_INTERVAL) {
 			xEventGroupSetBitsFromISR(eventButtons, EVT_BUTTON_NAV_PRESSED, 0);
-			lastSel = HAL_GetTick();
+			lastSel = dgas_time_ms();
 		}
 	}
 }
@@ -10,6 +10,7 @@
  */
 
 #include <dgas_adc.h>
+#include <dgas_time.h>
 
 // ADC Handle
 static ADC_HandleTypeDef adcHandle;
@@ -135,15 +136,16 @@ float adc_conv_raw_to_voltage(uint16_t raw) {
  * Return: None
  * */
 void task_adc(void) {
-	float voltage;
+	AdcSample sample;
 	// init hardware and start conversions
 	adc_hardware_init();
 	HAL_ADC_Start(&adcHandle);
 
-	queueADC = xQueueCreate(ADC_QUEUE_LENGTH, sizeof(float));
+	queueADC = xQueueCreate(ADC_QUEUE_LENGTH, sizeof(AdcSample));
 	for (;;) {
-		voltage = adc_conv_raw_to_voltage(lastConv);
-		xQueueSend(queueADC, &voltage, 10);
+		sample.voltage = adc_conv_raw_to_voltage(lastConv);
+		sample.time = dgas_time_us();
+		xQueueSend(queueADC, &sample, 10);
 		vTaskDelay(100);
 	}
 }
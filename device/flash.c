@@ -9,6 +9,7 @@
 #include <flash.h>
 #include <device.h>
 #include <stdbool.h>
+#include <string.h>
 
 #ifdef FLASH_USE_FREERTOS
 // stores task handle for flash memory controller
@@ -848,6 +849,9 @@ static DeviceStatus flash_handle_request(FlashReq* req) {
 		case FLASH_CMD_ERASE:
 			stat = flash_chip_erase();
 			break;
+		case FLASH_CMD_ERASE_SECTOR:
+			stat = flash_sector_erase(req->rAddr);
+			break;
 		default:
 			stat = DEV_ERROR;
 			break;
@@ -896,6 +900,48 @@ void flash_free_buffer(FlashBuf* ptr) {
 	xQueueSend(queueFlashBuf, &ptr, 0);
 }
 
+/**
+ * Make a request to flash task and wait for it to complete. Data is copied through a
+ * flash buffer so caller's data needn't outlive the request.
+ *
+ * cmd: Flash command
+ * addr: Flash address
+ * data: Data to write or buffer to store read data (NULL for erase)
+ * size: Number of bytes to read or write (at most sizeof(FlashBuf))
+ *
+ * Return: Status indicating success or failure
+ * */
+DeviceStatus flash_request(FlashCMD cmd, uint32_t addr, void* data, uint32_t size) {
+	FlashReq req = {0};
+	FlashBuf* buf;
+	DeviceStatus stat;
+
+	if ((queueFlashReq == NULL) || (size > sizeof(FlashBuf))) {
+		return DEV_ERROR;
+	}
+	if ((buf = flash_alloc_buffer(FLASH_ALLOC_TIMEOUT_100)) == NULL) {
+		return DEV_ERROR;
+	}
+	if (cmd == FLASH_CMD_WRITE) {
+		memcpy(buf, data, size);
+	}
+	req.rCmd = cmd;
+	req.rAddr = addr;
+	req.rBuf = buf;
+	req.rSize = size;
+	req.rCaller = xTaskGetCurrentTaskHandle();
+
+	xQueueSend(queueFlashReq, &req, portMAX_DELAY);
+	// flash task notifies with status of request
+	stat = ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+	if ((stat == DEV_OK) && (cmd == FLASH_CMD_READ)) {
+		memcpy(data, buf, size);
+	}
+	flash_free_buffer(buf);
+	return stat;
+}
+
 /**
  * Thread function for flash controller task
  *
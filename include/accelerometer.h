@@ -126,6 +126,7 @@ typedef struct {
 	float accX;
 	float accY;
 	float accZ;
+	uint64_t time;
 }AccelData;
 
 typedef struct {
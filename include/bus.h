@@ -16,12 +16,16 @@
 #define BUS_REQUEST_MAX DGAS_CONFIG_BUS_REQUEST_MAX
 #endif /* DGAS_CONFIG_BUS_REQUEST_MAX */
 
+// large enough for a KWP frame with a separate length byte (up to 255 data bytes)
 #ifndef DGAS_CONFIG_BUS_RESPONSE_MAX
-#define BUS_RESPONSE_MAX 64
+#define BUS_RESPONSE_MAX 256
 #else
 #define BUS_RESPONSE_MAX DGAS_CONFIG_BUS_RESPONSE_MAX
 #endif /* DGAS_CONFIG_BUS_RESPONSE_MAX */
 
+// most frames (e.g. from several ECUs) a single response can be assembled from
+#define BUS_RESPONSE_FRAMES_MAX		8
+
 #if (BUS_RESPONSE_MAX >= BUS_REQUEST_MAX)
 #define BUS_TRANSACTION_MAX		BUS_RESPONSE_MAX
 #else
@@ -68,21 +72,42 @@ typedef struct {
 	uint32_t timeout;
 } BusRequest;
 
+/**
+ * BusFrame
+ *
+ * Describes one frame a response was assembled from
+ *
+ * src: Source address of ECU which sent frame
+ * offset: Index of frame's first data byte within response data
+ * len: Number of data bytes in frame
+ * */
+typedef struct {
+	uint32_t src;
+	uint16_t offset;
+	uint16_t len;
+} BusFrame;
+
 /**
  * BusResponse
  *
  * Stores the response of OBD bus to a request
  *
- * data: Response
+ * data: Response, data of each frame back to back in the order they arrived
  * dataLen: Length of response
  * status: Status of response
+ * frames: Frames response was assembled from
+ * frameCount: Number of frames (0 if bus doesn't tag frames, data is a single message)
  * */
 typedef struct {
 	uint8_t data[BUS_RESPONSE_MAX];
 	uint32_t dataLen;
 	BusStatus status;
+	BusFrame frames[BUS_RESPONSE_FRAMES_MAX];
+	uint32_t frameCount;
 } BusResponse;
 
+typedef BusStatus (*BusTransaction) (BusRequest*, BusResponse*);
+
 /**
  * BusHandle
  *
@@ -91,11 +116,14 @@ typedef struct {
  * bid: Bus ID (BUS_ID_KWP etc.)
  * outBound: Pointer to queue for making requests on the bus
  * inBound: Pointer to queue for receiving responses to requests
+ * transact: Bus driver function to make a request and get response directly from
+ * 			 the calling task (NULL if requests must go through bus task queues)
  * */
 typedef struct {
 	BusID bid;
 	QueueHandle_t* outBound;
 	QueueHandle_t* inBound;
+	BusTransaction transact;
 } BusHandle;
 
 #endif /* INC_BUS_H_ */
@@ -51,6 +51,19 @@
 #define ADC_IO_SUPPLY_VOLTAGE			3.3
 
 
+/**
+ * AdcSample
+ *
+ * Supply voltage measurement
+ *
+ * voltage: Supply voltage (V)
+ * time: Time measurement was taken (us)
+ * */
+typedef struct {
+	float voltage;
+	uint64_t time;
+}AdcSample;
+
 /***************************** FreeRTOS ****************************/
 
 #define DGAS_TASK_ADC_PRIORITY		(tskIDLE_PRIORITY + 3)
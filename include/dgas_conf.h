@@ -12,8 +12,12 @@
 
 #define DGAS_CONFIG_USE_DOUBLE_BUFFERING
 
-#define DGAS_CONFIG_BUS_RESPONSE_MAX 64
+// KWP frames carry up to 255 data bytes and ISO-TP responses are reassembled whole
+#define DGAS_CONFIG_BUS_RESPONSE_MAX 256
 #define DGAS_CONFIG_BUS_REQUEST_MAX 64
 
+// back timebase with a virtual clock instead of DWT cycle counter (host builds)
+//#define DGAS_CONFIG_TIME_VIRTUAL
+
 
 #endif /* DGAS_CONF_H_ */
@@ -13,7 +13,18 @@
 #include <dgas_obd.h>
 
 #define DGAS_DEBUG_MSG_LEN						128
+// most bytes of a transaction kept for display, debug window can't show more anyway
+#define DGAS_DEBUG_DATA_MAX						64
 #define DGAS_DEBUG_BUFF_LEN						128
+// longest note which can be logged (including null terminator)
+#define DGAS_DEBUG_NOTE_LEN						64
+
+// CAN traffic profile is shown in place of the message log when selected (hold resume) or
+// while CAN is listening only, busiest IDs first
+#define DGAS_DEBUG_PROFILE_PERIOD				1000
+#define DGAS_DEBUG_PROFILE_LINES				12
+#define DGAS_DEBUG_PROFILE_LINE_LEN				48
+#define DGAS_DEBUG_PROFILE_TEXT_LEN				((DGAS_DEBUG_PROFILE_LINES + 2) * DGAS_DEBUG_PROFILE_LINE_LEN)
 
 /************************ FreeRTOS *********************/
 
@@ -27,11 +38,13 @@ extern QueueHandle_t queueDebug;
 /******************* Message Logging *******************/
 
 typedef struct {
-	uint8_t data[BUS_TRANSACTION_MAX];
+	uint8_t data[DGAS_DEBUG_DATA_MAX];
 	uint32_t dataLen;
 	BusStatus status;
 	BusID bid;
 	BusDirection direction;
+	// text note to show instead of a bus transaction (empty if none)
+	char note[DGAS_DEBUG_NOTE_LEN];
 }DebugMsg;
 // macros for logging debug messages, should be called by bus control tasks
 #define DGAS_DEBUG_LOG_MSG(data, len, status, bid, dir)			dgas_debug_log_msg(data, len, status, bid, dir)
@@ -44,16 +57,20 @@ typedef struct {
 #define DGAS_DEBUG_LOG_MSG_ERROR_TRANSMIT(bid, status)			DGAS_DEBUG_LOG_MSG_ERROR(bid, status, BUS_DIR_TRANSMIT)
 #define DGAS_DEBUG_LOG_MSG_ERROR_RECEIVE(bid, status)			DGAS_DEBUG_LOG_MSG_ERROR(bid, status, BUS_DIR_RECEIVE)
 
+#define DGAS_DEBUG_LOG_NOTE(bid, note)							dgas_debug_log_note(bid, note)
+
 
 /************************ Prototypes *********************/
 
 TaskHandle_t task_dgas_debug_get_handle(void);
 void dgas_debug_pause(void);
 void dgas_debug_resume(void);
+void dgas_debug_toggle_view(void);
 void dgas_debug_add_str(char* dest, char* add);
 void dgas_debug_log_byte(uint8_t byte);
 void dgas_debug_add_newline(char* dest);
 void dgas_debug_log_msg(uint8_t* data, uint32_t dataLen, BusStatus status, BusID bid, BusDirection direction);
+void dgas_debug_log_note(BusID bid, const char* note);
 OBDMode dgas_debug_get_obd_mode(uint8_t* data);
 void dgas_debug_add_obd_mode(char* dest, OBDMode mode);
 void dgas_debug_add_header(char* dest, BusStatus status, BusDirection direction);
@@ -62,6 +79,7 @@ void dgas_debug_add_error(char* dest, BusStatus status);
 void dgas_debug_build_message(char* message, DebugMsg* msg);
 void dgas_debug_log_message(char* message);
 void dgas_debug_flush(void);
+void dgas_debug_show_can_profile(void);
 void task_dgas_debug_init(void);
 
 #endif /* DGOS_INCLUDE_DGAS_DEBUG_H_ */
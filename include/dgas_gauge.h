@@ -39,19 +39,25 @@ typedef struct {
 }GaugeParam;
 
 /**
- * GaugeUpdate
+ * GaugePredict
  *
- * Stores information needed to update the gauge with latest readings
+ * Prediction stage between live data table and gauge UI. Dead-reckons the value from
+ * the last two samples so the needle moves smoothly between (slow) bus samples.
+ * Values are fixed point milli-units, times are live data timestamps (ms).
  *
- * paramVal: Most recent value of parameter taken from OBD-II bus
- * bStat: Most recent bus status
- * vBat: Battery voltage
+ * prevValue: Value of second most recent sample
+ * prevTime: Time of second most recent sample (0 if none)
+ * lastValue: Value of most recent sample
+ * lastTime: Time of most recent sample (0 if none)
+ * shown: Value currently shown on gauge
  * */
 typedef struct {
-	int paramVal;
-	char obdStat[GAUGE_OBD_STATUS_BUFF_LEN];
-	float vBat;
-}GaugeUpdate;
+	int32_t prevValue;
+	uint32_t prevTime;
+	int32_t lastValue;
+	uint32_t lastTime;
+	int32_t shown;
+}GaugePredict;
 
 /**
  * GaugeState
@@ -63,6 +69,10 @@ typedef struct {
  * vBat: Current battery voltage
  * paramMax: Current maximum value of parameter
  * param: Pointer to currently active gauge parameter
+ * liveSeq: Sequence number of last live data value shown
+ * stale: True if value shown is stale
+ * predict: Prediction stage of parameter value
+ * arcVal: Current arc position (1/UI_GAUGE_ARC_SCALE units)
  * */
 typedef struct {
 	int paramVal;
@@ -70,9 +80,12 @@ typedef struct {
 	float vBat;
 	int paramMax;
 	const GaugeParam* param;
+	uint32_t liveSeq;
+	bool stale;
+	GaugePredict predict;
+	int arcVal;
 }GaugeState;
 
-extern QueueHandle_t queueGaugeUpdate;
 extern EventGroupHandle_t eventGaugeParam;
 
 // event definitions
@@ -90,6 +103,15 @@ extern EventGroupHandle_t eventGaugeParam;
 										EVT_GAUGE_PARAM_BOOST 			| 	EVT_GAUGE_PARAM_INTAKE_TEMP	 | \
 										EVT_GAUGE_PARAM_MAF				| 	EVT_GAUGE_PARAM_FUEL_PRESSURE
 
+// rate (mHz) at which the gauge parameter is polled by the OBD acquisition scheduler
+#define GAUGE_POLL_RATE					10000
+// period (ms) at which gauge is redrawn, independent of rate parameter is sampled at
+#define GAUGE_FRAME_PERIOD				20
+// longest time (ms) value is extrapolated past most recent sample
+#define GAUGE_PREDICT_HORIZON			500
+// needle moves 1/GAUGE_PREDICT_SMOOTHING of the way to predicted value each frame
+#define GAUGE_PREDICT_SMOOTHING			3
+
 #define TASK_DGAS_GAUGE_PRIORITY		(tskIDLE_PRIORITY + 4)
 #define TASK_DGAS_GAUGE_STACK_SIZE		(configMINIMAL_STACK_SIZE * 8)
 
@@ -97,6 +119,7 @@ TaskHandle_t task_dgas_get_handle_gauge(void);
 void gauge_animate(void);
 void gauge_load_param(const GaugeParam* param);
 void gauge_update(void);
+void gauge_set_obd_status_string(char* dest, OBDStatus status);
 void gauge_init(void);
 void task_dgas_gauge_init(void);
 
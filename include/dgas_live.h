@@ -0,0 +1,70 @@
+/*
+ * dgas_live.h
+ *
+ *  Created on: 18 Oct. 2026
+ *      Author: rhett
+ */
+
+#ifndef DGOS_INCLUDE_DGAS_LIVE_H_
+#define DGOS_INCLUDE_DGAS_LIVE_H_
+
+#include <dgas_types.h>
+#include <dgas_obd.h>
+#include <stdbool.h>
+
+// channels 0x00 - 0xFF hold mode 01 PIDs, channels after those are for values which
+// don't come from a mode 01 PID
+#define LIVE_CHANNEL_PID_COUNT				0x100
+#define LIVE_CHANNEL_EXTRA_COUNT			32
+#define LIVE_CHANNEL_COUNT					(LIVE_CHANNEL_PID_COUNT + LIVE_CHANNEL_EXTRA_COUNT)
+#define LIVE_CHANNEL_PID(pid)				((LiveChannel) (pid))
+#define LIVE_CHANNEL_EXTRA(n)				((LiveChannel) (LIVE_CHANNEL_PID_COUNT + (n)))
+
+// age returned for a channel which has never been written
+#define LIVE_AGE_NEVER						0xFFFFFFFF
+// values older than this (in ms) should be shown as stale
+#define LIVE_STALE_AGE						1000
+
+typedef uint16_t LiveChannel;
+
+/**
+ * LiveValue
+ *
+ * Latest value of a live data channel
+ *
+ * value: Converted value (fixed point milli-units for PID channels)
+ * timestamp: Time value was sampled (ms)
+ * status: Status of most recent attempt to sample channel
+ * seq: Number of times channel has been written (0 if never written)
+ * */
+typedef struct {
+	int32_t value;
+	uint32_t timestamp;
+	OBDStatus status;
+	uint32_t seq;
+} LiveValue;
+
+/**
+ * LiveSlot
+ *
+ * Slot of live data table. The writer fills the copy not currently being read then
+ * publishes it by incrementing seq, readers retry if seq changes while they read.
+ * Each slot must only have a single writer.
+ *
+ * seq: Write count, copy[seq & 1] is the latest value
+ * copy: Two copies of value
+ * */
+typedef struct {
+	volatile uint32_t seq;
+	LiveValue copy[2];
+} LiveSlot;
+
+// Function prototypes
+void dgas_live_write(LiveChannel ch, int32_t value, OBDStatus status, uint32_t timestamp);
+void dgas_live_write_status(LiveChannel ch, OBDStatus status);
+bool dgas_live_read(LiveChannel ch, LiveValue* dest);
+uint32_t dgas_live_age(LiveChannel ch);
+bool dgas_live_is_stale(LiveChannel ch, uint32_t maxAge);
+uint32_t dgas_live_now(void);
+
+#endif /* DGOS_INCLUDE_DGAS_LIVE_H_ */
@@ -9,20 +9,21 @@
 #define INC_DGAS_OBD_H_
 
 #include <dgas_types.h>
+#include <iso15765.h>
 #include <bus.h>
 
 extern QueueHandle_t queueOBDRequest;
-extern QueueHandle_t queueOBDResponse;
 extern EventGroupHandle_t eventOBDChangeBus;
 
-#define OBD_BUS_REQUEST_MAX 64
-#define OBD_BUS_RESPONSE_MAX 64
+#define OBD_BUS_REQUEST_MAX BUS_REQUEST_MAX
+#define OBD_BUS_RESPONSE_MAX BUS_RESPONSE_MAX
 
 typedef enum {
 	OBD_OK,
 	OBD_INIT,
 	OBD_TIMEOUT,
-	OBD_ERROR
+	OBD_ERROR,
+	OBD_UNSUPPORTED
 }OBDStatus;
 
 // OBD modes
@@ -75,18 +76,6 @@ typedef enum {
 #define OBD_PID_VEHICLE_INFO_ECU_NAME 						  0x0A
 #define OBD_PID_VEHICLE_INFO_COMPRESSION_IGNITION_PERFORMANCE 0x0B
 
-// conversion macros from OBD-II A,B,C,D bytes to parameter value
-
-#define OBD_CONV_ENGINE_LOAD(A)			(A / 2.55)
-#define OBD_CONV_COOLANT_TEMP(A)		(A - 40)
-#define OBD_CONV_FUEL_TRIM(A)			((A / 1.28) - 100)
-#define OBD_CONV_FUEL_PRESSURE(A)		(3 * A)
-#define OBD_CONV_ENGINE_SPEED(A, B)		((256 * A + B) / 4)
-#define OBD_CONV_TIMING_ADVANCE(A)		((A / 2) - 64)
-#define OBD_CONV_INTAKE_AIR_TEMP(A)		(A - 40)
-#define OBD_CONV_MAF(A, B)				((256 * A + B) / 100)
-#define OBD_CONV_THROTTLE_POSITION(A)	(A / 2.55)
-
 // index of OBD mode, pid etc within a standard OBD-II response packet
 // Responses will take form such as [Mode + 0x40, pid, A, B, C, D] (typical PID response)
 // where A, B, C, D are the four data bytes which are to be converted to actual PID value
@@ -94,26 +83,298 @@ typedef enum {
 #define OBD_RESPONSE_PID_INDEX				1
 #define OBD_RESPONSE_DATA_START_INDEX		2
 #define OBD_RESPONSE_GET_NUMBER_OF_DATA_BYTES(len)		(len - 2)
+// header bytes repeated at the start of each message of a multi-message response,
+// [mode, pid, message number] for mode 09, [mode] for DTC modes and [mode, pid] otherwise
+#define OBD_RESPONSE_HEADER_LEN				2
+#define OBD_RESPONSE_HEADER_LEN_INFO		3
+#define OBD_RESPONSE_HEADER_LEN_DTC			1
+
+// positive responses have mode + 0x40, negative responses have form [0x7F, mode, NRC]
+#define OBD_RESPONSE_MODE_OFFSET			0x40
+#define OBD_RESPONSE_NEGATIVE				0x7F
+
+// maximum number of data bytes for a single mode 01 PID (PID 0x64 has 5)
+#define OBD_PID_DATA_MAX					5
+
+// batched (multi-PID) mode 01 requests, multi-frame responses are reassembled by ISO-TP
+#define OBD_BATCH_PID_MAX					OBD_CAN_PID_BATCH_MAX
+#define OBD_BATCH_RESPONSE_MAX				OBD_BUS_RESPONSE_MAX
+// number of consecutive rejected batches before falling back to single requests
+#define OBD_BATCH_REJECT_LIMIT				3
+
+// priority request queue constants
+#define OBD_INTAKE_QUEUE_LENGTH				8
+#define OBD_PENDING_MAX						4
+// class is served ahead of higher classes once it has been passed over this many times
+#define OBD_STARVATION_LIMIT				8
+
+// number of mode 01 PIDs held in value cache
+#define OBD_CACHE_PID_COUNT					0x100
+
+// acquisition scheduler constants
+#define OBD_SCHED_CHANNEL_MAX				16
+#define OBD_SCHED_SUBSCRIBER_MAX			4
+// longest time controller will block waiting for requests when no channel is due
+#define OBD_SCHED_IDLE_WAIT					10
+#define OBD_SCHED_TIMEOUT					100
+// period is clamped to at least one tick so rates above the tick rate can't yield 0
+#define OBD_SCHED_RATE_TO_PERIOD(mHz)		((pdMS_TO_TICKS(1000000 / (mHz)) > 0) ? \
+											pdMS_TO_TICKS(1000000 / (mHz)) : 1)
+#define OBD_SCHED_PERIOD_TO_RATE(ticks)		(1000000 / ((ticks) * portTICK_PERIOD_MS))
+// adaptive polling. Channel backs off (period doubles) each time its value hasn't moved
+// by at least its resolution for OBD_SCHED_STILL_SAMPLES samples, up to
+// OBD_SCHED_BACKOFF_MAX times its requested period
+#define OBD_SCHED_STILL_SAMPLES				10
+#define OBD_SCHED_BACKOFF_MAX				8
+// channel which has moved for OBD_SCHED_MOVING_SAMPLES samples in a row may be polled
+// up to OBD_SCHED_BOOST_MAX times its requested rate using bandwidth freed by backoff
+#define OBD_SCHED_MOVING_SAMPLES			3
+#define OBD_SCHED_BOOST_MAX					2
+// UDS periodic streaming. Channels requested at or above these rates (mHz) are streamed
+// by ECU at its fast, medium or slow periodic rate instead of being polled
+#define OBD_UDS_PERIODIC_FAST				10000
+#define OBD_UDS_PERIODIC_MEDIUM				4000
+#define OBD_UDS_PERIODIC_SLOW				1000
+
+// task notification index used to signal completion of OBD requests. Flash requests use
+// index 0 and must never share it with bus traffic
+#if (configTASK_NOTIFICATION_ARRAY_ENTRIES < 3)
+#error "configTASK_NOTIFICATION_ARRAY_ENTRIES must be >= 3"
+#endif
+#define OBD_NOTIFY_INDEX					1
 
 typedef uint8_t OBDPid;
 
+// OBD request priority classes, lower value is served first
+typedef enum {
+	OBD_PRIORITY_INTERACTIVE,
+	OBD_PRIORITY_ALARM,
+	OBD_PRIORITY_LOGGING,
+	OBD_PRIORITY_BACKGROUND,
+	OBD_PRIORITY_COUNT
+}OBDPriority;
+
+/**
+ * OBDResponse
+ *
+ * Result of an OBD request
+ *
+ * id: ID of request this is the result of
+ * mode: OBD mode of request
+ * data: Response data (excludes mode and PID bytes)
+ * dataLen: Number of data bytes
+ * status: Status of request
+ * complete: Set by controller once the rest of the result is stored in the reply slot
+ * */
+typedef struct {
+	uint32_t id;
+	OBDMode mode;
+	uint8_t data[OBD_BUS_RESPONSE_MAX];
+	uint32_t dataLen;
+	OBDStatus status;
+	volatile bool complete;
+} OBDResponse;
+
+/**
+ * OBDRequest
+ *
+ * Request made to the OBD controller. When the request is complete the controller
+ * writes the result to the reply slot, marks it complete then notifies the caller.
+ *
+ * mode: OBD mode
+ * pid: PID to request (if applicable)
+ * timeout: Time to wait for bus response
+ * id: Request ID (assigned by dgas_obd_request_async)
+ * caller: Task to notify on completion (NULL for no notification)
+ * reply: Reply slot to store result, must remain valid until request completes
+ * issued: Tick count at which request was made
+ * priority: Priority class of request
+ * maxWait: Ticks request may wait before being sent on bus, request is dropped with
+ * 			OBD_TIMEOUT status once this passes (0 for no deadline)
+ * maxAge: Oldest (ticks) a cached mode 01 value may be to be used instead of making
+ * 			a bus transaction (0 to always use bus)
+ * */
 typedef struct {
 	OBDMode mode;
 	OBDPid pid;
 	uint32_t timeout;
+	uint32_t id;
+	TaskHandle_t caller;
+	OBDResponse* reply;
+	TickType_t issued;
+	OBDPriority priority;
+	uint32_t maxWait;
+	uint32_t maxAge;
 } OBDRequest;
 
+/**
+ * OBDCacheEntry
+ *
+ * Most recently received data of a mode 01 PID
+ *
+ * data: Raw PID data bytes (A, B, C, D...)
+ * dataLen: Number of raw data bytes (0 if PID has never been received)
+ * tick: Tick count at which data was received
+ * */
 typedef struct {
-	OBDMode mode;
-	uint8_t data[OBD_BUS_RESPONSE_MAX];
+	uint8_t data[OBD_PID_DATA_MAX];
 	uint32_t dataLen;
+	TickType_t tick;
+} OBDCacheEntry;
+
+/**
+ * OBDCacheStats
+ *
+ * Statistics of mode 01 value cache and request merging
+ *
+ * hits: Number of requests served from cache
+ * misses: Number of mode 01 requests which needed a bus transaction
+ * merged: Number of requests completed by another identical request's transaction
+ * */
+typedef struct {
+	uint32_t hits;
+	uint32_t misses;
+	uint32_t merged;
+} OBDCacheStats;
+
+/**
+ * OBDPendingClass
+ *
+ * Requests of a single priority class waiting to be sent on the bus (oldest first)
+ *
+ * req: Pending requests
+ * count: Number of pending requests
+ * skipped: Consecutive times class has been passed over while it had pending requests
+ * */
+typedef struct {
+	OBDRequest req[OBD_PENDING_MAX];
+	uint32_t count;
+	uint32_t skipped;
+} OBDPendingClass;
+
+/**
+ * OBDPriorityStats
+ *
+ * Statistics of a request priority class
+ *
+ * served: Number of requests sent on bus
+ * dropped: Number of requests dropped as their deadline passed
+ * overflow: Number of requests rejected as class was full
+ * starved: Number of times class was passed over while it had pending requests
+ * maxWait: Longest time (ticks) a served request waited before being sent
+ * */
+typedef struct {
+	uint32_t served;
+	uint32_t dropped;
+	uint32_t overflow;
+	uint32_t starved;
+	uint32_t maxWait;
+} OBDPriorityStats;
+
+/**
+ * OBDLatencyStats
+ *
+ * Request to result latency of requests made through the OBD controller
+ *
+ * count: Number of requests completed
+ * total: Sum of latencies in ticks
+ * max: Largest latency in ticks
+ * last: Latency of most recent request in ticks
+ * */
+typedef struct {
+	uint32_t count;
+	uint32_t total;
+	uint32_t max;
+	uint32_t last;
+} OBDLatencyStats;
+
+/**
+ * OBDChannel
+ *
+ * Stores the state of a PID being periodically polled by the acquisition scheduler
+ *
+ * pid: Mode 01 PID being polled
+ * rate: Requested poll rate in mHz
+ * period: Poll period in ticks (derived from rate)
+ * adaptPeriod: Poll period in ticks currently used, adapted from signal dynamics
+ * nextDue: Tick count at which the channel is next due to be polled
+ * added: Tick count at which the channel was added (used to calculate achieved rate)
+ * samples: Number of successful samples taken
+ * errors: Number of failed polls
+ * refs: Number of consumers which have requested the channel
+ * lastValue: Value of last successful sample
+ * still: Consecutive samples where value hasn't moved by at least its resolution
+ * moving: Consecutive samples where value has moved by at least its resolution
+ * ecu: Response ID of ECU which answers PID on CAN, 0 until a functional poll finds it
+ * */
+typedef struct {
+	OBDPid pid;
+	uint32_t rate;
+	TickType_t period;
+	TickType_t adaptPeriod;
+	TickType_t nextDue;
+	TickType_t added;
+	uint32_t samples;
+	uint32_t errors;
+	uint32_t refs;
+	int32_t lastValue;
+	uint32_t still;
+	uint32_t moving;
+	uint32_t ecu;
+} OBDChannel;
+
+/**
+ * OBDSample
+ *
+ * A single result published by the acquisition scheduler
+ *
+ * pid: PID which was polled
+ * status: Status of the poll
+ * data: Raw PID data bytes (A, B, C, D...)
+ * dataLen: Number of raw data bytes
+ * value: Converted PID value (fixed point milli-units, see dgas_pid.h)
+ * tick: Tick count at which sample was taken
+ * time: Time sample was received (us)
+ * ecu: Response ID of ECU which answered on CAN (0 if unknown)
+ * */
+typedef struct {
+	OBDPid pid;
 	OBDStatus status;
-} OBDResponse;
+	uint8_t data[OBD_PID_DATA_MAX];
+	uint32_t dataLen;
+	int32_t value;
+	TickType_t tick;
+	uint64_t time;
+	uint32_t ecu;
+} OBDSample;
+
+/**
+ * OBDChannelReport
+ *
+ * Report on the requested and achieved poll rate of a scheduled channel
+ *
+ * pid: PID of channel
+ * requested: Requested poll rate in mHz
+ * achieved: Achieved poll rate in mHz
+ * adapted: Poll rate in mHz currently used after adapting to signal dynamics
+ * samples: Number of successful samples taken
+ * errors: Number of failed polls
+ * */
+typedef struct {
+	OBDPid pid;
+	uint32_t requested;
+	uint32_t achieved;
+	uint32_t adapted;
+	uint32_t samples;
+	uint32_t errors;
+} OBDChannelReport;
+
+typedef void (*OBDSampleCallback) (OBDSample*);
 
 
 #define TASK_BUS_CONTROL_PRIORITY 		(tskIDLE_PRIORITY + 3)
-#define TASK_BUS_CONTROL_STACK_SIZE 	(configMINIMAL_STACK_SIZE * 4)
-#define TASK_BUS_CONTROL_QUEUE_LENGTH 	5
+// bus transactions are made on controller's stack and responses can hold several frames
+#define TASK_BUS_CONTROL_STACK_SIZE 	(configMINIMAL_STACK_SIZE * 8)
 
 #define EVT_OBD_BUS_CHANGE_KWP 			(1 << 0)
 #define EVT_OBD_BUS_CHANGE_9141 		(1 << 1)
@@ -122,15 +383,25 @@ typedef struct {
 
 // Function prototypes
 TaskHandle_t task_dgas_obd_get_handle(void);
-BaseType_t obd_take_semaphore(void);
-void obd_give_semaphore(void);
 BusID obd_get_active_bus(void);
 int obd_pid_convert(OBDPid pid, uint8_t* data);
+uint8_t obd_pid_data_len(OBDPid pid);
 uint32_t dgas_obd_get_pid(OBDPid pid, OBDMode mode, uint8_t* dest, uint32_t timeout);
+uint32_t dgas_obd_get_pids(OBDPid* pids, uint32_t count, OBDSample* dest, uint32_t timeout);
 uint32_t dgas_obd_get_dtc(uint8_t* dest);
 uint32_t dgas_obd_get_vehicle_info(OBDPid pid, uint8_t* dest);
 OBDStatus dgas_obd_handle_request(OBDRequest* req, OBDResponse* resp);
+uint32_t dgas_obd_request_async(OBDRequest* req, OBDResponse* reply);
+OBDStatus dgas_obd_request_wait(OBDResponse* reply, uint32_t timeout);
+OBDStatus dgas_obd_request(OBDRequest* req, OBDResponse* reply);
+void dgas_obd_get_latency(OBDLatencyStats* dest);
+void dgas_obd_get_priority_stats(OBDPriorityStats* dest);
+void dgas_obd_get_cache_stats(OBDCacheStats* dest);
 OBDStatus dgas_obd_bus_change_handler(EventBits_t uxBits);
+OBDStatus dgas_obd_sched_add(OBDPid pid, uint32_t rate);
+OBDStatus dgas_obd_sched_remove(OBDPid pid);
+OBDStatus dgas_obd_sched_subscribe(OBDSampleCallback cb);
+uint32_t dgas_obd_sched_report(OBDChannelReport* dest, uint32_t max);
 void task_dgas_obd_init(void);
 
 #endif /* INC_DGAS_OBD_H_ */
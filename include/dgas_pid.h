@@ -0,0 +1,60 @@
+/*
+ * dgas_pid.h
+ *
+ *  Created on: 18 Oct. 2026
+ *      Author: rhett
+ */
+
+#ifndef DGOS_INCLUDE_DGAS_PID_H_
+#define DGOS_INCLUDE_DGAS_PID_H_
+
+#include <dgas_types.h>
+#include <stdbool.h>
+
+// converted PID values are fixed point with three decimal places (milli-units)
+#define OBD_PID_FIXED_ONE				1000
+#define OBD_PID_FIXED_TO_INT(fixed)		((fixed) / OBD_PID_FIXED_ONE)
+
+// number of mode 01 PIDs described by descriptor table (0x00 - 0xC0). J1979 defines
+// nothing past the 0xC0 supported PIDs bitmap
+#define OBD_PID_DESC_COUNT				0xC1
+
+// PID value is two's complement
+#define OBD_PID_FLAG_SIGNED				(1 << 0)
+// PID is a bitfield/enumeration (e.g. supported PIDs) so has no numeric value
+#define OBD_PID_FLAG_BITFIELD			(1 << 1)
+
+/**
+ * OBDPidDesc
+ *
+ * Describes how to convert a mode 01 PID's data bytes into its value. The rawLen data
+ * bytes from rawStart form the raw value (A, 256A + B or 32 bit) which is converted to
+ * milli-units by value = (raw * mul) / div + offset. PIDs which carry several sensors
+ * lead with a support bitmap so their (first) value starts at byte B.
+ *
+ * len: Number of data bytes ECU responds with
+ * rawLen: Number of data bytes forming the raw value (0 if no numeric value)
+ * flags: OBD_PID_FLAG_* flags
+ * mul: Scale numerator
+ * div: Scale denominator
+ * offset: Offset in milli-units
+ * units: Units of value
+ * rawStart: Index of first data byte forming the raw value
+ * */
+typedef struct {
+	uint8_t len;
+	uint8_t rawLen;
+	uint8_t flags;
+	int32_t mul;
+	int32_t div;
+	int32_t offset;
+	const char* units;
+	uint8_t rawStart;
+} OBDPidDesc;
+
+// Function prototypes
+const OBDPidDesc* obd_pid_desc(uint8_t pid);
+bool obd_pid_convert_fixed(uint8_t pid, uint8_t* data, int32_t* dest);
+int32_t obd_pid_resolution(uint8_t pid);
+
+#endif /* DGOS_INCLUDE_DGAS_PID_H_ */
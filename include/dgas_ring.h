@@ -0,0 +1,44 @@
+/*
+ * dgas_ring.h
+ *
+ *  Created on: 18 Oct. 2026
+ *      Author: rhett
+ */
+
+#ifndef DGOS_INCLUDE_DGAS_RING_H_
+#define DGOS_INCLUDE_DGAS_RING_H_
+
+#include <dgas_types.h>
+#include <stdbool.h>
+
+/**
+ * DRing
+ *
+ * Lock-free single producer single consumer ring buffer of fixed size elements. The
+ * producer (e.g. an ISR) only writes head and the consumer (a task) only writes tail
+ * so no locking is needed as long as there is a single producer and single consumer.
+ *
+ * buff: Element storage (elemSize * count bytes)
+ * elemSize: Size of each element in bytes
+ * count: Number of elements buffer can hold (must be a power of 2)
+ * head: Number of elements ever pushed (written by producer)
+ * tail: Number of elements ever popped (written by consumer)
+ * dropped: Number of elements dropped as ring was full
+ * */
+typedef struct {
+	uint8_t* buff;
+	uint32_t elemSize;
+	uint32_t count;
+	volatile uint32_t head;
+	volatile uint32_t tail;
+	volatile uint32_t dropped;
+} DRing;
+
+// Function prototypes
+void dgas_ring_init(DRing* ring, void* buff, uint32_t elemSize, uint32_t count);
+bool dgas_ring_push(DRing* ring, const void* elem);
+bool dgas_ring_pop(DRing* ring, void* dest);
+uint32_t dgas_ring_used(DRing* ring);
+void dgas_ring_flush(DRing* ring);
+
+#endif /* DGOS_INCLUDE_DGAS_RING_H_ */
@@ -0,0 +1,116 @@
+/*
+ * dgas_signal.h
+ *
+ *  Created on: 18 Oct. 2026
+ *      Author: rhett
+ */
+
+#ifndef DGOS_INCLUDE_DGAS_SIGNAL_H_
+#define DGOS_INCLUDE_DGAS_SIGNAL_H_
+
+#include <dgas_types.h>
+#include <dgas_live.h>
+#include <flash.h>
+#include <stdbool.h>
+
+// signal database is stored in its own flash sector (after vehicle profiles), a header
+// followed by the signal definitions
+#define SIGNAL_FLASH_ADDR					0x00002000
+// value of magic field for a valid database (erased flash reads as 0xFFFFFFFF)
+#define SIGNAL_DB_MAGIC						0x53494744
+
+#define SIGNAL_MAX							64
+// signals are extracted from the 8 data bytes of a classic CAN frame
+#define SIGNAL_FRAME_LEN					8
+#define SIGNAL_LENGTH_MAX					32
+// set in ID of signals (and received frames) using 29-bit IDs
+#define SIGNAL_ID_EXTENDED					(1UL << 31)
+
+// SignalDef flags
+#define SIGNAL_FLAG_BIG_ENDIAN				(1 << 0)
+#define SIGNAL_FLAG_SIGNED					(1 << 1)
+
+/**
+ * SignalDef
+ *
+ * Definition of a broadcast signal as stored in flash (DBC style)
+ *
+ * id: CAN ID of frame signal is in (SIGNAL_ID_EXTENDED set for 29-bit IDs)
+ * start: Start bit, least significant bit for little endian signals and most
+ * 		  significant bit for big endian signals (DBC bit numbering)
+ * length: Number of bits (1 - SIGNAL_LENGTH_MAX)
+ * flags: SIGNAL_FLAG_BIG_ENDIAN, SIGNAL_FLAG_SIGNED
+ * channel: Live data channel to publish value to
+ * divisor: Raw value is multiplied by factor then divided by divisor (must not be 0)
+ * factor: Scale in milli-units per raw bit (before divisor)
+ * offset: Offset added after scaling (milli-units)
+ * */
+typedef struct {
+	uint32_t id;
+	uint8_t start;
+	uint8_t length;
+	uint8_t flags;
+	uint8_t reserved;
+	LiveChannel channel;
+	uint16_t divisor;
+	int32_t factor;
+	int32_t offset;
+} SignalDef;
+
+/**
+ * SignalDbHeader
+ *
+ * Header of signal database in flash
+ *
+ * magic: Marks database as valid (SIGNAL_DB_MAGIC)
+ * count: Number of signal definitions following header
+ * checksum: Sum of all bytes of signal definitions
+ * */
+typedef struct {
+	uint32_t magic;
+	uint32_t count;
+	uint32_t checksum;
+} SignalDbHeader;
+
+_Static_assert(sizeof(SignalDbHeader) + (SIGNAL_MAX * sizeof(SignalDef)) <= FLASH_SECTOR_SIZE,
+		"Signal database too large for flash sector");
+
+/**
+ * SignalExtractor
+ *
+ * Signal definition compiled for decoding. Frame data is read as a 64-bit word (little
+ * or big endian to suit signal) so a signal is extracted with a single shift and mask.
+ *
+ * id: CAN ID of frame signal is in
+ * mask: Mask of signal bits after shifting
+ * shift: Bit position of signal's least significant bit within word
+ * minLen: Frame must have at least this many data bytes to hold signal
+ * flags: SIGNAL_FLAG_BIG_ENDIAN, SIGNAL_FLAG_SIGNED
+ * channel: Live data channel to publish value to
+ * signBit: Mask of signal's sign bit (signed signals only)
+ * factor: Scale in milli-units per raw bit (before divisor)
+ * divisor: Divisor applied after factor
+ * offset: Offset added after scaling (milli-units)
+ * */
+typedef struct {
+	uint32_t id;
+	uint64_t mask;
+	uint8_t shift;
+	uint8_t minLen;
+	uint8_t flags;
+	LiveChannel channel;
+	uint64_t signBit;
+	int32_t factor;
+	int32_t divisor;
+	int32_t offset;
+} SignalExtractor;
+
+// Function prototypes
+DStatus dgas_signal_load(void);
+DStatus dgas_signal_store(const SignalDef* defs, uint32_t count);
+void dgas_signal_clear(void);
+uint32_t dgas_signal_count(void);
+bool dgas_signal_feeds(LiveChannel ch);
+uint32_t dgas_signal_decode(uint32_t id, const uint8_t* data, uint32_t len, uint32_t timestamp);
+
+#endif /* DGOS_INCLUDE_DGAS_SIGNAL_H_ */
@@ -0,0 +1,33 @@
+/*
+ * dgas_time.h
+ *
+ *  Created on: 18 Oct. 2026
+ *      Author: rhett
+ */
+
+#ifndef DGOS_INCLUDE_DGAS_TIME_H_
+#define DGOS_INCLUDE_DGAS_TIME_H_
+
+#include <dgas_conf.h>
+#include <stdint.h>
+
+#ifndef DGAS_CONFIG_TIME_VIRTUAL
+#include <dgas_types.h>
+#endif
+
+// DWT cycle counter unlock key (Cortex-M7 DWT is locked out of reset)
+#define DGAS_TIME_DWT_LAR_KEY		0xC5ACCE55
+#define DGAS_TIME_US_PER_MS			1000
+// period of timer which reads DWT counter, must be well under its wrap time (~19s)
+#define DGAS_TIME_WRAP_CHECK_MS		1000
+
+// Function prototypes
+void dgas_time_init(void);
+uint64_t dgas_time_us(void);
+uint32_t dgas_time_ms(void);
+void dgas_time_delay_us(uint32_t us);
+#ifdef DGAS_CONFIG_TIME_VIRTUAL
+void dgas_time_advance(uint64_t us);
+#endif
+
+#endif /* DGOS_INCLUDE_DGAS_TIME_H_ */
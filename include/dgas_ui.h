@@ -78,6 +78,7 @@ typedef enum {
 
 	UI_EVENT_DEBUG_PAUSE,
 	UI_EVENT_DEBUG_RESUME,
+	UI_EVENT_DEBUG_VIEW,
 
 	UI_EVENT_DTC_GET,
 	UI_EVENT_DTC_CLEAR,
@@ -124,6 +125,7 @@ typedef enum {
 	UI_CMD_GAUGE_ANIMATE,
 
 	UI_CMD_DEBUG_FLUSH,
+	UI_CMD_DEBUG_PROFILE,
 
 	UI_CMD_DTC_SHOW,
 
@@ -137,13 +139,17 @@ typedef enum {
  * Gauge update struct for UI update
  *
  * paramVal: Most recent parameter value
+ * gArc: Arc position (parameter value in 1/UI_GAUGE_ARC_SCALE units)
  * obdStat: OBD status string
  * vBat: Battery voltage
+ * gStale: True if parameter value is stale
  * */
 typedef struct {
 	int gVal;
+	int gArc;
 	char gObd[UI_GAUGE_UPDATE_OBD_STAT_MAX_LEN];
 	float gVbat;
+	bool gStale;
 }UIGaugeUpdate;
 
 /**
@@ -172,6 +178,16 @@ typedef struct {
 	char dStr[UI_DEBUG_FLUSH_STR_LEN];
 }UIDebugFlush;
 
+/**
+ * Debug profile struct. Used to replace contents of debug UI with a report (e.g. CAN
+ * traffic profile).
+ *
+ * pText: Report to show, owner must not change it until the next report is sent
+ * */
+typedef struct {
+	const char* pText;
+}UIDebugProfile;
+
 /**
  * DTC report struct. Used to send DTC codes to UI.
  *
@@ -227,11 +243,14 @@ typedef struct {
 	UISelfTestMemStats sDram;
 }UISelfTestReport;
 
+// bus dropdown option added after the generated ones, CAN bus listening only
+#define UI_SETTINGS_BUS_CAN_LISTEN	4
+
 /**
  * UISettingsState struct.
  *
  * sParam: Parameter selection number on dropdown (0 to 7)
- * sBus: Bus selection number on dropdown (0 to 2)
+ * sBus: Bus selection number on dropdown (0 to 4)
  * */
 typedef struct {
 	uint32_t sParam;
@@ -0,0 +1,91 @@
+/*
+ * dgas_vehicle.h
+ *
+ *  Created on: 18 Oct. 2026
+ *      Author: rhett
+ */
+
+#ifndef DGOS_INCLUDE_DGAS_VEHICLE_H_
+#define DGOS_INCLUDE_DGAS_VEHICLE_H_
+
+#include <dgas_types.h>
+#include <dgas_obd.h>
+#include <flash.h>
+#include <bus.h>
+#include <kwp.h>
+#include <stdbool.h>
+
+// length of vehicle identification number (VIN)
+#define VEHICLE_VIN_LEN						17
+
+// each "supported PIDs" PID (0x00, 0x20, 0x40...) describes support of the next 32 PIDs
+#define VEHICLE_PID_GROUP_SIZE				0x20
+#define VEHICLE_PID_BITMAP_WORDS			(0x100 / VEHICLE_PID_GROUP_SIZE)
+// number of data bytes in a "supported PIDs" response
+#define VEHICLE_PID_BITMAP_LEN				4
+// bit within a group's bitmap indicating the next group is supported
+#define VEHICLE_PID_NEXT_GROUP				(1 << 0)
+
+// profiles are stored in fixed size slots in a single flash sector (after gauge config).
+// New and updated profiles are appended so the newest slot with a given VIN is the current one
+#define VEHICLE_FLASH_ADDR					0x00001000
+#define VEHICLE_FLASH_SLOT_SIZE				128
+#define VEHICLE_FLASH_SLOT_COUNT			(FLASH_SECTOR_SIZE / VEHICLE_FLASH_SLOT_SIZE)
+#define VEHICLE_FLASH_SLOT_ADDR(slot)		(VEHICLE_FLASH_ADDR + ((slot) * VEHICLE_FLASH_SLOT_SIZE))
+// number of other vehicles kept when the sector is full and has to be erased
+#define VEHICLE_FLASH_KEEP					4
+
+// value of magic field for a valid profile (erased flash reads as 0xFFFFFFFF)
+#define VEHICLE_PROFILE_MAGIC				0x56454834
+#define VEHICLE_PROFILE_ERASED				0xFFFFFFFF
+
+// time between discovery attempts if ECU didn't respond
+#define VEHICLE_DISCOVER_RETRY				5000
+#define VEHICLE_DISCOVER_TIMEOUT			200
+
+/**
+ * VehicleProfile
+ *
+ * Information cached about a vehicle (keyed by VIN) so it doesn't have to be
+ * discovered each time the bus is initialised
+ *
+ * magic: Marks profile as valid (VEHICLE_PROFILE_MAGIC)
+ * vin: Vehicle identification number (null terminated)
+ * pidsLive: Supported mode 01 PIDs, one word per group of 32 PIDs
+ * pidsInfo: Supported mode 09 PIDs, one word per group of 32 PIDs
+ * kwpInit: KWP bus initialisation method which worked for vehicle (KWPInitMethod)
+ * kwpTiming: KWP AccessTimingParameters bytes ECU accepted
+ * kwpTimingValid: Non-zero if kwpTiming has been negotiated
+ * canConfig: CAN bit rate and ID length vehicle uses
+ * canConfigValid: Non-zero if canConfig has been detected
+ * checksum: Sum of all preceding bytes of profile
+ * */
+typedef struct {
+	uint32_t magic;
+	char vin[VEHICLE_VIN_LEN + 1];
+	uint32_t pidsLive[VEHICLE_PID_BITMAP_WORDS];
+	uint32_t pidsInfo[VEHICLE_PID_BITMAP_WORDS];
+	uint8_t kwpInit;
+	uint8_t kwpTiming[KWP_ATP_PARAM_COUNT];
+	uint8_t kwpTimingValid;
+	CANConfig canConfig;
+	uint8_t canConfigValid;
+	uint32_t checksum;
+}VehicleProfile;
+
+_Static_assert(sizeof(VehicleProfile) <= VEHICLE_FLASH_SLOT_SIZE, "VehicleProfile too large for flash slot");
+
+// Function prototypes
+DStatus dgas_vehicle_profile_find(const char* vin, VehicleProfile* dest);
+DStatus dgas_vehicle_profile_save(VehicleProfile* profile);
+DStatus dgas_vehicle_discover(uint32_t timeout);
+void dgas_vehicle_clear_active(void);
+bool dgas_vehicle_get_active(VehicleProfile* dest);
+bool dgas_vehicle_pid_supported(OBDMode mode, OBDPid pid);
+KWPInitMethod dgas_vehicle_last_kwp_init(void);
+bool dgas_vehicle_last_kwp_timing(uint8_t* dest);
+void dgas_vehicle_save_kwp_timing(const uint8_t* timing);
+bool dgas_vehicle_last_can_config(CANConfig* dest);
+void dgas_vehicle_save_can_config(const CANConfig* config);
+
+#endif /* DGOS_INCLUDE_DGAS_VEHICLE_H_ */
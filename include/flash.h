@@ -308,7 +308,8 @@ typedef uint8_t FlashBuf[FLASH_REQ_BUFFER_SIZE];
 typedef enum {
 	FLASH_CMD_WRITE,
 	FLASH_CMD_READ,
-	FLASH_CMD_ERASE
+	FLASH_CMD_ERASE,
+	FLASH_CMD_ERASE_SECTOR
 }FlashCMD;
 
 /**
@@ -318,7 +319,7 @@ typedef enum {
  * and write to flash IC.
  *
  * rCmd: Flash command to execute
- * rAddr: Flash address to read/write to (if applicable)
+ * rAddr: Flash address to read/write/erase (if applicable)
  * rBuf: Buffer containing data to write or to store read data (if applicable)
  * rSize: Number of bytes to read or write (if applicable)
  * */
@@ -368,6 +369,7 @@ DeviceStatus flash_self_test_entire(void);
 #ifdef FLASH_USE_FREERTOS
 FlashBuf* flash_alloc_buffer(uint32_t timeout);
 void flash_free_buffer(FlashBuf* ptr);
+DeviceStatus flash_request(FlashCMD cmd, uint32_t addr, void* data, uint32_t size);
 void task_init_flash(void);
 TaskHandle_t task_flash_get_handle(void);
 #endif /* FLASH_USE_FREERTOS */
@@ -10,6 +10,7 @@
 
 #include <dgas_types.h>
 #include <bus.h>
+#include <isotp.h>
 
 extern QueueHandle_t queueCANRequest;
 extern QueueHandle_t queueCANResponse;
@@ -31,8 +32,22 @@ extern QueueHandle_t queueCANResponse;
 #define OBD_CAN_FIFO CAN_RX_FIFO0
 #define OBD_CAN_FILTER_FIFO CAN_FILTER_FIFO0
 #define OBD_CAN_NOTIFICATION CAN_IT_RX_FIFO0_MSG_PENDING
+#define OBD_CAN_RX_IRQN CAN1_RX0_IRQn
+#define OBD_CAN_SCE_IRQN CAN1_SCE_IRQn
 #endif
 
+// error interrupts used to count bus off and error passive events
+#define OBD_CAN_ERROR_NOTIFICATION		(CAN_IT_ERROR | CAN_IT_ERROR_PASSIVE | CAN_IT_BUSOFF)
+
+// CAN1 owns filter banks below this one, CAN2 the rest
+#define OBD_CAN_FILTER_SLAVE_START		14
+// 16-bit list mode filter bank holds four standard IDs, ID is in bits 15:5
+#define OBD_CAN_FILTER_LIST_IDS			4
+#define OBD_CAN_FILTER_STD(id)			((id) << 5)
+#define OBD_CAN_FILTER_BANKS			(OBD_CAN_ECU_COUNT / OBD_CAN_FILTER_LIST_IDS)
+// 32-bit filter register holds extended ID in bits 31:3 and IDE in bit 2
+#define OBD_CAN_FILTER_EXT(id)			(((id) << 3) | CAN_ID_EXT)
+
 // CAN ID to use when requesting data
 #define OBD_CAN_ID_REQUEST 0x7DF
 
@@ -41,13 +56,241 @@ extern QueueHandle_t queueCANResponse;
 #define OBD_CAN_ID_RESPONSE_LOWER 0x7E8
 #define OBD_CAN_ID_RESPONSE_UPPER 0x7EF
 
-#define DGAS_TASK_OBD_CAN_STACK_SIZE (configMINIMAL_STACK_SIZE * 2)
+// physical request ID of an ECU is its response ID less 8 (e.g. 0x7E8 -> 0x7E0)
+#define OBD_CAN_ID_PHYS_OFFSET			8
+
+// 29-bit IDs (normal fixed addressing). Requests to all ECUs are sent to 0x18DB33F1, ECU
+// with address xx is requested at 0x18DAxxF1 and responds from 0x18DAF1xx. ECUs are given
+// an index (and response ID 0x7E8 - 0x7EF within DGOS) in the order they first respond
+#define OBD_CAN_EXT_ID_REQUEST			0x18DB33F1
+#define OBD_CAN_EXT_ID_PHYS(addr)		(0x18DA00F1 | ((addr) << 8))
+#define OBD_CAN_EXT_ID_RESPONSE			0x18DAF100
+#define OBD_CAN_EXT_ID_RESPONSE_MASK	0x1FFFFF00
+#define OBD_CAN_EXT_ADDR(id)			((id) & 0xFF)
+// each ECU's responses are received into their own ring
+#define OBD_CAN_ECU_COUNT				(OBD_CAN_ID_RESPONSE_UPPER - OBD_CAN_ID_RESPONSE_LOWER + 1)
+#define OBD_CAN_ECU_INDEX(id)			((id) - OBD_CAN_ID_RESPONSE_LOWER)
+#define OBD_CAN_ECU_ID(index)			(OBD_CAN_ID_RESPONSE_LOWER + (index))
+// frames each ECU's receive ring holds (must be power of 2)
+#define OBD_CAN_RX_RING_SIZE			16
+// traffic profiler. IDs are tracked in a hash table (must be power of 2), an ID is only
+// looked for in OBD_CAN_PROFILE_PROBE places so the receive interrupt does bounded work
+#define OBD_CAN_PROFILE_IDS				64
+#define OBD_CAN_PROFILE_PROBE			4
+// bus load is measured over windows of this length (us)
+#define OBD_CAN_LOAD_WINDOW_US			1000000
+// bits of a frame besides its data (SOF, ID, control, CRC, ACK, EOF and interframe
+// space), stuff bits aren't counted so load is a slight underestimate
+#define OBD_CAN_FRAME_BITS_STD			47
+#define OBD_CAN_FRAME_BITS_EXT			67
+
+// bit timing. APB1 clock is divided down to 18 time quanta per bit (sync, BS1 of 15 and
+// BS2 of 2) for a sample point of 88.9%, prescaler is picked for the bit rate in use
+#define OBD_CAN_TQ_PER_BIT				18
+
+// bit rate and ID length detection. Each bit rate is listened to in silent mode for
+// OBD_CAN_DETECT_LISTEN (ms), addressing is found by sending mode 01 PID 00 (supported by
+// every ECU) to all ECUs and waiting OBD_CAN_DETECT_TIMEOUT (ms) for a response
+#define OBD_CAN_DETECT_LISTEN			100
+#define OBD_CAN_DETECT_TIMEOUT			100
+#define OBD_CAN_DETECT_SERVICE			0x01
+#define OBD_CAN_DETECT_PID				0x00
+// time between detection attempts while no ECU can be found (ms)
+#define OBD_CAN_DETECT_RETRY			5000
+// requests to all ECUs in a row which time out without any frame being received before
+// bus is detected again
+#define OBD_CAN_DETECT_FAILS			3
+
+// broadcast frames held for decoding in listen only mode (must be power of 2)
+#define OBD_CAN_BROADCAST_RING_SIZE		64
+// UDS periodic frames held for decoding (must be power of 2)
+#define OBD_CAN_PERIODIC_RING_SIZE		32
+
+// task notification index used to wake CAN task on received frames and new requests, and
+// to wake callers once their reply is ready (see kwp.h)
+#if (configTASK_NOTIFICATION_ARRAY_ENTRIES < 3)
+#error "configTASK_NOTIFICATION_ARRAY_ENTRIES must be >= 3"
+#endif
+#define OBD_CAN_NOTIFY_INDEX			2
+
+// ISO-TP flow control advertised to ECUs when receiving multi-frame responses, block
+// size of 0 lets ECU send whole response without waiting
+#ifdef DGAS_CONFIG_OBD_CAN_ISOTP_BLOCK_SIZE
+#define OBD_CAN_ISOTP_BLOCK_SIZE		DGAS_CONFIG_OBD_CAN_ISOTP_BLOCK_SIZE
+#else
+#define OBD_CAN_ISOTP_BLOCK_SIZE		0
+#endif
+#ifdef DGAS_CONFIG_OBD_CAN_ISOTP_STMIN
+#define OBD_CAN_ISOTP_STMIN				DGAS_CONFIG_OBD_CAN_ISOTP_STMIN
+#else
+#define OBD_CAN_ISOTP_STMIN				0
+#endif
+// requests which can be queued for the CAN task. Requests to an ECU which already has one
+// in flight are held in the backlog until its slot is free
+#define OBD_CAN_QUEUE_LENGTH			8
+#define OBD_CAN_BACKLOG_MAX				8
+
+// positive responses have service + 0x40, negative responses have form [0x7F, service, NRC]
+#define OBD_CAN_SID_POSITIVE_OFFSET		0x40
+#define OBD_CAN_SID_NEGATIVE			0x7F
+#define OBD_CAN_NRC_INDEX				2
+// ECU accepted request but needs longer than P2 to respond, request stays in flight for
+// up to OBD_CAN_TIMEOUT_PENDING (ms) longer
+#define OBD_CAN_NRC_RESPONSE_PENDING	0x78
+#define OBD_CAN_TIMEOUT_PENDING			5000
+
+// minimum separation of consecutive frames we send (STmin encoding)
+#define OBD_CAN_ISOTP_TX_STMIN			0
+// time to wait for a free transmit mailbox (ms)
+#define OBD_CAN_TX_TIMEOUT				10
+
+// SAE J1979 allows up to six PIDs in a single mode 01 request on CAN
+#define OBD_CAN_PID_BATCH_MAX			6
+
+#define DGAS_TASK_OBD_CAN_STACK_SIZE (configMINIMAL_STACK_SIZE * 4)
 #define DGAS_TASK_OBD_CAN_PRIORITY   (tskIDLE_PRIORITY + 5)
 
+// bit rates auto detection tries, in the order they are tried
+typedef enum {
+	OBD_CAN_BITRATE_500K,
+	OBD_CAN_BITRATE_250K,
+	OBD_CAN_BITRATE_125K,
+	OBD_CAN_BITRATE_1M,
+	OBD_CAN_BITRATE_COUNT
+} CANBitrate;
+
+/**
+ * CANConfig
+ *
+ * Bus configuration found by auto detection, cached in vehicle profile
+ *
+ * bitrate: Bit rate of bus (CANBitrate)
+ * extended: Non-zero if ECUs use 29-bit IDs
+ * */
+typedef struct {
+	uint8_t bitrate;
+	uint8_t extended;
+} CANConfig;
+
+/**
+ * CANFrame
+ *
+ * Received CAN frame
+ *
+ * id: CAN ID (SIGNAL_ID_EXTENDED set for 29-bit IDs)
+ * data: Frame data
+ * len: Number of data bytes (DLC)
+ * */
+typedef struct {
+	uint32_t id;
+	uint8_t data[ISOTP_FRAME_LEN];
+	uint32_t len;
+} CANFrame;
+
+/**
+ * CANIdStats
+ *
+ * Traffic statistics of a single CAN ID
+ *
+ * id: CAN ID (SIGNAL_ID_EXTENDED set for 29-bit IDs)
+ * count: Number of frames received
+ * first: Time first frame was received (us)
+ * last: Time latest frame was received (us)
+ * minPeriod: Shortest time between frames (us)
+ * maxPeriod: Longest time between frames (us)
+ * data: Data of latest frame
+ * len: Number of data bytes of latest frame
+ * changed: Bit n is set if data byte n has ever changed between frames
+ * */
+typedef struct {
+	uint32_t id;
+	uint32_t count;
+	uint64_t first;
+	uint64_t last;
+	uint32_t minPeriod;
+	uint32_t maxPeriod;
+	uint8_t data[ISOTP_FRAME_LEN];
+	uint8_t len;
+	uint8_t changed;
+} CANIdStats;
+
+/**
+ * CANBusStats
+ *
+ * Overall CAN bus statistics
+ *
+ * frames: Number of frames received
+ * untracked: Number of frames whose ID had no room in profiler table
+ * load: Bus load over last complete window (0.1% units)
+ * tec: Transmit error counter
+ * rec: Receive error counter
+ * busOff: Number of times controller went bus off
+ * errorPassive: Number of times controller went error passive
+ * overrun: Number of frames lost as receive FIFO was full
+ * */
+typedef struct {
+	uint32_t frames;
+	uint32_t untracked;
+	uint32_t load;
+	uint8_t tec;
+	uint8_t rec;
+	uint32_t busOff;
+	uint32_t errorPassive;
+	uint32_t overrun;
+} CANBusStats;
+
+/**
+ * CANRequest
+ *
+ * Request queued for CAN task
+ *
+ * bus: Request to send
+ * ecu: Response ID of ECU to send request to, OBD_CAN_ID_REQUEST to send to all ECUs
+ * 		(first ECU to respond completes request)
+ * reply: Reply slot to store response, status is BUS_NULL until response is stored (NULL
+ * 		  to send response to queueCANResponse instead)
+ * caller: Task to notify (OBD_CAN_NOTIFY_INDEX) once response is stored
+ * */
+typedef struct {
+	BusRequest bus;
+	uint32_t ecu;
+	BusResponse* reply;
+	TaskHandle_t caller;
+} CANRequest;
+
+/**
+ * CANSlot
+ *
+ * Request in flight to an ECU (or to all ECUs)
+ *
+ * req: Request which was sent
+ * resp: Response being received, data is only used when request has no reply slot (it
+ * 		 is reassembled straight into the reply slot otherwise)
+ * busy: True if request is in flight
+ * deadline: Time response must arrive by (us)
+ * */
+typedef struct {
+	CANRequest req;
+	BusResponse resp;
+	bool busy;
+	uint64_t deadline;
+} CANSlot;
+
 // Function prototypes
 TaskHandle_t task_obd_can_get_handle(void);
-BusStatus obd_can_send_data(uint8_t* data, uint32_t len);
-uint32_t obd_can_get_data(uint8_t* dest);
+void obd_can_hardware_init(void);
+void obd_can_set_isotp_config(const IsoTpConfig* cfg);
+void obd_can_get_isotp_config(IsoTpConfig* dest);
+void obd_can_set_listen_only(bool enable);
+bool obd_can_is_listen_only(void);
+bool obd_can_get_config(CANConfig* dest);
+bool obd_can_take_detected_config(CANConfig* dest);
+void obd_can_profile_reset(void);
+uint32_t obd_can_profile_report(CANIdStats* dest, uint32_t max);
+uint32_t obd_can_profile_avg_period(const CANIdStats* stats);
+void obd_can_get_bus_stats(CANBusStats* dest);
+BusStatus obd_can_submit(uint32_t ecu, BusRequest* req, BusResponse* reply);
+BusStatus obd_can_wait(BusResponse* reply);
 BusStatus obd_can_make_request(BusRequest* req, BusResponse* resp);
 void task_init_obd_can(void);
 
@@ -0,0 +1,101 @@
+/*
+ * isotp.h
+ *
+ *  Created on: 18 Oct. 2026
+ *      Author: rhett
+ */
+
+#ifndef DGOS_INCLUDE_ISOTP_H_
+#define DGOS_INCLUDE_ISOTP_H_
+
+#include <dgas_types.h>
+#include <bus.h>
+#include <stdbool.h>
+
+// all ISO-TP frames are sent with 8 data bytes, unused bytes are padded
+#define ISOTP_FRAME_LEN				8
+#define ISOTP_FRAME_PAD				0x55
+
+// protocol control information (PCI). Upper nibble of first byte is frame type
+#define ISOTP_PCI_TYPE_MASK			0xF0
+#define ISOTP_PCI_SINGLE			0x00
+#define ISOTP_PCI_FIRST				0x10
+#define ISOTP_PCI_CONSECUTIVE		0x20
+#define ISOTP_PCI_FLOW_CONTROL		0x30
+// lower nibble holds single frame length, upper 4 bits of first frame length, sequence
+// number of consecutive frame or flow status of flow control frame
+#define ISOTP_PCI_LOW_MASK			0x0F
+
+#define ISOTP_SF_DATA_MAX			7
+#define ISOTP_FF_DATA_LEN			6
+#define ISOTP_CF_DATA_LEN			7
+#define ISOTP_FC_LEN				3
+// first frame length is 12 bits
+#define ISOTP_MESSAGE_MAX			4095
+
+// flow status of flow control frame
+#define ISOTP_FS_CTS				0
+#define ISOTP_FS_WAIT				1
+#define ISOTP_FS_OVERFLOW			2
+
+// STmin 0x00 - 0x7F is in ms, 0xF1 - 0xF9 is 100 - 900us, reserved values mean 0x7F
+#define ISOTP_STMIN_MS_MAX			0x7F
+#define ISOTP_STMIN_US_FIRST		0xF1
+#define ISOTP_STMIN_US_LAST			0xF9
+#define ISOTP_STMIN_US_STEP			100
+
+// N_Bs: time to wait for flow control, N_Cr: time to wait for consecutive frame (ms)
+#define ISOTP_TIMEOUT_BS			1000
+#define ISOTP_TIMEOUT_CR			1000
+// most WAIT flow control frames accepted in a row (N_WFTmax)
+#define ISOTP_WAIT_MAX				8
+
+// source ID accepting frames from any ECU
+#define ISOTP_ANY_ID				0xFFFFFFFF
+
+typedef BusStatus (*IsoTpSend) (uint32_t, uint8_t*, uint32_t);
+typedef BusStatus (*IsoTpRecv) (uint32_t, uint32_t*, uint8_t*, uint32_t*, uint32_t);
+typedef uint32_t (*IsoTpFlowId) (uint32_t);
+
+/**
+ * IsoTpLink
+ *
+ * CAN link ISO-TP runs on. Normally the CAN driver, on a host build it can be a virtual
+ * ECU.
+ *
+ * send: Send a frame (ID, data, length)
+ * recv: Receive next frame from an ID (ISOTP_ANY_ID for any) storing its ID, data and
+ * 		 length, waiting up to timeout (ms). Returns BUS_RX_ERROR on timeout
+ * flowId: Get ID to send flow control to for an ECU's response ID
+ * */
+typedef struct {
+	IsoTpSend send;
+	IsoTpRecv recv;
+	IsoTpFlowId flowId;
+} IsoTpLink;
+
+/**
+ * IsoTpConfig
+ *
+ * Flow control parameters
+ *
+ * blockSize: Block size advertised when receiving (0 to receive all frames without
+ * 			  further flow control)
+ * stMin: Separation time advertised when receiving (STmin encoding)
+ * txStMin: Minimum separation time used when sending (STmin encoding), the receiver's
+ * 			STmin is used if it is longer
+ * */
+typedef struct {
+	uint8_t blockSize;
+	uint8_t stMin;
+	uint8_t txStMin;
+} IsoTpConfig;
+
+// Function prototypes
+uint32_t isotp_stmin_to_us(uint8_t stMin);
+BusStatus isotp_send(const IsoTpLink* link, const IsoTpConfig* cfg, uint32_t txId,
+		uint32_t fcId, uint8_t* data, uint32_t len);
+BusStatus isotp_receive(const IsoTpLink* link, const IsoTpConfig* cfg, uint32_t* src,
+		uint8_t* dest, uint32_t destMax, uint32_t* len, uint32_t timeout);
+
+#endif /* DGOS_INCLUDE_ISOTP_H_ */
@@ -9,6 +9,7 @@
 #define INC_KWP_H_
 
 #include <dgas_types.h>
+#include <stdbool.h>
 
 // in bound and out bound queues for KWP bus
 extern QueueHandle_t queueKwpRequest;
@@ -51,6 +52,32 @@ extern QueueHandle_t queueKwpResponse;
 #else
 #define KWP_UART_RX_BUFF_SIZE		64
 #endif
+// size of ring buffer received bytes are handed to tasks through (must be power of 2)
+#define KWP_RX_RING_SIZE			256
+
+// UART4_RX is on DMA1 stream 2 channel 4, check page 248 of reference manual
+#define KWP_UART_DMA_STREAM			DMA1_Stream2
+#define KWP_UART_DMA_CHANNEL		DMA_CHANNEL_4
+#define KWP_UART_DMA_IRQN			DMA1_Stream2_IRQn
+#define KWP_UART_DMA_IFCR			(DMA1->LIFCR)
+#define KWP_UART_DMA_FLAGS			(DMA_LIFCR_CHTIF2 | DMA_LIFCR_CTCIF2 | DMA_LIFCR_CTEIF2 | \
+									 DMA_LIFCR_CDMEIF2 | DMA_LIFCR_CFEIF2)
+#define __KWP_UART_DMA_CLK_EN()		__HAL_RCC_DMA1_CLK_ENABLE()
+
+// hardware timer which paces transmitted bytes (1MHz count)
+#define KWP_TX_TIMER				TIM7
+#define KWP_TX_TIMER_IRQN			TIM7_IRQn
+#define __KWP_TX_TIMER_CLK_EN()		__HAL_RCC_TIM7_CLK_ENABLE()
+// APB1 timers run at twice PCLK1 as APB1 prescaler is not 1
+#define KWP_TX_TIMER_CLK_HZ()		(HAL_RCC_GetPCLK1Freq() * 2)
+#define KWP_TX_TIMER_TICK_HZ		1000000
+
+// task notification index used to wake tasks waiting on received bytes. Flash requests
+// use index 0 and OBD requests use index 1
+#if (configTASK_NOTIFICATION_ARRAY_ENTRIES < 3)
+#error "configTASK_NOTIFICATION_ARRAY_ENTRIES must be >= 3"
+#endif
+#define KWP_NOTIFY_INDEX			2
 
 // K and L line high and low macros. Note L-Line control circuitry is active low
 #define L_LINE_LOW()		HAL_GPIO_WritePin(L_LINE_PORT, L_LINE_PIN, 1)
@@ -69,17 +96,91 @@ extern QueueHandle_t queueKwpResponse;
 
 #define KWP_BUS_PID_OFFSET	0x40
 
-#define KWP_INTERBYTE_DELAY 5
+// ISO 14230 fast init. Bus must be idle for W5 before the TiniL low, Twup wake up pattern
+#define KWP_FAST_INIT_IDLE_US		300000
+#define KWP_FAST_INIT_LOW_US		25000
+#define KWP_FAST_INIT_WAKEUP_US		50000
+// StartCommunication request is [format, target, source, service, checksum] with a
+// single data byte
+#define KWP_FAST_INIT_FORMAT		0xC1
+#define KWP_SID_START_COMM			0x81
+#define KWP_FAST_INIT_REQUEST_SIZE	5
+
+// session keep alive. TesterPresent is sent when bus has been idle for P3max less margin,
+// any response (positive or negative) shows session is still up
+#define KWP_SID_TESTER_PRESENT		0x3E
+#define KWP_KEEPALIVE_MARGIN_US		1000000
+#define KWP_KEEPALIVE_TIMEOUT		100
+// time between attempts to re-establish a lost session (ms)
+#define KWP_REINIT_RETRY			1000
+
+// ISO 14230-2 default timing parameters (us)
+// P1: inter-byte time of ECU response
+#define KWP_TIMING_P1_MAX			20000
+// P2: time between end of request and start of response
+#define KWP_TIMING_P2_MIN			25000
+#define KWP_TIMING_P2_MAX			50000
+// P3: time between end of response and start of next request
+#define KWP_TIMING_P3_MIN			55000
+#define KWP_TIMING_P3_MAX			5000000
+// P4: inter-byte time of tester request (spec minimum is 0)
+#define KWP_TIMING_P4_MIN			5000
+#define KWP_TIMING_P4_LIMIT			20000
+#define KWP_TIMING_DEFAULTS			{.p1Max = KWP_TIMING_P1_MAX, .p2Min = KWP_TIMING_P2_MIN, \
+									 .p2Max = KWP_TIMING_P2_MAX, .p3Min = KWP_TIMING_P3_MIN, \
+									 .p3Max = KWP_TIMING_P3_MAX, .p4Min = KWP_TIMING_P4_MIN}
+// time taken to send a single byte on the wire (start bit, 8 data bits, stop bit)
+#define KWP_BYTE_TIME_US			((10 * 1000000) / KWP_BUS_BAUD_RATE)
+// extra time allowed for a transmit to complete before giving up
+#define KWP_TX_MARGIN_US			10000
+// extra time allowed past P2max for the first byte of a response
+#define KWP_RESPONSE_MARGIN_US		5000
+// time to wait for each further frame of a gathered response (ms), kept at the default
+// P2max so a negotiated P2max doesn't cut off slower ECUs answering a functional request
+#define KWP_GATHER_TIMEOUT			((KWP_TIMING_P2_MAX + KWP_RESPONSE_MARGIN_US + 999) / 1000)
+
+// AccessTimingParameters service, timing parameter identifiers (TPI)
+#define KWP_SID_ACCESS_TIMING		0x83
+#define KWP_ATP_READ_LIMITS			0x00
+#define KWP_ATP_SET_VALUES			0x03
+// timing parameter bytes are [P2min, P2max, P3min, P3max, P4min]
+#define KWP_ATP_PARAM_COUNT			5
+#define KWP_ATP_P2_MIN				0
+#define KWP_ATP_P2_MAX				1
+#define KWP_ATP_P3_MIN				2
+#define KWP_ATP_P3_MAX				3
+#define KWP_ATP_P4_MIN				4
+// response is [SID + offset, TPI, parameters...]
+#define KWP_ATP_RESPONSE_PARAMS		2
+// resolution of timing parameter bytes (us per bit)
+#define KWP_ATP_MIN_RES_US			500
+#define KWP_ATP_P2_MAX_RES_US		25000
+#define KWP_ATP_P3_MAX_RES_US		250000
+#define KWP_ATP_TIMEOUT				100
+// number of requests request cadence is measured over before and after negotiation
+#define KWP_CADENCE_SAMPLES			16
+// gaps between requests longer than this are idle time and aren't measured (us)
+#define KWP_CADENCE_IDLE_US			1000000
+// smoothing of measured request period (new sample is weighted 1 / 2^n)
+#define KWP_CADENCE_SMOOTHING		3
 
 #define KWP_HEADER_SIZE 		3 // 3 header bytes
 #define KWP_HEADER_ONE 			0xC2
+// format byte with physical addressing, lower bits hold number of data bytes
+#define KWP_HEADER_FORMAT		0xC0
 #define KWP_HEADER_TWO 			0x33
 #define KWP_HEADER_THREE 		0xF1
 #define KWP_DATA_SIZE_MASK 		0b111111 // mask to apply to format byte to know how many bytes are to follow
 #define KWP_OFFSET_DATA_START 	3
 #define KWP_OBD_MODE_INDEX		3
-#define KWP_GET_MSG_SIZE_FROM_FBYTE(fByte) ((fByte & KWP_DATA_SIZE_MASK) + KWP_HEADER_SIZE + 1)
-#define KWP_GET_CHECKSUM_FROM_MSG(msg, msgSize) (msg[msgSize - 1]) // checksum is last byte of message
+// address mode bits of format byte, non-zero if target and source bytes follow it
+#define KWP_FORMAT_ADDR_MASK	0xC0
+#define KWP_ADDR_SIZE			2
+#define KWP_FRAME_SOURCE_INDEX	2
+// data length of zero in format byte means a separate length byte follows the header
+#define KWP_LENGTH_MAX			255
+// format, target, source, length, data and checksum
+#define KWP_FRAME_MAX			(1 + KWP_ADDR_SIZE + 1 + KWP_LENGTH_MAX + 1)
 
 #define TASK_KWP_PRIORITY (tskIDLE_PRIORITY + 5)
 #define TASK_KWP_STACK_SIZE (configMINIMAL_STACK_SIZE * 6)
@@ -91,9 +192,85 @@ typedef struct {
 	uint8_t kwTwo;
 } KWPInit;
 
+/**
+ * KWPTiming
+ *
+ * ISO 14230 timing parameters of KWP bus (all in us)
+ *
+ * p1Max: Maximum inter-byte time of ECU response
+ * p2Min: Minimum time between request and response
+ * p2Max: Maximum time between request and response
+ * p3Min: Minimum time between response and next request
+ * p3Max: Maximum time between requests before session is lost
+ * p4Min: Inter-byte time used when transmitting requests
+ * */
+typedef struct {
+	uint32_t p1Max;
+	uint32_t p2Min;
+	uint32_t p2Max;
+	uint32_t p3Min;
+	uint32_t p3Max;
+	uint32_t p4Min;
+} KWPTiming;
+
+/**
+ * KWPSessionStats
+ *
+ * Statistics of KWP session management
+ *
+ * keepAlive: Number of keep alive requests sent
+ * lost: Number of times session was found to be lost
+ * reinit: Number of attempts to re-establish session
+ * reinitFail: Number of failed attempts to re-establish session
+ * */
+typedef struct {
+	uint32_t keepAlive;
+	uint32_t lost;
+	uint32_t reinit;
+	uint32_t reinitFail;
+} KWPSessionStats;
+
+/**
+ * KWPCadence
+ *
+ * Achieved request cadence of KWP bus (requests per 1000 seconds)
+ *
+ * current: Cadence with current timing parameters
+ * before: Cadence with default timing parameters (0 if not measured yet)
+ * after: Cadence with negotiated timing parameters (0 if not measured yet)
+ * */
+typedef struct {
+	uint32_t current;
+	uint32_t before;
+	uint32_t after;
+} KWPCadence;
+
+// state of timing parameter negotiation
+typedef enum {
+	KWP_TIMING_DEFAULT,
+	KWP_TIMING_NEGOTIATED,
+	KWP_TIMING_SETTLED
+} KWPTimingState;
+
+// KWP bus initialisation methods
+typedef enum {
+	KWP_INIT_UNKNOWN,
+	KWP_INIT_FAST,
+	KWP_INIT_FIVE_BAUD
+} KWPInitMethod;
+
 // Function prototypes
 TaskHandle_t task_kwp_get_handle(void);
+void kwp_bus_rx_flush(void);
 void kwp_bus_five_baud_init(void);
+BusStatus kwp_bus_fast_init(void);
+KWPInitMethod kwp_bus_get_init_method(void);
+BusStatus kwp_bus_set_timing(const KWPTiming* timing);
+void kwp_bus_get_timing(KWPTiming* dest);
+uint32_t kwp_bus_response_timeout(void);
+void kwp_bus_get_cadence(KWPCadence* dest);
+bool kwp_bus_get_negotiated_timing(uint8_t* dest);
+void kwp_bus_get_session_stats(KWPSessionStats* dest);
 BusStatus kwp_bus_write_byte(uint8_t byte);
 BusStatus kwp_bus_read_byte(uint8_t* dest, uint32_t timeout);
 BusStatus kwp_bus_write(uint8_t* data, uint32_t len);
@@ -102,9 +279,9 @@ uint8_t kwp_bus_calc_checksum(uint8_t* data, uint32_t size);
 BusStatus kwp_bus_get_init_response(KWPInit* init);
 BusStatus kwp_bus_init(void);
 BusStatus kwp_bus_make_request(BusRequest* req);
-void kwp_bus_extract_data(uint8_t* response, uint32_t dataSize, uint8_t* dest);
 BusStatus kwp_bus_get_response(BusResponse* resp, uint32_t timeout);
 BusStatus kwp_bus_handle_request(BusRequest* busReq, BusResponse* busResp);
+void kwp_bus_suspend(void);
 void task_init_kwp_bus(void);
 
 #endif /* INC_KWP_H_ */
@@ -0,0 +1,130 @@
+/*
+ * uds.h
+ *
+ *  Created on: 18 Oct. 2026
+ *      Author: rhett
+ */
+
+#ifndef DGOS_INCLUDE_UDS_H_
+#define DGOS_INCLUDE_UDS_H_
+
+#include <dgas_types.h>
+#include <bus.h>
+#include <stdbool.h>
+
+// UDS (ISO 14229) services
+#define UDS_SID_SESSION					0x10
+#define UDS_SID_READ_DID				0x22
+#define UDS_SID_PERIODIC				0x2A
+#define UDS_SID_DYNAMIC_DEFINE			0x2C
+#define UDS_SID_TESTER_PRESENT			0x3E
+// positive responses have service + 0x40, negative responses have form [0x7F, service, NRC]
+#define UDS_SID_POSITIVE_OFFSET			0x40
+#define UDS_SID_NEGATIVE				0x7F
+#define UDS_NRC_INDEX					2
+
+// negative response codes
+#define UDS_NRC_NONE					0x00
+#define UDS_NRC_SERVICE_NOT_SUPPORTED	0x11
+#define UDS_NRC_BAD_SUB_FUNCTION		0x12
+#define UDS_NRC_OUT_OF_RANGE			0x31
+
+// data identifiers are sent high byte first
+#define UDS_DID_LEN						2
+#define UDS_DID_HIGH(did)				(((did) >> 8) & 0xFF)
+#define UDS_DID_LOW(did)				((did) & 0xFF)
+// OBD mode 01 PIDs can be read as DIDs 0xF400 - 0xF4FF (ISO 27145)
+#define UDS_DID_OBD_PID(pid)			(0xF400 | (pid))
+// dynamically defined record holding every displayed channel (DIDs 0xF200 - 0xF3FF can
+// be dynamically defined)
+#define UDS_DID_RECORD					0xF300
+// most DIDs in a single ReadDataByIdentifier request
+#define UDS_READ_DID_MAX				((BUS_REQUEST_MAX - 1) / UDS_DID_LEN)
+
+// DiagnosticSessionControl sessions
+#define UDS_SESSION_DEFAULT				0x01
+#define UDS_SESSION_EXTENDED			0x03
+// TesterPresent keeps a non-default session open, ECU falls back to default session after
+// S3 (5s) without requests
+#define UDS_TESTER_PRESENT_PERIOD		2000
+
+// ReadDataByPeriodicIdentifier transmission modes, actual rates are picked by ECU
+#define UDS_PERIODIC_SLOW				0x01
+#define UDS_PERIODIC_MEDIUM				0x02
+#define UDS_PERIODIC_FAST				0x03
+#define UDS_PERIODIC_STOP				0x04
+// ECU has stopped streaming once an identifier has gone this many slow rate periods (ms)
+// without a frame
+#define UDS_PERIODIC_SLOW_PERIOD		1000
+#define UDS_PERIODIC_LOST_PERIODS		3
+// periodic identifier xx is DID 0xF2xx, which is dynamically defined from OBD PIDs. Each
+// periodic frame is sent without ISO-TP PCI as [xx, data...] (type 1), or as a single
+// frame [PCI, 0x6A, xx, data...] (type 2), on ECU's response ID. Only xx of 0xE0 - 0xEF
+// are used as 0xEx is never a valid PCI byte so type 1 frames can't be mistaken for
+// ISO-TP frames
+#define UDS_DID_PERIODIC(id)			(0xF200 | (id))
+#define UDS_PERIODIC_ID_FIRST			0xE0
+#define UDS_PERIODIC_ID_MASK			0xF0
+#define UDS_PERIODIC_ID_COUNT			16
+// data bytes an identifier is packed to. Type 1 frames carry 7 but type 2 frames only
+// carry 5 and ECU picks the type, so identifiers are packed to fit either
+#define UDS_PERIODIC_DATA_MAX			5
+
+// DynamicallyDefineDataIdentifier sub-functions
+#define UDS_DDDI_DEFINE_BY_ID			0x01
+#define UDS_DDDI_CLEAR					0x03
+// request is [0x2C, sub-function, DID] followed by [source DID, position, size] for
+// each source, position is 1 based
+#define UDS_DDDI_HEADER_LEN				4
+#define UDS_DDDI_SOURCE_LEN				4
+#define UDS_DDDI_SOURCES_MAX			((BUS_REQUEST_MAX - UDS_DDDI_HEADER_LEN) / UDS_DDDI_SOURCE_LEN)
+
+/**
+ * UDSDataId
+ *
+ * Data identifier read with ReadDataByIdentifier or used as source of a dynamically
+ * defined record
+ *
+ * did: Data identifier
+ * len: Number of data bytes ECU responds with for identifier
+ * */
+typedef struct {
+	uint16_t did;
+	uint8_t len;
+} UDSDataId;
+
+/**
+ * UDSPeriodic
+ *
+ * Periodic identifier streamed by ECU, a dynamically defined record of OBD PIDs
+ *
+ * id: Periodic identifier (low byte of DID 0xF2xx)
+ * mode: Transmission mode (UDS_PERIODIC_FAST etc.)
+ * pids: Mode 01 PIDs record is made of, in record order
+ * count: Number of PIDs
+ * */
+typedef struct {
+	uint8_t id;
+	uint8_t mode;
+	uint8_t pids[UDS_PERIODIC_DATA_MAX];
+	uint8_t count;
+} UDSPeriodic;
+
+// Function prototypes
+uint8_t uds_nrc(const BusResponse* resp);
+BusStatus uds_request(uint32_t ecu, uint8_t* data, uint32_t len, BusResponse* resp, uint32_t timeout);
+BusStatus uds_read_dids(uint32_t ecu, const UDSDataId* dids, uint32_t count, BusResponse* resp,
+		uint32_t timeout);
+uint32_t uds_split_dids(BusResponse* resp, const UDSDataId* dids, uint32_t count, uint8_t** dest);
+BusStatus uds_define_record(uint32_t ecu, uint16_t record, const UDSDataId* sources, uint32_t count,
+		BusResponse* resp, uint32_t timeout);
+BusStatus uds_clear_record(uint32_t ecu, uint16_t record, BusResponse* resp, uint32_t timeout);
+bool uds_periodic_start(uint32_t ecu, const UDSPeriodic* ids, uint32_t count, uint32_t timeout);
+void uds_periodic_stop(uint32_t timeout);
+bool uds_periodic_keep_alive(uint32_t timeout);
+bool uds_periodic_matches(const UDSPeriodic* ids, uint32_t count);
+bool uds_periodic_feeds(uint8_t pid);
+int32_t uds_periodic_frame(uint32_t id, const uint8_t* data, uint32_t len);
+void uds_periodic_decode(uint32_t id, uint8_t* data, uint32_t len, uint32_t timestamp);
+
+#endif /* DGOS_INCLUDE_UDS_H_ */
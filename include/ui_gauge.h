@@ -23,6 +23,10 @@
 #define UI_GAUGE_VBAT_BUFF_LEN				32
 #define UI_GAUGE_PARAM_MAX_BUFF_LEN			32
 #define UI_GAUGE_TICK_BUFF_LEN				32
+// arc range is scaled so needle can move in steps finer than one unit of parameter
+#define UI_GAUGE_ARC_SCALE					10
+// colour of value and arc when value is stale
+#define UI_GAUGE_STALE_COLOUR				0xFF808080U
 
 void ui_gauge_make_request(UICmd cmd, void* arg);
 void ui_gauge_init(void);